@@ -0,0 +1,662 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    // The part of JSON the scripts use: objects, arrays, numbers, strings, true, false and null
+    struct JsonValue {
+
+        enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+        Type type;
+        double number;
+        std::string text;
+        std::vector<JsonValue> items;
+        std::vector<std::string> keys;      // of an object, paired with items
+
+        JsonValue() : type(JSON_NULL), number(0.0) {}
+
+        const JsonValue* Find(const char* key) const {
+
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (keys[i] == key) {
+                    return &items[i];
+                }
+            }
+            return NULL;
+        }
+    };
+
+    class JsonReader {
+
+    public:
+        JsonReader(const std::string& text) : text(text), position(0) {}
+
+        bool Parse(JsonValue* value) {
+
+            if (!ParseValue(value, 0)) {
+                return false;
+            }
+            SkipSpace();
+            return position == text.size() || Fail("trailing characters");
+        }
+
+        const std::string& getError() const {
+            return error;
+        }
+
+    private:
+        static const int MAX_DEPTH = 32;
+
+        const std::string& text;
+        size_t position;
+        std::string error;
+
+        bool Fail(const char* message) {
+
+            if (error.empty()) {
+                size_t line = 1 + std::count(text.begin(), text.begin() + std::min(position, text.size()), '\n');
+                error = std::string(message) + " on line " + std::to_string(line);
+            }
+            return false;
+        }
+
+        void SkipSpace() {
+            while (position < text.size() && isspace((unsigned char)text[position])) {
+                position++;
+            }
+        }
+
+        bool Consume(char c) {
+
+            SkipSpace();
+            if (position < text.size() && text[position] == c) {
+                position++;
+                return true;
+            }
+            return false;
+        }
+
+        bool ConsumeWord(const char* word) {
+
+            size_t length = strlen(word);
+            if (text.compare(position, length, word) == 0) {
+                position += length;
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseValue(JsonValue* value, int depth) {
+
+            if (depth > MAX_DEPTH) {
+                return Fail("nested too deeply");
+            }
+
+            SkipSpace();
+            if (position >= text.size()) {
+                return Fail("unexpected end of file");
+            }
+
+            char c = text[position];
+            if (c == '{') {
+                return ParseObject(value, depth);
+            }
+            if (c == '[') {
+                return ParseArray(value, depth);
+            }
+            if (c == '"') {
+                value->type = JsonValue::JSON_STRING;
+                return ParseString(&value->text);
+            }
+            if (ConsumeWord("true") || ConsumeWord("false")) {
+                value->type = JsonValue::JSON_BOOL;
+                value->number = c == 't' ? 1.0 : 0.0;
+                return true;
+            }
+            if (ConsumeWord("null")) {
+                value->type = JsonValue::JSON_NULL;
+                return true;
+            }
+
+            const char* start = text.c_str() + position;
+            char* end = NULL;
+            value->number = strtod(start, &end);
+            if (end == start) {
+                return Fail("expected a value");
+            }
+            value->type = JsonValue::JSON_NUMBER;
+            position += end - start;
+            return true;
+        }
+
+        bool ParseString(std::string* out) {
+
+            // the opening quote
+            position++;
+            while (position < text.size() && text[position] != '"') {
+
+                char c = text[position++];
+                if (c != '\\') {
+                    out->push_back(c);
+                    continue;
+                }
+                if (position >= text.size()) {
+                    break;
+                }
+
+                // \uXXXX is kept as is, the scripts only need it in names nobody reads
+                char escaped = text[position++];
+                switch (escaped) {
+                case 'n': out->push_back('\n'); break;
+                case 't': out->push_back('\t'); break;
+                case 'r': out->push_back('\r'); break;
+                case 'b': out->push_back('\b'); break;
+                case 'f': out->push_back('\f'); break;
+                case 'u': out->append("\\u"); break;
+                default: out->push_back(escaped); break;
+                }
+            }
+
+            if (position >= text.size()) {
+                return Fail("unterminated string");
+            }
+            position++;
+            return true;
+        }
+
+        bool ParseArray(JsonValue* value, int depth) {
+
+            value->type = JsonValue::JSON_ARRAY;
+            position++;
+            if (Consume(']')) {
+                return true;
+            }
+
+            do {
+                value->items.push_back(JsonValue());
+                if (!ParseValue(&value->items.back(), depth + 1)) {
+                    return false;
+                }
+            } while (Consume(','));
+
+            return Consume(']') || Fail("expected ',' or ']'");
+        }
+
+        bool ParseObject(JsonValue* value, int depth) {
+
+            value->type = JsonValue::JSON_OBJECT;
+            position++;
+            if (Consume('}')) {
+                return true;
+            }
+
+            do {
+                SkipSpace();
+                if (position >= text.size() || text[position] != '"') {
+                    return Fail("expected a key");
+                }
+                value->keys.push_back(std::string());
+                if (!ParseString(&value->keys.back())) {
+                    return false;
+                }
+                if (!Consume(':')) {
+                    return Fail("expected ':'");
+                }
+                value->items.push_back(JsonValue());
+                if (!ParseValue(&value->items.back(), depth + 1)) {
+                    return false;
+                }
+            } while (Consume(','));
+
+            return Consume('}') || Fail("expected ',' or '}'");
+        }
+    };
+
+    // Reads an optional number member, fails on a member of another type
+    static bool ReadNumber(const JsonValue& object, const char* key, double* out, std::string* error) {
+
+        const JsonValue* member = object.Find(key);
+        if (member == NULL) {
+            return true;
+        }
+        if (member->type != JsonValue::JSON_NUMBER) {
+            *error = std::string("\"") + key + "\" is not a number";
+            return false;
+        }
+        *out = member->number;
+        return true;
+    }
+
+    static bool ReadCameraKey(const JsonValue& object, BenchmarkCameraKey* key, std::string* error) {
+
+        if (object.type != JsonValue::JSON_OBJECT) {
+            *error = "a camera key is not an object";
+            return false;
+        }
+
+        const JsonValue* position = object.Find("position");
+        if (position == NULL || position->type != JsonValue::JSON_ARRAY || position->items.size() != 3) {
+            *error = "a camera key has no \"position\" of three numbers";
+            return false;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            if (position->items[axis].type != JsonValue::JSON_NUMBER) {
+                *error = "a camera key has no \"position\" of three numbers";
+                return false;
+            }
+            key->position[axis] = (float)position->items[axis].number;
+        }
+
+        double time = 0.0, yaw = -90.0, pitch = 0.0;
+        if (!ReadNumber(object, "time", &time, error) || !ReadNumber(object, "yaw", &yaw, error) ||
+            !ReadNumber(object, "pitch", &pitch, error)) {
+            return false;
+        }
+        key->time = time;
+        key->yaw = (float)yaw;
+        key->pitch = (float)pitch;
+        return true;
+    }
+
+    static bool ReadLightKey(const JsonValue& object, BenchmarkLightKey* key, std::string* error) {
+
+        if (object.type != JsonValue::JSON_OBJECT) {
+            *error = "a light key is not an object";
+            return false;
+        }
+
+        double time = 0.0, angle = 0.0, height = 0.0, fog = 0.0;
+        if (!ReadNumber(object, "time", &time, error) || !ReadNumber(object, "angle", &angle, error) ||
+            !ReadNumber(object, "height", &height, error) || !ReadNumber(object, "fog", &fog, error)) {
+            return false;
+        }
+        key->time = time;
+        key->angle = (float)angle;
+        key->height = (float)height;
+        key->fogDensity = (float)fog;
+        return true;
+    }
+
+    static bool ParseScript(const JsonValue& root, BenchmarkScript* script, std::string* error) {
+
+        if (root.type != JsonValue::JSON_OBJECT) {
+            *error = "the script is not an object";
+            return false;
+        }
+
+        double width = 1280.0, height = 720.0, timestep = 1.0 / 60.0, frames = 0.0, warmupFrames = 0.0;
+        if (!ReadNumber(root, "width", &width, error) || !ReadNumber(root, "height", &height, error) ||
+            !ReadNumber(root, "timestep", &timestep, error) || !ReadNumber(root, "frames", &frames, error) ||
+            !ReadNumber(root, "warmupFrames", &warmupFrames, error)) {
+            return false;
+        }
+        if (width < 1.0 || height < 1.0 || timestep <= 0.0 || frames < 0.0 || warmupFrames < 0.0) {
+            *error = "width, height and timestep must be positive, frames and warmupFrames not negative";
+            return false;
+        }
+
+        const JsonValue* output = root.Find("output");
+        if (output != NULL && output->type == JsonValue::JSON_STRING) {
+            script->output = output->text;
+        }
+
+        const JsonValue* camera = root.Find("camera");
+        if (camera == NULL || camera->type != JsonValue::JSON_ARRAY || camera->items.empty()) {
+            *error = "\"camera\" is missing or has no keys";
+            return false;
+        }
+        for (size_t i = 0; i < camera->items.size(); i++) {
+            BenchmarkCameraKey key;
+            if (!ReadCameraKey(camera->items[i], &key, error)) {
+                return false;
+            }
+            script->cameraKeys.push_back(key);
+        }
+
+        const JsonValue* light = root.Find("light");
+        if (light != NULL && light->type == JsonValue::JSON_ARRAY) {
+            for (size_t i = 0; i < light->items.size(); i++) {
+                BenchmarkLightKey key;
+                if (!ReadLightKey(light->items[i], &key, error)) {
+                    return false;
+                }
+                script->lightKeys.push_back(key);
+            }
+        }
+
+        // stable, keys given at the same time keep their order and make a jump
+        std::stable_sort(script->cameraKeys.begin(), script->cameraKeys.end(),
+            [](const BenchmarkCameraKey& a, const BenchmarkCameraKey& b) { return a.time < b.time; });
+        std::stable_sort(script->lightKeys.begin(), script->lightKeys.end(),
+            [](const BenchmarkLightKey& a, const BenchmarkLightKey& b) { return a.time < b.time; });
+
+        script->width = (int)width;
+        script->height = (int)height;
+        script->timestep = timestep;
+        script->warmupFrames = (uint32_t)warmupFrames;
+        script->frames = (uint32_t)frames;
+        if (script->frames == 0) {
+            script->frames = 1 + (uint32_t)(script->cameraKeys.back().time / timestep + 0.5);
+        }
+        return true;
+    }
+
+    bool LoadBenchmarkScript(const std::string& fileName, BenchmarkScript* script) {
+
+        std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+        if (!file) {
+            std::cerr << "ERROR: could not open benchmark script " << fileName << std::endl;
+            return false;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        std::string text = content.str();
+
+        JsonValue root;
+        JsonReader reader(text);
+        if (!reader.Parse(&root)) {
+            std::cerr << "ERROR: benchmark script " << fileName << " : " << reader.getError() << std::endl;
+            return false;
+        }
+
+        *script = BenchmarkScript();
+        std::string error;
+        if (!ParseScript(root, script, &error)) {
+            std::cerr << "ERROR: benchmark script " << fileName << " : " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Index of the key starting the span time falls in and how far along it is
+    template <typename Key>
+    static size_t FindSpan(const std::vector<Key>& keys, double time, float* t) {
+
+        *t = 0.0f;
+        if (time <= keys.front().time) {
+            return 0;
+        }
+        if (time >= keys.back().time) {
+            return keys.size() - 1;
+        }
+
+        size_t next = std::upper_bound(keys.begin(), keys.end(), time,
+            [](double value, const Key& key) { return value < key.time; }) - keys.begin();
+        const Key& a = keys[next - 1];
+        const Key& b = keys[next];
+        *t = (float)((time - a.time) / (b.time - a.time));
+        return next - 1;
+    }
+
+    BenchmarkPose SampleBenchmarkScript(const BenchmarkScript& script, double time) {
+
+        BenchmarkPose pose;
+
+        float t;
+        size_t key = FindSpan(script.cameraKeys, time, &t);
+        const BenchmarkCameraKey& a = script.cameraKeys[key];
+        const BenchmarkCameraKey& b = script.cameraKeys[std::min(key + 1, script.cameraKeys.size() - 1)];
+        pose.position = glm::mix(a.position, b.position, t);
+        pose.yaw = glm::mix(a.yaw, b.yaw, t);
+        pose.pitch = glm::mix(a.pitch, b.pitch, t);
+
+        pose.lightAngle = 0.0f;
+        pose.lightHeight = 0.0f;
+        pose.fogDensity = 0.0f;
+        if (!script.lightKeys.empty()) {
+            key = FindSpan(script.lightKeys, time, &t);
+            const BenchmarkLightKey& la = script.lightKeys[key];
+            const BenchmarkLightKey& lb = script.lightKeys[std::min(key + 1, script.lightKeys.size() - 1)];
+            pose.lightAngle = glm::mix(la.angle, lb.angle, t);
+            pose.lightHeight = glm::mix(la.height, lb.height, t);
+            pose.fogDensity = glm::mix(la.fogDensity, lb.fogDensity, t);
+        }
+
+        return pose;
+    }
+
+    void BenchmarkRecorder::BeginFrame(uint32_t frame, double time) {
+
+        BenchmarkFrame record;
+        record.frame = frame;
+        record.time = time;
+        record.cpuMilliseconds = 0.0;
+        record.gpuMilliseconds = -1.0;
+        record.drawCalls = 0;
+        record.triangles = 0;
+        frames.push_back(record);
+    }
+
+    void BenchmarkRecorder::EndFrame(double cpuMilliseconds, uint64_t drawCalls, uint64_t triangles) {
+
+        BenchmarkFrame& record = frames.back();
+        record.cpuMilliseconds = cpuMilliseconds;
+        record.drawCalls = drawCalls;
+        record.triangles = triangles;
+    }
+
+    BenchmarkFrame* BenchmarkRecorder::FindFrame(uint32_t frame) {
+
+        // frames are recorded in order from 0
+        return frame < frames.size() && frames[frame].frame == frame ? &frames[frame] : NULL;
+    }
+
+    void BenchmarkRecorder::SetGpuTime(uint32_t frame, double milliseconds) {
+
+        BenchmarkFrame* record = FindFrame(frame);
+        if (record != NULL) {
+            record->gpuMilliseconds = milliseconds;
+        }
+    }
+
+    void BenchmarkRecorder::SetPassTime(uint32_t frame, const char* pass, double milliseconds) {
+
+        BenchmarkFrame* record = FindFrame(frame);
+        if (record == NULL) {
+            return;
+        }
+
+        size_t index = std::find(passes.begin(), passes.end(), pass) - passes.begin();
+        if (index == passes.size()) {
+            passes.push_back(pass);
+        }
+
+        std::vector<double>& times = record->passMilliseconds;
+        if (times.size() <= index) {
+            times.resize(index + 1, -1.0);
+        }
+        times[index] = milliseconds;
+    }
+
+    void BenchmarkRecorder::SetCounter(const char* counter, uint64_t value) {
+
+        if (frames.empty()) {
+            return;
+        }
+
+        size_t index = std::find(counters.begin(), counters.end(), counter) - counters.begin();
+        if (index == counters.size()) {
+            counters.push_back(counter);
+        }
+
+        std::vector<uint64_t>& values = frames.back().counters;
+        if (values.size() <= index) {
+            values.resize(index + 1, UINT64_MAX);
+        }
+        values[index] = value;
+    }
+
+    bool BenchmarkRecorder::Write(const std::string& fileName) const {
+
+        FILE* file = fopen(fileName.c_str(), "w");
+        if (file == NULL) {
+            std::cerr << "ERROR: could not write benchmark results " << fileName << std::endl;
+            return false;
+        }
+
+        // pass names as column names, "shadow static" becomes gpu_shadow_static_ms
+        std::vector<std::string> columns;
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            std::string column = "gpu_" + passes[pass] + "_ms";
+            for (size_t i = 0; i < column.size(); i++) {
+                if (!isalnum((unsigned char)column[i])) {
+                    column[i] = '_';
+                }
+            }
+            columns.push_back(column);
+        }
+
+        bool json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+        if (json) {
+            fprintf(file, "{\n  \"frames\": [\n");
+        }
+        else {
+            fprintf(file, "frame,time,cpu_ms,gpu_ms,draw_calls,triangles");
+            for (size_t pass = 0; pass < columns.size(); pass++) {
+                fprintf(file, ",%s", columns[pass].c_str());
+            }
+            for (size_t counter = 0; counter < counters.size(); counter++) {
+                fprintf(file, ",%s", counters[counter].c_str());
+            }
+            fprintf(file, "\n");
+        }
+
+        for (size_t i = 0; i < frames.size(); i++) {
+
+            const BenchmarkFrame& frame = frames[i];
+            char gpu[32] = "";
+            if (frame.gpuMilliseconds >= 0.0) {
+                snprintf(gpu, sizeof(gpu), "%.4f", frame.gpuMilliseconds);
+            }
+
+            if (json) {
+                fprintf(file, "    { \"frame\": %u, \"time\": %.4f, \"cpu_ms\": %.4f, \"gpu_ms\": %s, \"draw_calls\": %llu, \"triangles\": %llu",
+                    frame.frame, frame.time, frame.cpuMilliseconds, gpu[0] != '\0' ? gpu : "null",
+                    (unsigned long long)frame.drawCalls, (unsigned long long)frame.triangles);
+            }
+            else {
+                fprintf(file, "%u,%.4f,%.4f,%s,%llu,%llu", frame.frame, frame.time, frame.cpuMilliseconds, gpu,
+                    (unsigned long long)frame.drawCalls, (unsigned long long)frame.triangles);
+            }
+
+            for (size_t pass = 0; pass < columns.size(); pass++) {
+                char time[32] = "";
+                if (pass < frame.passMilliseconds.size() && frame.passMilliseconds[pass] >= 0.0) {
+                    snprintf(time, sizeof(time), "%.4f", frame.passMilliseconds[pass]);
+                }
+                if (json) {
+                    fprintf(file, ", \"%s\": %s", columns[pass].c_str(), time[0] != '\0' ? time : "null");
+                }
+                else {
+                    fprintf(file, ",%s", time);
+                }
+            }
+            for (size_t counter = 0; counter < counters.size(); counter++) {
+                char value[32] = "";
+                if (counter < frame.counters.size() && frame.counters[counter] != UINT64_MAX) {
+                    snprintf(value, sizeof(value), "%llu", (unsigned long long)frame.counters[counter]);
+                }
+                if (json) {
+                    fprintf(file, ", \"%s\": %s", counters[counter].c_str(), value[0] != '\0' ? value : "null");
+                }
+                else {
+                    fprintf(file, ",%s", value);
+                }
+            }
+            fprintf(file, json ? (i + 1 < frames.size() ? " },\n" : " }\n") : "\n");
+        }
+
+        if (json) {
+            fprintf(file, "  ]\n}\n");
+        }
+
+        bool written = ferror(file) == 0;
+        written = fclose(file) == 0 && written;
+        if (!written) {
+            std::cerr << "ERROR: could not write benchmark results " << fileName << std::endl;
+        }
+        return written;
+    }
+
+    // avg, p50, p95 and max of the values, which are sorted in place
+    static void PrintDistribution(const char* name, std::vector<double>& values) {
+
+        if (values.empty()) {
+            fprintf(stdout, "  %s : not available\n", name);
+            return;
+        }
+
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); i++) {
+            sum += values[i];
+        }
+        fprintf(stdout, "  %s : avg %.3f ms, p50 %.3f ms, p95 %.3f ms, max %.3f ms\n", name, sum / values.size(),
+            values[values.size() / 2], values[std::min(values.size() - 1, values.size() * 95 / 100)], values.back());
+    }
+
+    void BenchmarkRecorder::PrintSummary() const {
+
+        if (frames.empty()) {
+            return;
+        }
+
+        std::vector<double> cpu, gpu;
+        double drawCalls = 0.0, triangles = 0.0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            cpu.push_back(frames[i].cpuMilliseconds);
+            if (frames[i].gpuMilliseconds >= 0.0) {
+                gpu.push_back(frames[i].gpuMilliseconds);
+            }
+            drawCalls += (double)frames[i].drawCalls;
+            triangles += (double)frames[i].triangles;
+        }
+
+        fprintf(stdout, "Benchmark : %zu frames, %.1f draw calls and %.0f triangles per frame\n",
+            frames.size(), drawCalls / frames.size(), triangles / frames.size());
+        PrintDistribution("CPU", cpu);
+        PrintDistribution("GPU", gpu);
+
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            std::vector<double> times;
+            for (size_t i = 0; i < frames.size(); i++) {
+                if (pass < frames[i].passMilliseconds.size() && frames[i].passMilliseconds[pass] >= 0.0) {
+                    times.push_back(frames[i].passMilliseconds[pass]);
+                }
+            }
+            std::string name = "GPU " + passes[pass];
+            PrintDistribution(name.c_str(), times);
+        }
+
+        for (size_t counter = 0; counter < counters.size(); counter++) {
+            double sum = 0.0;
+            uint64_t worst = 0;
+            size_t count = 0;
+            for (size_t i = 0; i < frames.size(); i++) {
+                if (counter < frames[i].counters.size() && frames[i].counters[counter] != UINT64_MAX) {
+                    sum += (double)frames[i].counters[counter];
+                    worst = std::max(worst, frames[i].counters[counter]);
+                    count++;
+                }
+            }
+            if (count > 0) {
+                fprintf(stdout, "  %s : avg %.1f, max %llu\n", counters[counter].c_str(), sum / count,
+                    (unsigned long long)worst);
+            }
+        }
+    }
+
+    const std::vector<BenchmarkFrame>& BenchmarkRecorder::getFrames() const {
+
+        return frames;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct BenchmarkCameraKey {
+
+        double time;
+        glm::vec3 position;
+        float yaw;                  // degrees, as the mouse look uses them
+        float pitch;
+    };
+
+    struct BenchmarkLightKey {
+
+        double time;
+        float angle;                // degrees around the y axis
+        float height;               // the light's vertical movement, the sine of it is the y of lightDir
+        float fogDensity;
+    };
+
+    // Camera and light at one instant of a script
+    struct BenchmarkPose {
+
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+        float lightAngle;
+        float lightHeight;
+        float fogDensity;
+    };
+
+    // A recorded flight through the scene, read from JSON:
+    //   { "width": 1280, "height": 720, "timestep": 0.0166667, "frames": 600, "warmupFrames": 30,
+    //     "output": "benchmark.csv",
+    //     "camera": [ { "time": 0, "position": [0, 10, 20], "yaw": -90, "pitch": -20 }, ... ],
+    //     "light": [ { "time": 0, "angle": 0, "height": 0.8, "fog": 0 }, ... ] }
+    // Only the camera keys are required. Keys are sorted by time and interpolated linearly, the pose
+    // holds at the first and last key; frames defaults to the last key time over the timestep.
+    struct BenchmarkScript {
+
+        int width;
+        int height;
+        double timestep;
+        uint32_t frames;
+        uint32_t warmupFrames;      // rendered first and left out of the results
+        std::string output;         // may be empty
+        std::vector<BenchmarkCameraKey> cameraKeys;
+        std::vector<BenchmarkLightKey> lightKeys;
+    };
+
+    // Reports what is wrong with the file on stderr and fails
+    bool LoadBenchmarkScript(const std::string& fileName, BenchmarkScript* script);
+
+    BenchmarkPose SampleBenchmarkScript(const BenchmarkScript& script, double time);
+
+    struct BenchmarkFrame {
+
+        uint32_t frame;
+        double time;                // script time the frame was rendered at
+        double cpuMilliseconds;
+        double gpuMilliseconds;     // negative until the GPU profiler reads the frame back
+        uint64_t drawCalls;
+        uint64_t triangles;
+        std::vector<double> passMilliseconds;   // by pass of the recorder, negative where not timed
+        std::vector<uint64_t> counters;         // by counter of the recorder, UINT64_MAX where not set
+    };
+
+    // Collects the per-frame numbers of a benchmark run. The GPU times come from the GPU profiler, which
+    // reads them back a few frames later so the CPU does not wait on them: the whole frame is timed as a
+    // zone of its own, the passes as theirs.
+    class BenchmarkRecorder {
+
+    public:
+        void BeginFrame(uint32_t frame, double time);
+        void EndFrame(double cpuMilliseconds, uint64_t drawCalls, uint64_t triangles);
+
+        // GPU time of a whole recorded frame
+        void SetGpuTime(uint32_t frame, double milliseconds);
+
+        // GPU time of a named pass within a recorded frame
+        void SetPassTime(uint32_t frame, const char* pass, double milliseconds);
+
+        // An integer column of the frame just ended, the GL call counts
+        void SetCounter(const char* counter, uint64_t value);
+
+        // CSV, or JSON when the name ends in .json
+        bool Write(const std::string& fileName) const;
+
+        // Average, median, 95th percentile and worst frame
+        void PrintSummary() const;
+
+        const std::vector<BenchmarkFrame>& getFrames() const;
+
+    private:
+        std::vector<BenchmarkFrame> frames;
+        std::vector<std::string> passes;
+        std::vector<std::string> counters;
+
+        // the recorded frame number, NULL for one not recorded
+        BenchmarkFrame* FindFrame(uint32_t frame);
+    };
+}
+
+#endif /* Benchmark_hpp */
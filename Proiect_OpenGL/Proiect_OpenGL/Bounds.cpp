@@ -0,0 +1,227 @@
+#include "Bounds.hpp"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GPS_BOUNDS_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    void ComputeBounds(const void* positions, size_t count, size_t stride, BoundingBox* box, BoundingSphere* sphere) {
+
+        const unsigned char* bytes = (const unsigned char*)positions;
+
+        if (count == 0) {
+            box->min = glm::vec3(0.0f);
+            box->max = glm::vec3(0.0f);
+            sphere->center = glm::vec3(0.0f);
+            sphere->radius = 0.0f;
+            return;
+        }
+
+        box->min = glm::vec3(FLT_MAX);
+        box->max = glm::vec3(-FLT_MAX);
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3& p = *(const glm::vec3*)(bytes + i * stride);
+            box->min = glm::min(box->min, p);
+            box->max = glm::max(box->max, p);
+        }
+
+        // tighter than half the diagonal for anything that does not fill its box corners
+        sphere->center = (box->min + box->max) * 0.5f;
+        float radius2 = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3& p = *(const glm::vec3*)(bytes + i * stride);
+            glm::vec3 d = p - sphere->center;
+            radius2 = glm::max(radius2, glm::dot(d, d));
+        }
+        sphere->radius = std::sqrt(radius2);
+    }
+
+    Frustum::Frustum() {
+
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        SplitPlanes();
+    }
+
+    Frustum::Frustum(const glm::mat4& m) {
+
+        // rows of the clip matrix, glm stores columns
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        // -w <= x, y, z <= w; the planes are not normalized, only their sign is used
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        planes[6] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        planes[7] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        SplitPlanes();
+    }
+
+    void Frustum::SplitPlanes() {
+
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            planeX[i] = planes[i].x;
+            planeY[i] = planes[i].y;
+            planeZ[i] = planes[i].z;
+            planeW[i] = planes[i].w;
+        }
+    }
+
+    FrustumTest Frustum::Classify(const BoundingBox& box) const {
+
+#if defined (GPS_BOUNDS_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        __m128 minX = _mm_set1_ps(box.min.x), minY = _mm_set1_ps(box.min.y), minZ = _mm_set1_ps(box.min.z);
+        __m128 maxX = _mm_set1_ps(box.max.x), maxY = _mm_set1_ps(box.max.y), maxZ = _mm_set1_ps(box.max.z);
+        int outside = 0;
+        int crossing = 0;
+
+        for (int group = 0; group < PLANE_COUNT; group += 4) {
+
+            __m128 a = _mm_loadu_ps(planeX + group);
+            __m128 b = _mm_loadu_ps(planeY + group);
+            __m128 c = _mm_loadu_ps(planeZ + group);
+            __m128 d = _mm_loadu_ps(planeW + group);
+
+            // per plane, the corner furthest along the normal and the one opposite to it
+            __m128 signX = _mm_cmpge_ps(a, zero), signY = _mm_cmpge_ps(b, zero), signZ = _mm_cmpge_ps(c, zero);
+            __m128 farX = _mm_or_ps(_mm_and_ps(signX, maxX), _mm_andnot_ps(signX, minX));
+            __m128 farY = _mm_or_ps(_mm_and_ps(signY, maxY), _mm_andnot_ps(signY, minY));
+            __m128 farZ = _mm_or_ps(_mm_and_ps(signZ, maxZ), _mm_andnot_ps(signZ, minZ));
+            __m128 nearX = _mm_or_ps(_mm_and_ps(signX, minX), _mm_andnot_ps(signX, maxX));
+            __m128 nearY = _mm_or_ps(_mm_and_ps(signY, minY), _mm_andnot_ps(signY, maxY));
+            __m128 nearZ = _mm_or_ps(_mm_and_ps(signZ, minZ), _mm_andnot_ps(signZ, maxZ));
+
+            __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, farX), _mm_mul_ps(b, farY)), _mm_add_ps(_mm_mul_ps(c, farZ), d));
+            __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, nearX), _mm_mul_ps(b, nearY)), _mm_add_ps(_mm_mul_ps(c, nearZ), d));
+
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(farDistance, zero));
+            crossing |= _mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero));
+        }
+
+        if (outside) {
+            return FRUSTUM_OUTSIDE;
+        }
+        return crossing ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#else
+        bool crossing = false;
+        for (int p = 0; p < PLANE_COUNT; p++) {
+
+            const glm::vec4& plane = planes[p];
+            glm::vec3 farCorner(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z);
+            glm::vec3 nearCorner(plane.x >= 0.0f ? box.min.x : box.max.x, plane.y >= 0.0f ? box.min.y : box.max.y, plane.z >= 0.0f ? box.min.z : box.max.z);
+
+            if (glm::dot(glm::vec3(plane), farCorner) + plane.w < 0.0f) {
+                return FRUSTUM_OUTSIDE;
+            }
+            if (glm::dot(glm::vec3(plane), nearCorner) + plane.w < 0.0f) {
+                crossing = true;
+            }
+        }
+        return crossing ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#endif
+    }
+
+    BoxList::BoxList() : count(0) {
+    }
+
+    void BoxList::Clear() {
+
+        minX.clear(); minY.clear(); minZ.clear();
+        maxX.clear(); maxY.clear(); maxZ.clear();
+        count = 0;
+    }
+
+    void BoxList::Add(const BoundingBox& box) {
+
+        // grow a whole group of four at a time, the unused lanes hold empty boxes at the origin
+        if (count % 4 == 0) {
+            size_t padded = count + 4;
+            minX.resize(padded, 0.0f); minY.resize(padded, 0.0f); minZ.resize(padded, 0.0f);
+            maxX.resize(padded, 0.0f); maxY.resize(padded, 0.0f); maxZ.resize(padded, 0.0f);
+        }
+
+        minX[count] = box.min.x; minY[count] = box.min.y; minZ[count] = box.min.z;
+        maxX[count] = box.max.x; maxY[count] = box.max.y; maxZ[count] = box.max.z;
+        count++;
+    }
+
+    size_t BoxList::size() const {
+
+        return count;
+    }
+
+    size_t BoxList::Cull(const Frustum& frustum, uint8_t* visible) const {
+
+        size_t visibleCount = 0;
+
+#if defined (GPS_BOUNDS_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+
+        for (size_t i = 0; i < count; i += 4) {
+
+            __m128 boxMinX = _mm_loadu_ps(&minX[i]);
+            __m128 boxMinY = _mm_loadu_ps(&minY[i]);
+            __m128 boxMinZ = _mm_loadu_ps(&minZ[i]);
+            __m128 boxMaxX = _mm_loadu_ps(&maxX[i]);
+            __m128 boxMaxY = _mm_loadu_ps(&maxY[i]);
+            __m128 boxMaxZ = _mm_loadu_ps(&maxZ[i]);
+            __m128 outside = zero;
+
+            for (int p = 0; p < Frustum::PLANE_COUNT; p++) {
+
+                const glm::vec4& plane = frustum.planes[p];
+
+                // the corner furthest along the plane normal decides, a box is out only if that corner is
+                __m128 x = plane.x >= 0.0f ? boxMaxX : boxMinX;
+                __m128 y = plane.y >= 0.0f ? boxMaxY : boxMinY;
+                __m128 z = plane.z >= 0.0f ? boxMaxZ : boxMinZ;
+
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            size_t lanes = count - i < 4 ? count - i : 4;
+            for (size_t lane = 0; lane < lanes; lane++) {
+                uint8_t inside = (outsideMask & (1 << lane)) ? 0 : 1;
+                visible[i + lane] = inside;
+                visibleCount += inside;
+            }
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+
+            bool outside = false;
+            for (int p = 0; p < Frustum::PLANE_COUNT && !outside; p++) {
+
+                const glm::vec4& plane = frustum.planes[p];
+                float x = plane.x >= 0.0f ? maxX[i] : minX[i];
+                float y = plane.y >= 0.0f ? maxY[i] : minY[i];
+                float z = plane.z >= 0.0f ? maxZ[i] : minZ[i];
+                outside = plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f;
+            }
+
+            visible[i] = outside ? 0 : 1;
+            visibleCount += visible[i];
+        }
+#endif
+
+        return visibleCount;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef Bounds_hpp
+#define Bounds_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    struct BoundingBox {
+
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    struct BoundingSphere {
+
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Meshes considered for a frustum, how many of them were kept and how many boxes it took to find out;
+    // occluded counts the ones inside the frustum dropped by an occlusion test
+    struct CullStats {
+
+        uint64_t tested;
+        uint64_t visible;
+        uint64_t boxTests;
+        uint64_t occluded;
+    };
+
+    // Box around the box center holding every position, positions are read with a byte stride
+    void ComputeBounds(const void* positions, size_t count, size_t stride, BoundingBox* box, BoundingSphere* sphere);
+
+    enum FrustumTest {
+
+        FRUSTUM_OUTSIDE = 0,
+        FRUSTUM_INTERSECTS = 1,
+        FRUSTUM_INSIDE = 2
+    };
+
+    // Planes of a clip matrix, inside is where dot(plane, (p, 1)) >= 0.
+    // Built from projection * view * model the planes are in object space,
+    // so bounds can be tested without transforming them.
+    class Frustum {
+
+    public:
+        // left, right, bottom, top, near, far, padded with two planes that accept everything
+        // so the SIMD test runs a fixed 8 planes
+        static const int PLANE_COUNT = 8;
+
+        Frustum();
+        explicit Frustum(const glm::mat4& clipMatrix);
+
+        // One box against all 8 planes at once, used to accept or reject whole BVH subtrees
+        FrustumTest Classify(const BoundingBox& box) const;
+
+        glm::vec4 planes[PLANE_COUNT];
+
+    private:
+        // the planes again as structure of arrays for Classify
+        float planeX[PLANE_COUNT];
+        float planeY[PLANE_COUNT];
+        float planeZ[PLANE_COUNT];
+        float planeW[PLANE_COUNT];
+
+        void SplitPlanes();
+    };
+
+    // Axis aligned boxes kept as structure of arrays and padded to groups of four,
+    // so one SSE pass tests four boxes against a plane
+    class BoxList {
+
+    public:
+        BoxList();
+
+        void Clear();
+        void Add(const BoundingBox& box);
+        size_t size() const;
+
+        // Sets visible[i] to 1 for the boxes touching the frustum and 0 for the others,
+        // returns how many are visible; visible must hold size() entries
+        size_t Cull(const Frustum& frustum, uint8_t* visible) const;
+
+    private:
+        std::vector<float> minX, minY, minZ;
+        std::vector<float> maxX, maxY, maxZ;
+        size_t count;
+    };
+}
+
+#endif /* Bounds_hpp */
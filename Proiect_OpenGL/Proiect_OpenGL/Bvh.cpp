@@ -0,0 +1,557 @@
+#include "Bvh.hpp"
+#include "CpuProfiler.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+namespace gps {
+
+    static const char BVH_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'B', 'V', 'H', 0, 0 };
+
+    // Centroid bins per axis when searching for a split
+    static const int SAH_BIN_COUNT = 16;
+    // Nodes with more primitives than this are split at the median when the SAH finds nothing
+    static const uint32_t MAX_FORCED_LEAF_SIZE = 64;
+    // Deeper nodes become leaves whatever their size, so the fixed traversal stacks can not overflow
+    static const uint32_t MAX_DEPTH = 60;
+    static const int TRAVERSAL_STACK_SIZE = 64;
+
+    struct BvhCacheHeader {
+
+        SidecarStamp stamp;
+        uint64_t meshCount;
+        uint64_t triangleCount;
+    };
+
+    static float SurfaceArea(const BoundingBox& box) {
+
+        glm::vec3 extent = glm::max(box.max - box.min, glm::vec3(0.0f));
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    static BoundingBox EmptyBox() {
+
+        BoundingBox box;
+        box.min = glm::vec3(FLT_MAX);
+        box.max = glm::vec3(-FLT_MAX);
+        return box;
+    }
+
+    static void Grow(BoundingBox& box, const BoundingBox& other) {
+
+        box.min = glm::min(box.min, other.min);
+        box.max = glm::max(box.max, other.max);
+    }
+
+    static BoundingBox NodeBox(const BvhNode& node) {
+
+        BoundingBox box;
+        box.min = glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+        box.max = glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]);
+        return box;
+    }
+
+    // Entry distance of the ray into the box, or a negative value if it misses before maxDistance
+    static float RayBoxEntry(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const BvhNode& node) {
+
+        float t0 = 0.0f;
+        float t1 = maxDistance;
+        for (int axis = 0; axis < 3; axis++) {
+            float slabEnter = (node.boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+            float slabExit = (node.boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+            if (slabEnter > slabExit) {
+                std::swap(slabEnter, slabExit);
+            }
+            // NaN from 0 * inf fails both comparisons and leaves the slab open
+            t0 = slabEnter > t0 ? slabEnter : t0;
+            t1 = slabExit < t1 ? slabExit : t1;
+            if (t0 > t1) {
+                return -1.0f;
+            }
+        }
+        return t0;
+    }
+
+    // Builds the hierarchy of one primitive range; the top of the tree is split serially and the
+    // ranges below parallelThreshold are handed back as subtrees to build on the pool
+    class BvhBuilder {
+
+    public:
+        struct Subtree {
+
+            uint32_t node;
+            uint32_t first;
+            uint32_t count;
+            uint32_t depth;
+        };
+
+        BvhBuilder(const BoundingBox* boxes, std::vector<uint32_t>& primitives, uint32_t maxLeafSize)
+            : boxes(boxes), primitives(primitives), maxLeafSize(maxLeafSize) {
+
+            centroids.resize(primitives.size());
+            for (size_t i = 0; i < primitives.size(); i++) {
+                centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+            }
+        }
+
+        void BuildNode(std::vector<BvhNode>& nodes, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth,
+            uint32_t parallelThreshold, std::vector<Subtree>* deferred) const {
+
+            if (deferred != NULL && count <= parallelThreshold) {
+                Subtree subtree = { nodeIndex, first, count, depth };
+                deferred->push_back(subtree);
+                return;
+            }
+
+            BoundingBox bounds = EmptyBox();
+            BoundingBox centroidBounds = EmptyBox();
+            for (uint32_t i = first; i < first + count; i++) {
+                Grow(bounds, boxes[primitives[i]]);
+                BoundingBox point = { centroids[primitives[i]], centroids[primitives[i]] };
+                Grow(centroidBounds, point);
+            }
+
+            BvhNode& node = nodes[nodeIndex];
+            for (int axis = 0; axis < 3; axis++) {
+                node.boundsMin[axis] = bounds.min[axis];
+                node.boundsMax[axis] = bounds.max[axis];
+            }
+            node.offset = first;
+            node.count = count;
+
+            if (count == 1 || depth >= MAX_DEPTH) {
+                return;
+            }
+
+            int splitAxis = -1;
+            int splitBin = 0;
+            float splitCost = FLT_MAX;
+            FindSplit(first, count, centroidBounds, &splitAxis, &splitBin, &splitCost);
+
+            // leaf cost is one intersection per primitive, traversing costs about one more
+            float leafCost = (float)count;
+            float area = SurfaceArea(bounds);
+            float splitTotal = area > 0.0f ? 1.0f + splitCost / area : leafCost;
+            if (count <= maxLeafSize && (splitAxis < 0 || splitTotal >= leafCost)) {
+                return;
+            }
+
+            uint32_t leftCount;
+            if (splitAxis >= 0) {
+                float origin = centroidBounds.min[splitAxis];
+                float scale = SAH_BIN_COUNT / (centroidBounds.max[splitAxis] - origin);
+                const std::vector<glm::vec3>& centers = centroids;
+                int axis = splitAxis;
+                int bin = splitBin;
+                uint32_t* middle = std::partition(&primitives[first], &primitives[first] + count, [&](uint32_t primitive) {
+                    return BinOf(centers[primitive][axis], origin, scale) <= bin;
+                });
+                leftCount = (uint32_t)(middle - &primitives[first]);
+            }
+            else {
+                if (count <= MAX_FORCED_LEAF_SIZE) {
+                    return;
+                }
+                // every centroid in one spot - split the range in two so leaves stay small
+                leftCount = count / 2;
+            }
+
+            if (leftCount == 0 || leftCount == count) {
+                leftCount = count / 2;
+            }
+
+            uint32_t left = (uint32_t)nodes.size();
+            nodes.resize(nodes.size() + 2);
+            nodes[nodeIndex].offset = left;
+            nodes[nodeIndex].count = 0;
+
+            BuildNode(nodes, left, first, leftCount, depth + 1, parallelThreshold, deferred);
+            BuildNode(nodes, left + 1, first + leftCount, count - leftCount, depth + 1, parallelThreshold, deferred);
+        }
+
+    private:
+        const BoundingBox* boxes;
+        std::vector<uint32_t>& primitives;
+        std::vector<glm::vec3> centroids;
+        uint32_t maxLeafSize;
+
+        static int BinOf(float value, float origin, float scale) {
+
+            int bin = (int)((value - origin) * scale);
+            return bin < 0 ? 0 : (bin >= SAH_BIN_COUNT ? SAH_BIN_COUNT - 1 : bin);
+        }
+
+        // Best split between bins on any axis; the cost is the surface area weighted primitive count
+        void FindSplit(uint32_t first, uint32_t count, const BoundingBox& centroidBounds,
+            int* bestAxis, int* bestBin, float* bestCost) const {
+
+            for (int axis = 0; axis < 3; axis++) {
+
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if (!(extent > 0.0f)) {
+                    continue;
+                }
+
+                float origin = centroidBounds.min[axis];
+                float scale = SAH_BIN_COUNT / extent;
+
+                BoundingBox binBounds[SAH_BIN_COUNT];
+                uint32_t binCounts[SAH_BIN_COUNT];
+                for (int b = 0; b < SAH_BIN_COUNT; b++) {
+                    binBounds[b] = EmptyBox();
+                    binCounts[b] = 0;
+                }
+
+                for (uint32_t i = first; i < first + count; i++) {
+                    uint32_t primitive = primitives[i];
+                    int b = BinOf(centroids[primitive][axis], origin, scale);
+                    Grow(binBounds[b], boxes[primitive]);
+                    binCounts[b]++;
+                }
+
+                // sweep from the right to get the cost of every right side, then from the left
+                float rightArea[SAH_BIN_COUNT];
+                uint32_t rightCount[SAH_BIN_COUNT];
+                BoundingBox accumulated = EmptyBox();
+                uint32_t accumulatedCount = 0;
+                for (int b = SAH_BIN_COUNT - 1; b > 0; b--) {
+                    Grow(accumulated, binBounds[b]);
+                    accumulatedCount += binCounts[b];
+                    rightArea[b] = accumulatedCount > 0 ? SurfaceArea(accumulated) : 0.0f;
+                    rightCount[b] = accumulatedCount;
+                }
+
+                accumulated = EmptyBox();
+                accumulatedCount = 0;
+                for (int b = 0; b < SAH_BIN_COUNT - 1; b++) {
+                    Grow(accumulated, binBounds[b]);
+                    accumulatedCount += binCounts[b];
+                    if (accumulatedCount == 0 || rightCount[b + 1] == 0) {
+                        continue;
+                    }
+
+                    float cost = SurfaceArea(accumulated) * accumulatedCount + rightArea[b + 1] * rightCount[b + 1];
+                    if (cost < *bestCost) {
+                        *bestCost = cost;
+                        *bestAxis = axis;
+                        *bestBin = b;
+                    }
+                }
+            }
+        }
+    };
+
+    void Bvh::Build(const BoundingBox* boxes, size_t count, uint32_t maxLeafSize) {
+
+        GPS_CPU_ZONE("Bvh::Build");
+
+        Clear();
+        if (count == 0) {
+            return;
+        }
+
+        primitives.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            primitives[i] = (uint32_t)i;
+        }
+
+        BvhBuilder builder(boxes, primitives, maxLeafSize);
+
+        nodes.reserve(2 * count);
+        nodes.resize(1);
+
+        // split serially until the ranges are small enough to give every worker a few subtrees
+        ThreadPool& pool = ThreadPool::Shared();
+        uint32_t parallelThreshold = (uint32_t)std::max<size_t>(count / (4 * (size_t)pool.getThreadCount() + 1), 1024);
+        std::vector<BvhBuilder::Subtree> subtrees;
+        builder.BuildNode(nodes, 0, 0, (uint32_t)count, 0, parallelThreshold, &subtrees);
+
+        std::vector<std::vector<BvhNode> > subtreeNodes(subtrees.size());
+        pool.ParallelFor(subtrees.size(), [&](size_t i) {
+            subtreeNodes[i].reserve(2 * subtrees[i].count);
+            subtreeNodes[i].resize(1);
+            builder.BuildNode(subtreeNodes[i], 0, subtrees[i].first, subtrees[i].count, subtrees[i].depth, 0, NULL);
+        });
+
+        // the subtree roots replace their placeholder, the other nodes are appended and their child offsets moved
+        for (size_t i = 0; i < subtrees.size(); i++) {
+
+            uint32_t base = (uint32_t)nodes.size() - 1;
+            std::vector<BvhNode>& local = subtreeNodes[i];
+            for (size_t n = 0; n < local.size(); n++) {
+                if (local[n].count == 0) {
+                    local[n].offset += base;
+                }
+            }
+
+            nodes[subtrees[i].node] = local[0];
+            nodes.insert(nodes.end(), local.begin() + 1, local.end());
+        }
+    }
+
+    size_t Bvh::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+
+        if (nodes.empty()) {
+            return 0;
+        }
+
+        size_t tests = 0;
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+
+            const BvhNode& node = nodes[stack[--stackSize]];
+
+            tests++;
+            FrustumTest test = frustum.Classify(NodeBox(node));
+            if (test == FRUSTUM_OUTSIDE) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                visible.insert(visible.end(), primitives.begin() + node.offset, primitives.begin() + node.offset + node.count);
+                continue;
+            }
+
+            if (test == FRUSTUM_INSIDE) {
+                // take every leaf below without testing it again
+                uint32_t inner[TRAVERSAL_STACK_SIZE];
+                int innerSize = 0;
+                inner[innerSize++] = node.offset;
+                inner[innerSize++] = node.offset + 1;
+                while (innerSize > 0) {
+                    const BvhNode& child = nodes[inner[--innerSize]];
+                    if (child.count > 0) {
+                        visible.insert(visible.end(), primitives.begin() + child.offset, primitives.begin() + child.offset + child.count);
+                    }
+                    else {
+                        inner[innerSize++] = child.offset;
+                        inner[innerSize++] = child.offset + 1;
+                    }
+                }
+                continue;
+            }
+
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = node.offset + 1;
+        }
+
+        return tests;
+    }
+
+    bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+        const std::function<float(uint32_t)>& intersect, uint32_t* hitPrimitive, float* hitDistance) const {
+
+        if (nodes.empty()) {
+            return false;
+        }
+
+        glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float closest = maxDistance;
+        bool hit = false;
+
+        // nodes are pushed with their entry distance so the ones behind a closer hit are skipped
+        uint32_t stack[TRAVERSAL_STACK_SIZE];
+        float stackEntry[TRAVERSAL_STACK_SIZE];
+        int stackSize = 0;
+
+        float rootEntry = RayBoxEntry(origin, inverseDirection, closest, nodes[0]);
+        if (rootEntry < 0.0f) {
+            return false;
+        }
+        stack[stackSize] = 0;
+        stackEntry[stackSize++] = rootEntry;
+
+        while (stackSize > 0) {
+
+            stackSize--;
+            if (stackEntry[stackSize] > closest) {
+                continue;
+            }
+            const BvhNode& node = nodes[stack[stackSize]];
+
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    float distance = intersect(primitives[i]);
+                    if (distance >= 0.0f && distance < closest) {
+                        closest = distance;
+                        *hitPrimitive = primitives[i];
+                        hit = true;
+                    }
+                }
+                continue;
+            }
+
+            float leftEntry = RayBoxEntry(origin, inverseDirection, closest, nodes[node.offset]);
+            float rightEntry = RayBoxEntry(origin, inverseDirection, closest, nodes[node.offset + 1]);
+
+            // the nearer child goes on top of the stack
+            uint32_t first = node.offset, second = node.offset + 1;
+            if (rightEntry >= 0.0f && (leftEntry < 0.0f || rightEntry < leftEntry)) {
+                std::swap(first, second);
+                std::swap(leftEntry, rightEntry);
+            }
+            if (rightEntry >= 0.0f) {
+                stack[stackSize] = second;
+                stackEntry[stackSize++] = rightEntry;
+            }
+            if (leftEntry >= 0.0f) {
+                stack[stackSize] = first;
+                stackEntry[stackSize++] = leftEntry;
+            }
+        }
+
+        if (hit) {
+            *hitDistance = closest;
+        }
+        return hit;
+    }
+
+    void Bvh::Clear() {
+
+        nodes.clear();
+        primitives.clear();
+    }
+
+    bool Bvh::empty() const {
+
+        return nodes.empty();
+    }
+
+    size_t Bvh::getNodeCount() const {
+
+        return nodes.size();
+    }
+
+    size_t Bvh::getPrimitiveCount() const {
+
+        return primitives.size();
+    }
+
+    void Bvh::Write(std::ostream& out) const {
+
+        uint64_t nodeCount = nodes.size();
+        uint64_t primitiveCount = primitives.size();
+        out.write((const char*)&nodeCount, sizeof(nodeCount));
+        out.write((const char*)&primitiveCount, sizeof(primitiveCount));
+        if (nodeCount > 0) {
+            out.write((const char*)nodes.data(), nodeCount * sizeof(BvhNode));
+        }
+        if (primitiveCount > 0) {
+            out.write((const char*)primitives.data(), primitiveCount * sizeof(uint32_t));
+        }
+    }
+
+    bool Bvh::Read(const unsigned char*& cursor, const unsigned char* end) {
+
+        Clear();
+
+        uint64_t nodeCount;
+        uint64_t primitiveCount;
+        if ((size_t)(end - cursor) < sizeof(nodeCount) + sizeof(primitiveCount)) {
+            return false;
+        }
+        memcpy(&nodeCount, cursor, sizeof(nodeCount));
+        memcpy(&primitiveCount, cursor + sizeof(nodeCount), sizeof(primitiveCount));
+        cursor += sizeof(nodeCount) + sizeof(primitiveCount);
+
+        uint64_t available = (uint64_t)(end - cursor);
+        if (nodeCount > available / sizeof(BvhNode) ||
+            primitiveCount > (available - nodeCount * sizeof(BvhNode)) / sizeof(uint32_t)) {
+            return false;
+        }
+
+        nodes.resize((size_t)nodeCount);
+        primitives.resize((size_t)primitiveCount);
+        if (nodeCount > 0) {
+            memcpy(nodes.data(), cursor, (size_t)nodeCount * sizeof(BvhNode));
+        }
+        cursor += nodeCount * sizeof(BvhNode);
+        if (primitiveCount > 0) {
+            memcpy(primitives.data(), cursor, (size_t)primitiveCount * sizeof(uint32_t));
+        }
+        cursor += primitiveCount * sizeof(uint32_t);
+
+        // a damaged file must not send the traversal out of bounds: children come after their parent,
+        // so one pass finds the depth of every node, which has to fit the fixed traversal stacks
+        std::vector<uint32_t> depths(nodes.size(), 0);
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const BvhNode& node = nodes[i];
+            bool valid = node.count > 0 ?
+                (uint64_t)node.offset + node.count <= primitiveCount :
+                node.offset > i && (uint64_t)node.offset + 1 < nodeCount && depths[i] < MAX_DEPTH;
+            if (!valid) {
+                Clear();
+                return false;
+            }
+            if (node.count == 0) {
+                depths[node.offset] = std::max(depths[node.offset], depths[i] + 1);
+                depths[node.offset + 1] = std::max(depths[node.offset + 1], depths[i] + 1);
+            }
+        }
+
+        // every primitive indexes the boxes the tree was built over
+        for (size_t i = 0; i < primitives.size(); i++) {
+            if (primitives[i] >= primitiveCount) {
+                Clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string BvhCachePathFor(const std::string& objFileName) {
+
+        return MeshCache::SidecarPathFor(objFileName, ".gpsbvh");
+    }
+
+    bool WriteBvhCache(const std::string& cachePath, const std::string& objFileName, const Bvh& meshBvh, const Bvh& triangleBvh) {
+
+        BvhCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        if (!MeshCache::StampSidecar(objFileName, BVH_CACHE_MAGIC, BVH_CACHE_VERSION, &header.stamp)) {
+            return false;
+        }
+        header.meshCount = meshBvh.getPrimitiveCount();
+        header.triangleCount = triangleBvh.getPrimitiveCount();
+
+        return MeshCache::WriteSidecar(cachePath, [&](std::ostream& out) {
+            out.write((const char*)&header, sizeof(header));
+            meshBvh.Write(out);
+            triangleBvh.Write(out);
+            return true;
+        });
+    }
+
+    bool ReadBvhCache(const std::string& cachePath, const std::string& objFileName,
+        size_t meshCount, size_t triangleCount, Bvh* meshBvh, Bvh* triangleBvh) {
+
+        MappedFile file;
+        if (!file.Open(cachePath) || file.getSize() < sizeof(BvhCacheHeader)) {
+            return false;
+        }
+
+        BvhCacheHeader header;
+        memcpy(&header, file.getData(), sizeof(header));
+        if (!MeshCache::MatchesSidecarStamp(header.stamp, objFileName, BVH_CACHE_MAGIC, BVH_CACHE_VERSION) ||
+            header.meshCount != meshCount || header.triangleCount != triangleCount) {
+            return false;
+        }
+
+        const unsigned char* cursor = file.getData() + sizeof(header);
+        const unsigned char* end = file.getData() + file.getSize();
+        if (!meshBvh->Read(cursor, end) || !triangleBvh->Read(cursor, end) ||
+            meshBvh->getPrimitiveCount() != meshCount || triangleBvh->getPrimitiveCount() != triangleCount) {
+            meshBvh->Clear();
+            triangleBvh->Clear();
+            return false;
+        }
+        return true;
+    }
+}
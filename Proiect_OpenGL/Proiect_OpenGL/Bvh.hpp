@@ -0,0 +1,72 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "Bounds.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the node layout, the .gpsbvh layout or the triangle order of the meshes changes - older files are then rebuilt
+    const uint32_t BVH_CACHE_VERSION = 2;
+
+    // 32 byte node: interior nodes keep their two children side by side at offset, offset + 1;
+    // leaves (count > 0) own primitives[offset .. offset + count - 1]
+    struct BvhNode {
+
+        float boundsMin[3];
+        uint32_t offset;
+        float boundsMax[3];
+        uint32_t count;
+    };
+
+    // Bounding volume hierarchy over a set of primitive boxes, built with a binned SAH
+    class Bvh {
+
+    public:
+        // Subtrees are built in parallel on the shared thread pool once the top splits are done
+        void Build(const BoundingBox* boxes, size_t count, uint32_t maxLeafSize);
+
+        // Appends the primitives whose boxes touch the frustum; subtrees fully inside are taken
+        // without further tests. Returns the number of node boxes tested.
+        size_t Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+        // Walks the leaves the ray crosses, nearest first, and calls intersect for their primitives.
+        // intersect returns the hit distance along direction or a negative value for a miss.
+        // Keeps the closest hit below maxDistance.
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+            const std::function<float(uint32_t)>& intersect, uint32_t* hitPrimitive, float* hitDistance) const;
+
+        void Clear();
+        bool empty() const;
+        size_t getNodeCount() const;
+        size_t getPrimitiveCount() const;
+
+        void Write(std::ostream& out) const;
+        // Reads what Write produced, advancing cursor; false if the data is cut short, a node or primitive
+        // points outside the tree or the tree is deeper than the traversal stacks allow
+        bool Read(const unsigned char*& cursor, const unsigned char* end);
+
+    private:
+        std::vector<BvhNode> nodes;
+        std::vector<uint32_t> primitives;
+    };
+
+    // Name of the sidecar holding the hierarchies of an .obj file
+    std::string BvhCachePathFor(const std::string& objFileName);
+
+    // The file is stamped with the .obj so an edited model is rebuilt
+    bool WriteBvhCache(const std::string& cachePath, const std::string& objFileName, const Bvh& meshBvh, const Bvh& triangleBvh);
+
+    // Fails if the file is missing, stale or built for other primitive counts
+    bool ReadBvhCache(const std::string& cachePath, const std::string& objFileName,
+        size_t meshCount, size_t triangleCount, Bvh* meshBvh, Bvh* triangleBvh);
+}
+
+#endif /* Bvh_hpp */
@@ -62,6 +62,10 @@ namespace gps {
         return cameraPosition;
     }
 
+    glm::vec3 Camera::getCameraFrontDirection() const {
+        return cameraFrontDirection;
+    }
+
     void Camera::setCameraPosition(glm::vec3 newPosition) {
         cameraPosition = newPosition;
         cameraFrontDirection = glm::normalize(cameraTarget - cameraPosition);
@@ -24,6 +24,7 @@ namespace gps {
 
         void resetPozition();
         glm::vec3 getCameraPosition() const;
+        glm::vec3 getCameraFrontDirection() const;
         void setCameraPosition(glm::vec3 newPosition);
         
     private:
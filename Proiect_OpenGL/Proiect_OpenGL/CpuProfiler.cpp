@@ -0,0 +1,145 @@
+#include "CpuProfiler.hpp"
+#include "Json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    std::atomic<bool> CpuProfiler::enabled(false);
+
+    static const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+    struct CpuEvent {
+
+        const CpuZoneSite* site;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    // The ring of one thread. Event i goes to slot i % CPU_PROFILER_RING_SIZE; head counts the
+    // events written so far and is only advanced once the slot holds the event.
+    struct CpuThreadRing {
+
+        std::atomic<uint64_t> head;
+        uint32_t id;
+        std::string name;
+        CpuEvent events[CPU_PROFILER_RING_SIZE];
+    };
+
+    // Rings of every thread that recorded a zone. They are never freed: a worker that has
+    // exited still has zones to dump, and the threads only take the lock once, on their first zone.
+    static std::mutex ringsMutex;
+    static std::vector<CpuThreadRing*> rings;
+    static thread_local CpuThreadRing* threadRing = NULL;
+    // given before the thread had a ring, it only gets one on its first zone
+    static thread_local const char* threadName = NULL;
+
+    static CpuThreadRing* RingOfThread() {
+
+        if (threadRing == NULL) {
+            CpuThreadRing* ring = new CpuThreadRing();
+            ring->head.store(0, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            ring->id = (uint32_t)rings.size() + 1;
+            ring->name = threadName != NULL ? threadName : "thread " + std::to_string(ring->id);
+            rings.push_back(ring);
+            threadRing = ring;
+        }
+        return threadRing;
+    }
+
+    void CpuProfiler::Enable(bool enable) {
+
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    uint64_t CpuProfiler::Now() {
+
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - profilerEpoch).count();
+    }
+
+    void CpuProfiler::Record(const CpuZoneSite* site, uint64_t begin, uint64_t end) {
+
+        CpuThreadRing* ring = RingOfThread();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+        CpuEvent& event = ring->events[head % CPU_PROFILER_RING_SIZE];
+        event.site = site;
+        event.begin = begin;
+        event.end = end;
+
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    void CpuProfiler::SetThreadName(const char* name) {
+
+        threadName = name;
+        if (threadRing != NULL) {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            threadRing->name = name;
+        }
+    }
+
+    bool CpuProfiler::WriteTrace(const std::string& fileName) {
+
+        FILE* file = fopen(fileName.c_str(), "w");
+        if (file == NULL) {
+            std::cerr << "ERROR: could not write CPU trace " << fileName << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Proiect_OpenGL\"}}");
+
+        size_t written = 0;
+        std::vector<CpuEvent> events;
+        for (size_t r = 0; r < rings.size(); r++) {
+
+            const CpuThreadRing& ring = *rings[r];
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", ring.id);
+            WriteJsonString(file, ring.name.c_str());
+            fprintf(file, "}}");
+
+            // copy first and check what the thread overwrote meanwhile; event i is intact
+            // as long as event i + CPU_PROFILER_RING_SIZE has not been started
+            uint64_t end = ring.head.load(std::memory_order_acquire);
+            uint64_t start = end > CPU_PROFILER_RING_SIZE ? end - CPU_PROFILER_RING_SIZE : 0;
+            events.clear();
+            for (uint64_t i = start; i < end; i++) {
+                events.push_back(ring.events[i % CPU_PROFILER_RING_SIZE]);
+            }
+            uint64_t after = ring.head.load(std::memory_order_acquire);
+            uint64_t firstIntact = after >= CPU_PROFILER_RING_SIZE ? after - CPU_PROFILER_RING_SIZE + 1 : 0;
+
+            for (uint64_t i = std::max(start, firstIntact); i < end; i++) {
+
+                const CpuEvent& event = events[(size_t)(i - start)];
+                fprintf(file, ",\n{\"name\":");
+                WriteJsonString(file, event.site->name);
+                fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":",
+                    ring.id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+                WriteJsonString(file, event.site->file);
+                fprintf(file, ",\"line\":%d}}", event.site->line);
+                written++;
+            }
+        }
+        fprintf(file, "\n]}\n");
+
+        bool ok = ferror(file) == 0;
+        ok = fclose(file) == 0 && ok;
+        if (!ok) {
+            std::cerr << "ERROR: could not write CPU trace " << fileName << std::endl;
+            return false;
+        }
+        std::cout << "CPU trace : " << written << " zones of " << rings.size() << " threads written to " << fileName << std::endl;
+        return true;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef CpuProfiler_hpp
+#define CpuProfiler_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Zones each thread keeps, older ones are overwritten
+    const uint32_t CPU_PROFILER_RING_SIZE = 1 << 16;
+
+    // Where a zone is. One constant per GPS_CPU_ZONE, so an event only records its address.
+    struct CpuZoneSite {
+
+        const char* name;
+        const char* file;
+        int line;
+    };
+
+    // Scoped zone profiler for the CPU side. Each thread writes the zones it closes into a ring
+    // of its own, without locks: only that thread writes it, and the head is published with a
+    // release store for WriteTrace to read. Off until Enable, then a zone costs two clock reads.
+    class CpuProfiler {
+
+    public:
+        static void Enable(bool enabled);
+
+        static bool IsEnabled() {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        // Nanoseconds on the steady clock since the program started
+        static uint64_t Now();
+
+        static void Record(const CpuZoneSite* site, uint64_t begin, uint64_t end);
+
+        // Names the calling thread in the trace, name must be a string literal
+        static void SetThreadName(const char* name);
+
+        // Writes the zones still in the rings as Chrome trace event JSON, for chrome://tracing
+        // or ui.perfetto.dev; can be called while other threads keep recording
+        static bool WriteTrace(const std::string& fileName);
+
+    private:
+        static std::atomic<bool> enabled;
+    };
+
+    class CpuZone {
+
+    public:
+        explicit CpuZone(const CpuZoneSite* site) : site(CpuProfiler::IsEnabled() ? site : NULL), begin(0) {
+            if (this->site != NULL) {
+                begin = CpuProfiler::Now();
+            }
+        }
+
+        ~CpuZone() {
+            if (site != NULL) {
+                CpuProfiler::Record(site, begin, CpuProfiler::Now());
+            }
+        }
+
+    private:
+        const CpuZoneSite* site;
+        uint64_t begin;
+
+        CpuZone(const CpuZone&);
+        CpuZone& operator=(const CpuZone&);
+    };
+}
+
+#define GPS_CPU_ZONE_CONCAT2(a, b) a##b
+#define GPS_CPU_ZONE_CONCAT(a, b) GPS_CPU_ZONE_CONCAT2(a, b)
+
+// Times the rest of the scope as name, which must be a string literal
+#define GPS_CPU_ZONE(name) \
+    static const gps::CpuZoneSite GPS_CPU_ZONE_CONCAT(gpsCpuZoneSite, __LINE__) = { name, __FILE__, __LINE__ }; \
+    gps::CpuZone GPS_CPU_ZONE_CONCAT(gpsCpuZone, __LINE__)(&GPS_CPU_ZONE_CONCAT(gpsCpuZoneSite, __LINE__))
+
+#endif /* CpuProfiler_hpp */
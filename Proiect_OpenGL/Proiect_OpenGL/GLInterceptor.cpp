@@ -0,0 +1,462 @@
+#include "GLInterceptor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    // A binding the hooks have not seen yet; no GL name reaches it
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    static const char* const callNames[GL_CALL_COUNT] = {
+
+#define GPS_GL_CALL_NAME(name) "gl" #name,
+        GPS_GL_HOOKED_CALLS(GPS_GL_CALL_NAME)
+        GPS_GL_NOTED_CALLS(GPS_GL_CALL_NAME)
+#undef GPS_GL_CALL_NAME
+    };
+
+    static const char* const bindKindNames[GL_BIND_KIND_COUNT] = {
+        "program", "vertex array", "buffer", "framebuffer", "texture unit", "texture"
+    };
+
+    uint64_t GLCallStats::TotalCalls() const {
+
+        uint64_t total = 0;
+        for (int call = 0; call < GL_CALL_COUNT; call++) {
+            total += calls[call];
+        }
+        return total;
+    }
+
+    uint64_t GLCallStats::TotalRedundantBinds() const {
+
+        uint64_t total = 0;
+        for (int kind = 0; kind < GL_BIND_KIND_COUNT; kind++) {
+            total += redundantBinds[kind];
+        }
+        return total;
+    }
+
+#if !defined (__APPLE__)
+
+    // What a hooked call tells the interceptor besides being made. Calls without an overload of
+    // their own land on the template and only count.
+    template <GLCall Call>
+    struct GLCallTag {};
+
+    template <GLCall Call, typename... Args>
+    static void Observe(GLInterceptor&, GLCallTag<Call>, Args...) {}
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_UseProgram>, GLuint program) {
+        gl.NoteBind(GL_BIND_PROGRAM, 0, program);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_BindVertexArray>, GLuint array) {
+        gl.NoteBind(GL_BIND_VERTEX_ARRAY, 0, array);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_BindBuffer>, GLenum target, GLuint buffer) {
+        gl.NoteBind(GL_BIND_BUFFER, target, buffer);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_BindFramebuffer>, GLenum target, GLuint framebuffer) {
+        gl.NoteBind(GL_BIND_FRAMEBUFFER, target, framebuffer);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ActiveTexture>, GLenum texture) {
+        gl.NoteBind(GL_BIND_TEXTURE_UNIT, 0, texture - GL_TEXTURE0);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_DeleteVertexArrays>, GLsizei n, const GLuint* arrays) {
+        gl.NoteDeleted(GL_BIND_VERTEX_ARRAY, n, arrays);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_DeleteBuffers>, GLsizei n, const GLuint* buffers) {
+        gl.NoteDeleted(GL_BIND_BUFFER, n, buffers);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_DeleteFramebuffers>, GLsizei n, const GLuint* framebuffers) {
+        gl.NoteDeleted(GL_BIND_FRAMEBUFFER, n, framebuffers);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniform1i>, GLuint, GLint, GLint) {
+        gl.NoteUniformUpload(sizeof(GLint));
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniform1f>, GLuint, GLint, GLfloat) {
+        gl.NoteUniformUpload(sizeof(GLfloat));
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniform3fv>, GLuint, GLint, GLsizei count, const GLfloat*) {
+        gl.NoteUniformUpload((size_t)count * 3 * sizeof(GLfloat));
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniform4fv>, GLuint, GLint, GLsizei count, const GLfloat*) {
+        gl.NoteUniformUpload((size_t)count * 4 * sizeof(GLfloat));
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniformMatrix3fv>, GLuint, GLint, GLsizei count, GLboolean, const GLfloat*) {
+        gl.NoteUniformUpload((size_t)count * 9 * sizeof(GLfloat));
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_ProgramUniformMatrix4fv>, GLuint, GLint, GLsizei count, GLboolean, const GLfloat*) {
+        gl.NoteUniformUpload((size_t)count * 16 * sizeof(GLfloat));
+    }
+
+    // a NULL data only allocates the store, nothing crosses the bus
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_BufferData>, GLenum, GLsizeiptr size, const void* data, GLenum) {
+        if (data != NULL) {
+            gl.NoteUpload((size_t)size);
+        }
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_BufferSubData>, GLenum, GLintptr, GLsizeiptr size, const void*) {
+        gl.NoteUpload((size_t)size);
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_MapBufferRange>, GLenum, GLintptr, GLsizeiptr length, GLbitfield access) {
+        if ((access & GL_MAP_WRITE_BIT) != 0) {
+            gl.NoteUpload((size_t)length);
+        }
+    }
+
+    static void Observe(GLInterceptor& gl, GLCallTag<GL_CALL_CompressedTexImage2D>, GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei imageSize, const void*) {
+        gl.NoteUpload((size_t)imageSize);
+    }
+
+    // One hook per entry point: keeps the driver's pointer and stands in for it in the GLEW global
+    template <GLCall Call, typename Ret, typename... Args>
+    struct GLHook {
+
+        static Ret (GLAPIENTRY *driver)(Args...);
+
+        static Ret GLAPIENTRY Forward(Args... args) {
+
+            GLInterceptor& gl = GLInterceptor::Current();
+            gl.NoteCall(Call);
+            Observe(gl, GLCallTag<Call>(), args...);
+            return driver(args...);
+        }
+    };
+
+    template <GLCall Call, typename Ret, typename... Args>
+    Ret (GLAPIENTRY *GLHook<Call, Ret, Args...>::driver)(Args...) = NULL;
+
+    // Entry points the driver does not have stay NULL, as GLEW left them
+    template <GLCall Call, typename Ret, typename... Args>
+    static void InstallHook(Ret (GLAPIENTRY *&pointer)(Args...)) {
+
+        if (pointer != NULL && pointer != &GLHook<Call, Ret, Args...>::Forward) {
+            GLHook<Call, Ret, Args...>::driver = pointer;
+            pointer = &GLHook<Call, Ret, Args...>::Forward;
+        }
+    }
+
+    template <GLCall Call, typename Ret, typename... Args>
+    static void UninstallHook(Ret (GLAPIENTRY *&pointer)(Args...)) {
+
+        if (pointer == &GLHook<Call, Ret, Args...>::Forward) {
+            pointer = GLHook<Call, Ret, Args...>::driver;
+        }
+    }
+
+#endif
+
+    GLInterceptor& GLInterceptor::Current() {
+
+        static GLInterceptor interceptor;
+        return interceptor;
+    }
+
+    GLInterceptor::GLInterceptor() : installed(false), reportInterval(0) {
+
+        resetStats();
+    }
+
+    bool GLInterceptor::Install(uint32_t reportInterval) {
+
+#if defined (__APPLE__)
+        (void)reportInterval;
+        std::cerr << "WARNING: GL call counting needs the GLEW function pointers, not available on macOS" << std::endl;
+        return false;
+#else
+        if (!installed) {
+#define GPS_GL_INSTALL_HOOK(name) InstallHook<GL_CALL_##name>(__glew##name);
+            GPS_GL_HOOKED_CALLS(GPS_GL_INSTALL_HOOK)
+#undef GPS_GL_INSTALL_HOOK
+            installed = true;
+        }
+        this->reportInterval = reportInterval;
+        resetStats();
+        return true;
+#endif
+    }
+
+    void GLInterceptor::Uninstall() {
+
+#if !defined (__APPLE__)
+        if (installed) {
+#define GPS_GL_UNINSTALL_HOOK(name) UninstallHook<GL_CALL_##name>(__glew##name);
+            GPS_GL_HOOKED_CALLS(GPS_GL_UNINSTALL_HOOK)
+#undef GPS_GL_UNINSTALL_HOOK
+            installed = false;
+        }
+#endif
+    }
+
+    bool GLInterceptor::isInstalled() const {
+
+        return installed;
+    }
+
+    void GLInterceptor::NoteBindTexture(GLenum target, GLuint texture) {
+
+        if (installed) {
+            current.calls[GL_CALL_BindTexture]++;
+            NoteBind(GL_BIND_TEXTURE, target, texture);
+        }
+    }
+
+    void GLInterceptor::NoteDeleteTextures(GLsizei count, const GLuint* objects) {
+
+        if (installed) {
+            current.calls[GL_CALL_DeleteTextures]++;
+            NoteDeleted(GL_BIND_TEXTURE, count, objects);
+        }
+    }
+
+    void GLInterceptor::NoteBind(GLBindKind kind, GLenum target, GLuint object) {
+
+        current.binds[kind]++;
+
+        bool redundant = false;
+        switch (kind) {
+        case GL_BIND_PROGRAM:
+            redundant = program == object;
+            program = object;
+            break;
+        case GL_BIND_VERTEX_ARRAY:
+            redundant = vertexArray == object;
+            if (!redundant) {
+                // the element array binding belongs to the vertex array
+                for (size_t i = 0; i < buffers.size(); i++) {
+                    if (buffers[i].first == GL_ELEMENT_ARRAY_BUFFER) {
+                        buffers[i].second = UNKNOWN;
+                    }
+                }
+            }
+            vertexArray = object;
+            break;
+        case GL_BIND_BUFFER: {
+            size_t i = 0;
+            while (i < buffers.size() && buffers[i].first != target) {
+                i++;
+            }
+            if (i == buffers.size()) {
+                buffers.push_back(std::make_pair(target, UNKNOWN));
+            }
+            redundant = buffers[i].second == object;
+            buffers[i].second = object;
+            break;
+        }
+        case GL_BIND_FRAMEBUFFER:
+            if (target == GL_READ_FRAMEBUFFER) {
+                redundant = readFramebuffer == object;
+                readFramebuffer = object;
+            }
+            else if (target == GL_DRAW_FRAMEBUFFER) {
+                redundant = drawFramebuffer == object;
+                drawFramebuffer = object;
+            }
+            else {
+                redundant = drawFramebuffer == object && readFramebuffer == object;
+                drawFramebuffer = object;
+                readFramebuffer = object;
+            }
+            break;
+        case GL_BIND_TEXTURE_UNIT:
+            redundant = activeUnit == object;
+            activeUnit = object;
+            break;
+        case GL_BIND_TEXTURE: {
+            // a unit the hooks have not seen made active is not known to hold anything
+            if (activeUnit == UNKNOWN) {
+                break;
+            }
+            std::map<std::pair<GLuint, GLenum>, GLuint>::iterator bound =
+                textures.insert(std::make_pair(std::make_pair(activeUnit, target), UNKNOWN)).first;
+            redundant = bound->second == object;
+            bound->second = object;
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (redundant) {
+            current.redundantBinds[kind]++;
+        }
+    }
+
+    void GLInterceptor::NoteDeleted(GLBindKind kind, GLsizei count, const GLuint* objects) {
+
+        for (GLsizei i = 0; i < count; i++) {
+
+            GLuint object = objects[i];
+            if (object == 0) {
+                continue;
+            }
+            if (kind == GL_BIND_VERTEX_ARRAY && vertexArray == object) {
+                vertexArray = 0;
+            }
+            else if (kind == GL_BIND_FRAMEBUFFER) {
+                if (drawFramebuffer == object) {
+                    drawFramebuffer = 0;
+                }
+                if (readFramebuffer == object) {
+                    readFramebuffer = 0;
+                }
+            }
+            else if (kind == GL_BIND_BUFFER) {
+                for (size_t b = 0; b < buffers.size(); b++) {
+                    if (buffers[b].second == object) {
+                        buffers[b].second = 0;
+                    }
+                }
+            }
+            else if (kind == GL_BIND_TEXTURE) {
+                for (std::map<std::pair<GLuint, GLenum>, GLuint>::iterator t = textures.begin(); t != textures.end(); ++t) {
+                    if (t->second == object) {
+                        t->second = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    void GLInterceptor::NoteUniformUpload(size_t bytes) {
+
+        current.uniformUploads++;
+        current.uniformBytes += bytes;
+    }
+
+    void GLInterceptor::NoteUpload(size_t bytes) {
+
+        current.uploadBytes += bytes;
+    }
+
+    static void Accumulate(GLCallStats& into, const GLCallStats& frame) {
+
+        for (int call = 0; call < GL_CALL_COUNT; call++) {
+            into.calls[call] += frame.calls[call];
+        }
+        for (int kind = 0; kind < GL_BIND_KIND_COUNT; kind++) {
+            into.binds[kind] += frame.binds[kind];
+            into.redundantBinds[kind] += frame.redundantBinds[kind];
+        }
+        into.uniformUploads += frame.uniformUploads;
+        into.uniformBytes += frame.uniformBytes;
+        into.uploadBytes += frame.uploadBytes;
+    }
+
+    void GLInterceptor::EndFrame() {
+
+        if (!installed) {
+            return;
+        }
+
+        lastFrame = current;
+        Accumulate(window, current);
+        Accumulate(totals, current);
+        windowFrames++;
+        totalFrames++;
+        memset(&current, 0, sizeof(current));
+
+        if (reportInterval > 0 && windowFrames >= reportInterval) {
+            PrintReport(window, windowFrames, "last frames");
+            memset(&window, 0, sizeof(window));
+            windowFrames = 0;
+        }
+    }
+
+    const GLCallStats& GLInterceptor::getLastFrame() const {
+
+        return lastFrame;
+    }
+
+    const GLCallStats& GLInterceptor::getTotals() const {
+
+        return totals;
+    }
+
+    uint64_t GLInterceptor::getTotalFrames() const {
+
+        return totalFrames;
+    }
+
+    void GLInterceptor::PrintReport(const GLCallStats& stats, uint64_t frames, const char* title) const {
+
+        if (frames == 0) {
+            return;
+        }
+        double perFrame = 1.0 / (double)frames;
+
+        std::vector<int> calls;
+        for (int call = 0; call < GL_CALL_COUNT; call++) {
+            if (stats.calls[call] > 0) {
+                calls.push_back(call);
+            }
+        }
+        std::stable_sort(calls.begin(), calls.end(), [&stats](int a, int b) {
+            return stats.calls[a] > stats.calls[b];
+        });
+
+        printf("GL calls per frame, %s (%llu frames): %.1f\n", title, (unsigned long long)frames,
+            stats.TotalCalls() * perFrame);
+        for (size_t i = 0; i < calls.size(); i++) {
+            printf("  %-36s %10.1f\n", CallName((GLCall)calls[i]), stats.calls[calls[i]] * perFrame);
+        }
+
+        printf("  redundant binds per frame : %.1f\n", stats.TotalRedundantBinds() * perFrame);
+        for (int kind = 0; kind < GL_BIND_KIND_COUNT; kind++) {
+            if (stats.binds[kind] > 0) {
+                printf("    %-14s %8.1f of %8.1f\n", bindKindNames[kind],
+                    stats.redundantBinds[kind] * perFrame, stats.binds[kind] * perFrame);
+            }
+        }
+        printf("  uniform uploads per frame : %.1f (%.2f KB)\n", stats.uniformUploads * perFrame,
+            stats.uniformBytes * perFrame / 1024.0);
+        printf("  data uploaded per frame   : %.2f KB\n", stats.uploadBytes * perFrame / 1024.0);
+        fflush(stdout);
+    }
+
+    void GLInterceptor::resetStats() {
+
+        memset(&current, 0, sizeof(current));
+        memset(&lastFrame, 0, sizeof(lastFrame));
+        memset(&window, 0, sizeof(window));
+        memset(&totals, 0, sizeof(totals));
+        windowFrames = 0;
+        totalFrames = 0;
+        ForgetBindings();
+    }
+
+    const char* GLInterceptor::CallName(GLCall call) {
+
+        return call >= 0 && call < GL_CALL_COUNT ? callNames[call] : "?";
+    }
+
+    void GLInterceptor::ForgetBindings() {
+
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        drawFramebuffer = UNKNOWN;
+        readFramebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        buffers.clear();
+        textures.clear();
+    }
+}
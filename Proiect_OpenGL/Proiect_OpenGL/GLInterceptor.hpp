@@ -0,0 +1,146 @@
+#ifndef GLInterceptor_hpp
+#define GLInterceptor_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// GLEW entry points the project calls, hooked by swapping their function pointers
+#define GPS_GL_HOOKED_CALLS(X) \
+    X(ActiveTexture) X(AttachShader) X(BindBuffer) X(BindFramebuffer) X(BindVertexArray) X(BufferData) \
+    X(BufferSubData) X(CompileShader) X(CompressedTexImage2D) X(CreateProgram) X(CreateShader) X(DeleteBuffers) \
+    X(DeleteFramebuffers) X(DeleteProgram) X(DeleteQueries) X(DeleteShader) X(DeleteVertexArrays) \
+    X(DrawElementsBaseVertex) X(DrawElementsInstancedBaseVertex) X(EnableVertexAttribArray) \
+    X(FramebufferTextureLayer) X(GenBuffers) X(GenFramebuffers) X(GenQueries) X(GenVertexArrays) X(GenerateMipmap) \
+    X(GetActiveUniform) X(GetProgramBinary) X(GetProgramInfoLog) X(GetProgramiv) X(GetQueryObjectiv) \
+    X(GetQueryObjectui64v) X(GetShaderInfoLog) X(GetShaderiv) X(GetUniformLocation) X(LinkProgram) \
+    X(MapBufferRange) X(MultiDrawElementsIndirect) X(ProgramBinary) X(ProgramParameteri) X(ProgramUniform1f) \
+    X(ProgramUniform1i) X(ProgramUniform3fv) X(ProgramUniform4fv) X(ProgramUniformMatrix3fv) \
+    X(ProgramUniformMatrix4fv) X(QueryCounter) X(ShaderSource) X(TexBuffer) X(TexImage3D) X(UnmapBuffer) \
+    X(UseProgram) X(VertexAttribDivisor) X(VertexAttribIPointer) X(VertexAttribPointer)
+
+// GL 1.1 entry points, exported by the GL library itself with no GLEW pointer to swap;
+// their callers report them through NoteCall and NoteBindTexture
+#define GPS_GL_NOTED_CALLS(X) \
+    X(BindTexture) X(Clear) X(DeleteTextures) X(DepthFunc) X(Disable) X(DrawArrays) X(Enable) X(GetError) X(PolygonMode) X(Viewport)
+
+namespace gps {
+
+    enum GLCall {
+
+#define GPS_GL_CALL_ENUM(name) GL_CALL_##name,
+        GPS_GL_HOOKED_CALLS(GPS_GL_CALL_ENUM)
+        GPS_GL_NOTED_CALLS(GPS_GL_CALL_ENUM)
+#undef GPS_GL_CALL_ENUM
+        GL_CALL_COUNT
+    };
+
+    // Objects whose binds are checked for rebinding what is already bound
+    enum GLBindKind {
+
+        GL_BIND_PROGRAM = 0,
+        GL_BIND_VERTEX_ARRAY = 1,
+        GL_BIND_BUFFER = 2,
+        GL_BIND_FRAMEBUFFER = 3,
+        GL_BIND_TEXTURE_UNIT = 4,       // glActiveTexture of the unit already active
+        GL_BIND_TEXTURE = 5,
+        GL_BIND_KIND_COUNT = 6
+    };
+
+    struct GLCallStats {
+
+        uint64_t calls[GL_CALL_COUNT];
+        uint64_t binds[GL_BIND_KIND_COUNT];
+        uint64_t redundantBinds[GL_BIND_KIND_COUNT];
+        uint64_t uniformUploads;
+        uint64_t uniformBytes;
+        uint64_t uploadBytes;           // buffer data, mapped ranges and compressed images
+
+        uint64_t TotalCalls() const;
+        uint64_t TotalRedundantBinds() const;
+    };
+
+    // Opt-in counting layer under the GL calls of the application. Install swaps the GLEW function
+    // pointers for hooks that count each call by function, check binds against what the hooks saw
+    // bound last, and add up the uniform and buffer bytes sent, then call the driver. The counts are
+    // kept per frame; a table of them is printed every reportInterval frames. Not available on macOS,
+    // which has no GLEW.
+    class GLInterceptor {
+
+    public:
+        // The interceptor of the one GL context the application uses
+        static GLInterceptor& Current();
+
+        GLInterceptor();
+
+        // After glewInit; the bindings are unknown until first seen. 0 frames = no periodic table.
+        bool Install(uint32_t reportInterval);
+        void Uninstall();
+        bool isInstalled() const;
+
+        void NoteCall(GLCall call) {
+            if (installed) {
+                current.calls[call]++;
+            }
+        }
+
+        // glBindTexture on the active unit, called next to it
+        void NoteBindTexture(GLenum target, GLuint texture);
+        // glDeleteTextures, called next to it; the units holding the textures fall back to 0
+        void NoteDeleteTextures(GLsizei count, const GLuint* objects);
+
+        // Hook side: a bind of object to target, redundant if the target already holds it
+        void NoteBind(GLBindKind kind, GLenum target, GLuint object);
+        // Hook side: an object was deleted, the targets holding it fall back to 0
+        void NoteDeleted(GLBindKind kind, GLsizei count, const GLuint* objects);
+        void NoteUniformUpload(size_t bytes);
+        void NoteUpload(size_t bytes);
+
+        // Closes the frame, its counts move to the last frame and the totals
+        void EndFrame();
+
+        const GLCallStats& getLastFrame() const;
+        const GLCallStats& getTotals() const;
+        uint64_t getTotalFrames() const;
+
+        // The calls made, busiest first, and the binds and uploads, all per frame
+        void PrintReport(const GLCallStats& stats, uint64_t frames, const char* title) const;
+
+        void resetStats();
+
+        static const char* CallName(GLCall call);
+
+    private:
+        bool installed;
+        uint32_t reportInterval;
+        GLCallStats current;
+        GLCallStats lastFrame;
+        GLCallStats window;             // since the last periodic table
+        uint64_t windowFrames;
+        GLCallStats totals;
+        uint64_t totalFrames;
+
+        // what the hooks saw bound, UNKNOWN before they saw it
+        GLuint program;
+        GLuint vertexArray;
+        GLuint drawFramebuffer;
+        GLuint readFramebuffer;
+        GLuint activeUnit;
+        std::vector<std::pair<GLenum, GLuint> > buffers;
+        std::map<std::pair<GLuint, GLenum>, GLuint> textures;
+
+        void ForgetBindings();
+    };
+}
+
+#endif /* GLInterceptor_hpp */
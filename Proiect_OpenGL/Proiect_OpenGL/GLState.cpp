@@ -0,0 +1,173 @@
+#include "GLState.hpp"
+#include "GLInterceptor.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    // Slot of a texture target in the per unit mirror, -1 for targets that are not tracked
+    static int TargetSlot(GLenum target) {
+
+        switch (target) {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_CUBE_MAP:
+            return 1;
+        case GL_TEXTURE_2D_ARRAY:
+            return 2;
+        case GL_TEXTURE_BUFFER:
+            return 3;
+        default:
+            return -1;
+        }
+    }
+
+    GLState& GLState::Current() {
+
+        static GLState state;
+        return state;
+    }
+
+    GLState::GLState() {
+
+        Invalidate();
+        resetStats();
+    }
+
+    void GLState::UseProgram(GLuint program) {
+
+        stats.requested++;
+        if (this->program != program) {
+            glUseProgram(program);
+            this->program = program;
+            stats.issued++;
+        }
+    }
+
+    void GLState::BindVertexArray(GLuint vao) {
+
+        stats.requested++;
+        if (this->vao != vao) {
+            glBindVertexArray(vao);
+            this->vao = vao;
+            stats.issued++;
+        }
+    }
+
+    void GLState::ActiveTexture(GLuint unit) {
+
+        if (activeUnit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            stats.issued++;
+        }
+    }
+
+    void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+
+        stats.requested++;
+
+        int slot = TargetSlot(target);
+        if (slot < 0 || unit >= MAX_TEXTURE_UNITS) {
+            ActiveTexture(unit);
+            glBindTexture(target, texture);
+            GLInterceptor::Current().NoteBindTexture(target, texture);
+            stats.issued++;
+            return;
+        }
+
+        if (textures[unit][slot] != texture) {
+            ActiveTexture(unit);
+            glBindTexture(target, texture);
+            GLInterceptor::Current().NoteBindTexture(target, texture);
+            textures[unit][slot] = texture;
+            stats.issued++;
+        }
+    }
+
+    void GLState::BindTextureSet(const GLuint* textures, GLuint count) {
+
+        for (GLuint unit = 0; unit < count; unit++) {
+            BindTexture(unit, GL_TEXTURE_2D, textures[unit]);
+        }
+
+        // an unknown previous size clears nothing - after Invalidate the units are unknown anyway
+        GLuint previous = textureSetSize == UNKNOWN ? 0 : textureSetSize;
+        for (GLuint unit = count; unit < previous; unit++) {
+            BindTexture(unit, GL_TEXTURE_2D, 0);
+        }
+
+        textureSetSize = count;
+    }
+
+    void GLState::SetDepthTest(bool enabled) {
+
+        stats.requested++;
+        GLuint value = enabled ? 1 : 0;
+        if (depthTest != value) {
+            if (enabled) {
+                glEnable(GL_DEPTH_TEST);
+                GLInterceptor::Current().NoteCall(GL_CALL_Enable);
+            }
+            else {
+                glDisable(GL_DEPTH_TEST);
+                GLInterceptor::Current().NoteCall(GL_CALL_Disable);
+            }
+            depthTest = value;
+            stats.issued++;
+        }
+    }
+
+    void GLState::SetDepthFunc(GLenum func) {
+
+        stats.requested++;
+        if (depthFunc != func) {
+            glDepthFunc(func);
+            GLInterceptor::Current().NoteCall(GL_CALL_DepthFunc);
+            depthFunc = func;
+            stats.issued++;
+        }
+    }
+
+    void GLState::SetPolygonMode(GLenum mode) {
+
+        stats.requested++;
+        if (polygonMode != mode) {
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+            GLInterceptor::Current().NoteCall(GL_CALL_PolygonMode);
+            polygonMode = mode;
+            stats.issued++;
+        }
+    }
+
+    void GLState::Invalidate() {
+
+        program = UNKNOWN;
+        vao = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (int slot = 0; slot < TRACKED_TARGETS; slot++) {
+                textures[unit][slot] = UNKNOWN;
+            }
+        }
+        textureSetSize = UNKNOWN;
+        depthTest = UNKNOWN;
+        depthFunc = UNKNOWN;
+        polygonMode = UNKNOWN;
+    }
+
+    const GLStateStats& GLState::getStats() const {
+
+        return stats;
+    }
+
+    void GLState::resetStats() {
+
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    DrawContext::DrawContext(gps::Shader& shader, GLState& state) : shader(shader), state(state) {
+
+        state.UseProgram(shader.shaderProgram);
+    }
+}
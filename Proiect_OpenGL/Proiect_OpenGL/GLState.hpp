@@ -0,0 +1,85 @@
+#ifndef GLState_hpp
+#define GLState_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Shader.hpp"
+
+#include <cstdint>
+
+namespace gps {
+
+    // Binds and state changes asked of the tracker, and how many of them reached GL
+    struct GLStateStats {
+
+        uint64_t requested;
+        uint64_t issued;
+    };
+
+    // Mirror of the GL state the draw path touches. Every setter compares against the
+    // mirror and only calls GL on a change, so redundant binds are dropped across the frame.
+    // Code that binds behind its back (loaders, buffer setup) must call Invalidate afterwards.
+    class GLState {
+
+    public:
+        static const GLuint MAX_TEXTURE_UNITS = 16;
+
+        // The tracker of the one GL context the application uses
+        static GLState& Current();
+
+        GLState();
+
+        void UseProgram(GLuint program);
+        void BindVertexArray(GLuint vao);
+        void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+        // Binds 2D textures to units 0..count-1 and clears the units the previous set used beyond
+        // count, so a mesh never samples a texture left behind by the one drawn before it
+        void BindTextureSet(const GLuint* textures, GLuint count);
+
+        void SetDepthTest(bool enabled);
+        void SetDepthFunc(GLenum func);
+        void SetPolygonMode(GLenum mode);
+
+        // Forgets everything, the next request of each kind reaches GL
+        void Invalidate();
+
+        const GLStateStats& getStats() const;
+        void resetStats();
+
+    private:
+        static const GLuint UNKNOWN = 0xFFFFFFFFu;
+        static const int TRACKED_TARGETS = 4;
+
+        GLuint program;
+        GLuint vao;
+        GLuint activeUnit;
+        GLuint textures[MAX_TEXTURE_UNITS][TRACKED_TARGETS];
+        GLuint textureSetSize;
+        GLuint depthTest;
+        GLenum depthFunc;
+        GLenum polygonMode;
+        GLStateStats stats;
+
+        void ActiveTexture(GLuint unit);
+    };
+
+    // A shader bound through the state tracker - the draw path takes this by reference
+    // instead of copying the shader into every call and binding it again
+    class DrawContext {
+
+    public:
+        DrawContext(gps::Shader& shader, GLState& state = GLState::Current());
+
+        gps::Shader& shader;
+        GLState& state;
+    };
+}
+
+#endif /* GLState_hpp */
@@ -0,0 +1,179 @@
+#include "GeometryArena.hpp"
+
+#include <cstddef>
+#include <iostream>
+
+namespace gps {
+
+    // Typical granularity drivers allocate buffer storage with - only used for the memory report
+    static const size_t DRIVER_ALLOCATION_GRANULARITY = 4096;
+
+    static size_t RoundToAllocation(size_t bytes) {
+        return (bytes + DRIVER_ALLOCATION_GRANULARITY - 1) / DRIVER_ALLOCATION_GRANULARITY * DRIVER_ALLOCATION_GRANULARITY;
+    }
+
+    // 0, 1, 2, ... read once per instance, so a draw sees its base instance as its draw index.
+    // Shared by every arena and kept for the lifetime of the context.
+    static GLuint DrawIndexBuffer() {
+
+        static GLuint buffer = 0;
+        if (buffer == 0) {
+            std::vector<GLuint> indices(MAX_INDIRECT_DRAWS);
+            for (GLuint i = 0; i < MAX_INDIRECT_DRAWS; i++) {
+                indices[i] = i;
+            }
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        }
+        return buffer;
+    }
+
+    GeometryArena::GeometryArena() : vertexCount(0), indexCount(0), declaredIndexCount(0) {
+
+        buffers.VAO = 0;
+        buffers.VBO = 0;
+        buffers.EBO = 0;
+    }
+
+    GeometryArena::~GeometryArena() {
+
+        if (buffers.VAO != 0) {
+            glDeleteBuffers(1, &buffers.VBO);
+            glDeleteBuffers(1, &buffers.EBO);
+            glDeleteVertexArrays(1, &buffers.VAO);
+        }
+    }
+
+    GeometryRange GeometryArena::Add(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount) {
+
+        GeometryRange range = AddRange((GLint)stagedVertices.size(), vertexCount, (GLuint)stagedIndices.size(), indexCount);
+
+        stagedVertices.insert(stagedVertices.end(), vertexData, vertexData + vertexCount);
+        stagedIndices.insert(stagedIndices.end(), indexData, indexData + indexCount);
+
+        return range;
+    }
+
+    GeometryRange GeometryArena::AddRange(GLint baseVertex, GLsizei vertexCount, GLuint firstIndex, GLsizei indexCount) {
+
+        GeometryRange range;
+        range.baseVertex = baseVertex;
+        range.vertexCount = vertexCount;
+        range.firstIndex = firstIndex;
+        range.indexCount = indexCount;
+
+        ranges.push_back(range);
+        if (firstIndex + (size_t)indexCount > declaredIndexCount) {
+            declaredIndexCount = firstIndex + (size_t)indexCount;
+        }
+        return range;
+    }
+
+    GeometryRange GeometryArena::AddIndices(GeometryRange mesh, const GLuint* indexData, GLsizei indexCount) {
+
+        GeometryRange range = mesh;
+        range.firstIndex = (GLuint)declaredIndexCount;
+        range.indexCount = indexCount;
+
+        stagedIndices.insert(stagedIndices.end(), indexData, indexData + indexCount);
+        declaredIndexCount += indexCount;
+
+        return range;
+    }
+
+    void GeometryArena::Upload() {
+
+        CreateBuffers(stagedVertices.data(), stagedVertices.size(), stagedIndices.data(), stagedIndices.size(), NULL, 0);
+
+        std::vector<Vertex>().swap(stagedVertices);
+        std::vector<GLuint>().swap(stagedIndices);
+    }
+
+    void GeometryArena::Upload(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount) {
+
+        CreateBuffers(vertexData, vertexCount, indexData, indexCount, stagedIndices.data(), stagedIndices.size());
+
+        std::vector<GLuint>().swap(stagedIndices);
+    }
+
+    void GeometryArena::CreateBuffers(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+        const GLuint* extraIndexData, size_t extraIndexCount) {
+
+        this->vertexCount = vertexCount;
+        this->indexCount = indexCount + extraIndexCount;
+
+        glGenVertexArrays(1, &buffers.VAO);
+        glGenBuffers(1, &buffers.VBO);
+        glGenBuffers(1, &buffers.EBO);
+
+        glBindVertexArray(buffers.VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+        if (extraIndexCount == 0) {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indexData, GL_STATIC_DRAW);
+        }
+        else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (indexCount + extraIndexCount) * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexCount * sizeof(GLuint), indexData);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), extraIndexCount * sizeof(GLuint), extraIndexData);
+        }
+
+        // same layout as Mesh::setupMesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+        // plain draws read element 0, indirect ones their base instance
+        glBindBuffer(GL_ARRAY_BUFFER, DrawIndexBuffer());
+        glEnableVertexAttribArray(DRAW_INDEX_ATTRIBUTE);
+        glVertexAttribIPointer(DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(DRAW_INDEX_ATTRIBUTE, 1);
+
+        glBindVertexArray(0);
+    }
+
+    Buffers GeometryArena::getBuffers() const {
+
+        return buffers;
+    }
+
+    size_t GeometryArena::getVertexCount() const {
+
+        return vertexCount;
+    }
+
+    size_t GeometryArena::getIndexCount() const {
+
+        return indexCount;
+    }
+
+    size_t GeometryArena::getUploadedBytes() const {
+
+        return vertexCount * sizeof(Vertex) + indexCount * sizeof(GLuint);
+    }
+
+    void GeometryArena::PrintMemoryReport(const std::string& name) const {
+
+        size_t arenaBytes = vertexCount * sizeof(Vertex) + indexCount * sizeof(GLuint);
+        size_t arenaAllocated = RoundToAllocation(vertexCount * sizeof(Vertex)) + RoundToAllocation(indexCount * sizeof(GLuint));
+
+        size_t perMeshAllocated = 0;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            perMeshAllocated += RoundToAllocation(ranges[i].vertexCount * sizeof(Vertex));
+            perMeshAllocated += RoundToAllocation(ranges[i].indexCount * sizeof(GLuint));
+        }
+
+        std::cout << "Geometry arena : " << name << " : " << ranges.size() << " meshes, "
+            << arenaBytes / 1024 << " KB in 3 GL objects (~" << arenaAllocated / 1024 << " KB allocated); "
+            << "per-mesh buffers would need " << 3 * ranges.size() << " GL objects (~"
+            << perMeshAllocated / 1024 << " KB allocated at " << DRIVER_ALLOCATION_GRANULARITY / 1024 << " KB granularity)"
+            << std::endl;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Attribute location of the per-draw index that multi-draw indirect commands pass as base instance
+    const GLuint DRAW_INDEX_ATTRIBUTE = 7;
+
+    // Base instances an indirect command can use - the size of the shared draw index buffer
+    const GLuint MAX_INDIRECT_DRAWS = 65536;
+
+    // One vertex buffer, one index buffer and one VAO holding the static meshes of a model.
+    // Meshes keep a GeometryRange into it and draw with a base vertex and first index,
+    // so switching between them needs no VAO bind.
+    class GeometryArena {
+
+    public:
+        GeometryArena();
+        ~GeometryArena();
+
+        // Copies a mesh into the staging data uploaded by Upload()
+        GeometryRange Add(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount);
+
+        // Declares a mesh that is already part of the blocks given to Upload(vertices, indices)
+        GeometryRange AddRange(GLint baseVertex, GLsizei vertexCount, GLuint firstIndex, GLsizei indexCount);
+
+        // Copies more indices into the vertices of a mesh already added, e.g. a coarser level of detail.
+        // They go after every index declared so far, so all the meshes have to be added first.
+        GeometryRange AddIndices(GeometryRange mesh, const GLuint* indexData, GLsizei indexCount);
+
+        // Creates the buffers from the staged meshes and frees the staging copy
+        void Upload();
+
+        // Creates the buffers straight from contiguous blocks owned by the caller (e.g. a mapped mesh cache);
+        // indices added with AddIndices follow the caller's
+        void Upload(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+        Buffers getBuffers() const;
+
+        // What Upload put in the buffers, levels of detail included
+        size_t getVertexCount() const;
+        size_t getIndexCount() const;
+        size_t getUploadedBytes() const;
+
+        // Prints the arena size next to what one VBO/EBO/VAO per mesh would take
+        void PrintMemoryReport(const std::string& name) const;
+
+    private:
+        Buffers buffers;
+        size_t vertexCount;
+        size_t indexCount;
+        // end of the indices declared by Add, AddRange and AddIndices
+        size_t declaredIndexCount;
+        std::vector<GeometryRange> ranges;
+        std::vector<Vertex> stagedVertices;
+        std::vector<GLuint> stagedIndices;
+
+        void CreateBuffers(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+            const GLuint* extraIndexData, size_t extraIndexCount);
+
+        // the buffers can not be shared between two owners
+        GeometryArena(const GeometryArena&);
+        GeometryArena& operator=(const GeometryArena&);
+    };
+}
+
+#endif /* GeometryArena_hpp */
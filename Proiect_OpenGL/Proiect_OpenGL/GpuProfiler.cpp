@@ -0,0 +1,267 @@
+#include "GpuProfiler.hpp"
+
+#if GPS_GPU_PROFILER
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+    // Release builds time the GPU only when asked to, e.g. by a benchmark run
+#if defined (NDEBUG)
+    static const bool PROFILE_BY_DEFAULT = false;
+#else
+    static const bool PROFILE_BY_DEFAULT = true;
+#endif
+
+    GpuProfiler& GpuProfiler::Current() {
+
+        static GpuProfiler profiler;
+        return profiler;
+    }
+
+    GpuProfiler::GpuProfiler() : enabled(PROFILE_BY_DEFAULT), current(0), started(false), keepSamples(false), droppedFrames(0) {
+
+        for (uint32_t slot = 0; slot < GPU_PROFILER_FRAMES; slot++) {
+            ring[slot].frame = 0;
+            ring[slot].pending = false;
+            ring[slot].usedQueries = 0;
+            ring[slot].lastIssued = 0;
+        }
+    }
+
+    void GpuProfiler::Enable(bool enabled) {
+
+        // the frames in flight are read by Flush or dropped by resetStats, the next frame starts the ring over
+        this->enabled = enabled;
+        if (!enabled) {
+            started = false;
+        }
+    }
+
+    bool GpuProfiler::isEnabled() const {
+
+        return enabled;
+    }
+
+    uint32_t GpuProfiler::FindPass(const char* name) {
+
+        // literals of the same pass may not share an address across translation units
+        for (uint32_t pass = 0; pass < passes.size(); pass++) {
+            if (passes[pass].name == name || strcmp(passes[pass].name, name) == 0) {
+                return pass;
+            }
+        }
+
+        if (passes.size() == GPU_PROFILER_MAX_PASSES) {
+            return UINT32_MAX;
+        }
+        PassHistory history;
+        history.name = name;
+        history.frames = 0;
+        passes.push_back(history);
+        return (uint32_t)passes.size() - 1;
+    }
+
+    uint32_t GpuProfiler::NextQuery() {
+
+        FrameQueries& frame = ring[current];
+        if (frame.usedQueries == frame.queries.size()) {
+            // the set grows to the busiest frame and is kept from then on
+            size_t grown = std::max<size_t>(16, frame.queries.size() * 2);
+            size_t old = frame.queries.size();
+            frame.queries.resize(grown);
+            glGenQueries((GLsizei)(grown - old), &frame.queries[old]);
+        }
+        return frame.usedQueries++;
+    }
+
+    void GpuProfiler::ReadFrame(FrameQueries& frame, bool wait) {
+
+        if (!frame.pending) {
+            return;
+        }
+        frame.pending = false;
+        if (frame.zones.empty()) {
+            return;
+        }
+
+        // once the query issued last is done all the others are
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.lastIssued], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                droppedFrames++;
+                return;
+            }
+        }
+
+        double frameTimes[GPU_PROFILER_MAX_PASSES];
+        bool ran[GPU_PROFILER_MAX_PASSES] = { false };
+        for (size_t i = 0; i < frame.zones.size(); i++) {
+
+            const Zone& zone = frame.zones[i];
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[zone.firstQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[zone.firstQuery + 1], GL_QUERY_RESULT, &end);
+
+            double milliseconds = end > begin ? (double)(end - begin) / 1e6 : 0.0;
+            frameTimes[zone.pass] = ran[zone.pass] ? frameTimes[zone.pass] + milliseconds : milliseconds;
+            ran[zone.pass] = true;
+        }
+
+        for (uint32_t pass = 0; pass < passes.size(); pass++) {
+            if (!ran[pass]) {
+                continue;
+            }
+            PassHistory& history = passes[pass];
+            history.samples[history.frames % GPU_PROFILER_WINDOW] = frameTimes[pass];
+            history.frames++;
+
+            if (keepSamples) {
+                GpuPassSample sample = { frame.frame, pass, frameTimes[pass] };
+                samples.push_back(sample);
+            }
+        }
+    }
+
+    void GpuProfiler::BeginFrame(uint64_t frameNumber) {
+
+        if (!enabled) {
+            return;
+        }
+        if (started) {
+            current = (current + 1) % GPU_PROFILER_FRAMES;
+        }
+        started = true;
+
+        // the queries of this slot are reused now, whatever they hold has to be read first
+        FrameQueries& frame = ring[current];
+        ReadFrame(frame, keepSamples);
+
+        frame.frame = frameNumber;
+        frame.pending = true;
+        frame.usedQueries = 0;
+        frame.lastIssued = 0;
+        frame.zones.clear();
+    }
+
+    void GpuProfiler::Flush() {
+
+        // oldest first, the samples stay in frame order
+        for (uint32_t i = 1; i <= GPU_PROFILER_FRAMES; i++) {
+            ReadFrame(ring[(current + i) % GPU_PROFILER_FRAMES], true);
+        }
+    }
+
+    uint32_t GpuProfiler::BeginZone(const char* name) {
+
+        if (!started) {
+            return UINT32_MAX;
+        }
+        uint32_t pass = FindPass(name);
+        if (pass == UINT32_MAX) {
+            return UINT32_MAX;
+        }
+
+        uint32_t first = NextQuery();
+        NextQuery();
+        glQueryCounter(ring[current].queries[first], GL_TIMESTAMP);
+        ring[current].lastIssued = first;
+
+        Zone zone = { pass, first };
+        ring[current].zones.push_back(zone);
+        return (uint32_t)ring[current].zones.size() - 1;
+    }
+
+    void GpuProfiler::EndZone(uint32_t zone) {
+
+        if (zone == UINT32_MAX) {
+            return;
+        }
+        FrameQueries& frame = ring[current];
+        frame.lastIssued = frame.zones[zone].firstQuery + 1;
+        glQueryCounter(frame.queries[frame.lastIssued], GL_TIMESTAMP);
+    }
+
+    void GpuProfiler::KeepSamples(bool keep) {
+
+        keepSamples = keep;
+        if (!keep) {
+            samples.clear();
+        }
+    }
+
+    void GpuProfiler::TakeSamples(std::vector<GpuPassSample>* taken) {
+
+        taken->insert(taken->end(), samples.begin(), samples.end());
+        samples.clear();
+    }
+
+    const char* GpuProfiler::getPassName(uint32_t pass) const {
+
+        return pass < passes.size() ? passes[pass].name : "";
+    }
+
+    std::vector<GpuPassStats> GpuProfiler::getStats() const {
+
+        std::vector<GpuPassStats> stats;
+        std::vector<double> window;
+
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+
+            const PassHistory& history = passes[pass];
+            GpuPassStats entry = { history.name, history.frames, 0.0, 0.0, 0.0 };
+            size_t count = (size_t)std::min<uint64_t>(history.frames, GPU_PROFILER_WINDOW);
+
+            if (count > 0) {
+                window.assign(history.samples, history.samples + count);
+                std::sort(window.begin(), window.end());
+
+                double sum = 0.0;
+                for (size_t i = 0; i < count; i++) {
+                    sum += window[i];
+                }
+                entry.minMilliseconds = window.front();
+                entry.avgMilliseconds = sum / count;
+                entry.p99Milliseconds = window[std::min(count - 1, count * 99 / 100)];
+            }
+            stats.push_back(entry);
+        }
+        return stats;
+    }
+
+    uint64_t GpuProfiler::getDroppedFrames() const {
+
+        return droppedFrames;
+    }
+
+    void GpuProfiler::resetStats() {
+
+        // the frames still in flight belong before the reset
+        for (uint32_t slot = 0; slot < GPU_PROFILER_FRAMES; slot++) {
+            ring[slot].pending = false;
+        }
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            passes[pass].frames = 0;
+        }
+        samples.clear();
+        droppedFrames = 0;
+    }
+
+    void GpuProfiler::Delete() {
+
+        for (uint32_t slot = 0; slot < GPU_PROFILER_FRAMES; slot++) {
+            if (!ring[slot].queries.empty()) {
+                glDeleteQueries((GLsizei)ring[slot].queries.size(), ring[slot].queries.data());
+            }
+            ring[slot].queries.clear();
+            ring[slot].usedQueries = 0;
+            ring[slot].zones.clear();
+            ring[slot].pending = false;
+        }
+        started = false;
+    }
+}
+
+#endif
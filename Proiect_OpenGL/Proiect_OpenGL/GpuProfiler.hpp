@@ -0,0 +1,169 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+
+// The profiler is built into every configuration, so release benchmark runs keep their pass
+// times; GPS_GPU_PROFILER=0 compiles its calls to nothing and the zones cost no queries
+#ifndef GPS_GPU_PROFILER
+    #define GPS_GPU_PROFILER 1
+#endif
+
+namespace gps {
+
+    // Frames a query can be in flight for before its slot is needed again
+    const uint32_t GPU_PROFILER_FRAMES = 4;
+    // Frames the rolling min / avg / p99 of a pass are taken over
+    const uint32_t GPU_PROFILER_WINDOW = 256;
+    // Distinct pass names, further names are not timed
+    const uint32_t GPU_PROFILER_MAX_PASSES = 16;
+
+    struct GpuPassStats {
+
+        const char* name;
+        uint64_t frames;            // frames the pass ran in, over the whole run
+        double minMilliseconds;     // over the last GPU_PROFILER_WINDOW of them
+        double avgMilliseconds;
+        double p99Milliseconds;
+    };
+
+    // GPU time of one pass in a frame whose queries came back
+    struct GpuPassSample {
+
+        uint64_t frame;
+        uint32_t pass;
+        double milliseconds;
+    };
+
+    // Times named passes on the GPU with GL_TIMESTAMP query pairs, so zones may nest. Each frame
+    // uses its own set of queries out of a ring of GPU_PROFILER_FRAMES; a frame is read when its
+    // set comes round again, and if the GPU is still behind by then, its times are dropped rather
+    // than waited for - unless the samples are kept, a benchmark wants every frame. A pass entered
+    // several times in a frame (once per cascade) counts as the sum. On in debug builds, a release
+    // build issues no queries until Enable.
+    class GpuProfiler {
+
+    public:
+        // The profiler of the one GL context the application uses
+        static GpuProfiler& Current();
+
+        GpuProfiler();
+
+        // Between frames; a disabled profiler ignores its frames and zones
+        void Enable(bool enabled);
+        bool isEnabled() const;
+
+        // Starts frame number frame, reading the oldest frame in the ring; needs the GL context
+        void BeginFrame(uint64_t frame);
+
+        // Waits for the frames still in flight, for the end of a run
+        void Flush();
+
+        // name must outlive the profiler, a string literal; returns the zone for EndZone
+        uint32_t BeginZone(const char* name);
+        void EndZone(uint32_t zone);
+
+        // Pass times of the frames read since the last call, in frame order; they are only
+        // kept once keep is set, a run nobody reads them from does not pile them up
+        void KeepSamples(bool keep);
+        void TakeSamples(std::vector<GpuPassSample>* samples);
+
+        const char* getPassName(uint32_t pass) const;
+        std::vector<GpuPassStats> getStats() const;
+        uint64_t getDroppedFrames() const;
+        // Also forgets the frames in flight, call it between frames
+        void resetStats();
+
+        void Delete();
+
+#if GPS_GPU_PROFILER
+    private:
+        struct Zone {
+
+            uint32_t pass;
+            uint32_t firstQuery;        // its begin, the end is the next query
+        };
+
+        struct FrameQueries {
+
+            uint64_t frame;
+            bool pending;
+            std::vector<GLuint> queries;
+            uint32_t usedQueries;
+            uint32_t lastIssued;        // nested zones end out of query order
+            std::vector<Zone> zones;
+        };
+
+        struct PassHistory {
+
+            const char* name;
+            uint64_t frames;
+            double samples[GPU_PROFILER_WINDOW];
+        };
+
+        FrameQueries ring[GPU_PROFILER_FRAMES];
+        bool enabled;
+        uint32_t current;
+        bool started;
+        std::vector<PassHistory> passes;
+        std::vector<GpuPassSample> samples;
+        bool keepSamples;
+        uint64_t droppedFrames;
+
+        uint32_t FindPass(const char* name);
+        uint32_t NextQuery();
+        void ReadFrame(FrameQueries& frame, bool wait);
+#endif
+    };
+
+#if !GPS_GPU_PROFILER
+    inline GpuProfiler& GpuProfiler::Current() { static GpuProfiler profiler; return profiler; }
+    inline GpuProfiler::GpuProfiler() {}
+    inline void GpuProfiler::Enable(bool) {}
+    inline bool GpuProfiler::isEnabled() const { return false; }
+    inline void GpuProfiler::BeginFrame(uint64_t) {}
+    inline void GpuProfiler::Flush() {}
+    inline uint32_t GpuProfiler::BeginZone(const char*) { return 0; }
+    inline void GpuProfiler::EndZone(uint32_t) {}
+    inline void GpuProfiler::KeepSamples(bool) {}
+    inline void GpuProfiler::TakeSamples(std::vector<GpuPassSample>*) {}
+    inline const char* GpuProfiler::getPassName(uint32_t) const { return ""; }
+    inline std::vector<GpuPassStats> GpuProfiler::getStats() const { return std::vector<GpuPassStats>(); }
+    inline uint64_t GpuProfiler::getDroppedFrames() const { return 0; }
+    inline void GpuProfiler::resetStats() {}
+    inline void GpuProfiler::Delete() {}
+#endif
+
+    // Times the GPU work issued during its lifetime as the pass name
+    class GpuZone {
+
+    public:
+        explicit GpuZone(const char* name) : zone(GpuProfiler::Current().BeginZone(name)) {}
+        ~GpuZone() { GpuProfiler::Current().EndZone(zone); }
+
+    private:
+        uint32_t zone;
+
+        GpuZone(const GpuZone&);
+        GpuZone& operator=(const GpuZone&);
+    };
+}
+
+#if GPS_GPU_PROFILER
+    #define GPS_GPU_ZONE_NAME2(line) gpsGpuZone##line
+    #define GPS_GPU_ZONE_NAME(line) GPS_GPU_ZONE_NAME2(line)
+    #define GPS_GPU_ZONE(name) gps::GpuZone GPS_GPU_ZONE_NAME(__LINE__)(name)
+#else
+    #define GPS_GPU_ZONE(name) ((void)0)
+#endif
+
+#endif /* GpuProfiler_hpp */
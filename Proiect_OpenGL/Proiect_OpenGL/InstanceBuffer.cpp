@@ -0,0 +1,116 @@
+#include "InstanceBuffer.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+namespace gps {
+
+    // Room for this many instances is allocated up front, the buffer doubles when a frame needs more
+    static const size_t INITIAL_INSTANCE_CAPACITY = 1024;
+
+    InstanceBuffer::InstanceBuffer() : buffer(0), capacity(0) {
+
+        resetStats();
+    }
+
+    InstanceBuffer::~InstanceBuffer() {
+
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    void InstanceBuffer::CreateBuffer() {
+
+        if (buffer != 0) {
+            return;
+        }
+
+        capacity = INITIAL_INSTANCE_CAPACITY;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    }
+
+    void InstanceBuffer::Clear() {
+
+        staged.clear();
+    }
+
+    GLuint InstanceBuffer::Add(const glm::mat4* transforms, size_t count) {
+
+        GLuint first = (GLuint)staged.size();
+        staged.insert(staged.end(), transforms, transforms + count);
+        return first;
+    }
+
+    void InstanceBuffer::Upload() {
+
+        if (staged.empty()) {
+            return;
+        }
+
+        CreateBuffer();
+        while (capacity < staged.size()) {
+            capacity *= 2;
+        }
+
+        // orphaning the storage lets the driver hand out a fresh block while the last frame still reads the old one
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, staged.size() * sizeof(glm::mat4), staged.data());
+
+        stats.uploads++;
+        stats.instances += staged.size();
+        stats.bytes += staged.size() * sizeof(glm::mat4);
+    }
+
+    GLuint InstanceBuffer::CreateVertexArray(const Buffers& geometry) {
+
+        CreateBuffer();
+
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        // same layout as GeometryArena
+        glBindBuffer(GL_ARRAY_BUFFER, geometry.VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.EBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+        // one matrix column per location, advancing once per instance
+        for (GLuint column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 1);
+        }
+        BindInstances(0);
+
+        glBindVertexArray(0);
+        return vao;
+    }
+
+    void InstanceBuffer::BindInstances(GLuint firstInstance) const {
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        size_t base = firstInstance * sizeof(glm::mat4);
+        for (GLuint column = 0; column < 4; column++) {
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (GLvoid*)(base + column * sizeof(glm::vec4)));
+        }
+    }
+
+    const InstanceBufferStats& InstanceBuffer::getStats() const {
+
+        return stats;
+    }
+
+    void InstanceBuffer::resetStats() {
+
+        memset(&stats, 0, sizeof(stats));
+    }
+}
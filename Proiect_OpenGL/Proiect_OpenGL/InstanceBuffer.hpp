@@ -0,0 +1,71 @@
+#ifndef InstanceBuffer_hpp
+#define InstanceBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // First of the four attribute locations holding the columns of the instance model matrix
+    const GLuint INSTANCE_ATTRIBUTE = 3;
+
+    struct InstanceBufferStats {
+
+        uint64_t uploads;
+        uint64_t instances;
+        uint64_t bytes;
+    };
+
+    // Model matrices of every instanced draw of a frame, gathered on the CPU and streamed to one
+    // buffer once per frame. Instanced VAOs read them through per-instance attributes.
+    class InstanceBuffer {
+
+    public:
+        InstanceBuffer();
+        ~InstanceBuffer();
+
+        // Drops the instances of the previous frame
+        void Clear();
+
+        // Appends instances, returns the index of the first one
+        GLuint Add(const glm::mat4* transforms, size_t count);
+
+        // Streams the instances added since Clear; call once after the last Add and before drawing
+        void Upload();
+
+        // New VAO reading the vertices and indices of geometry and the instance matrices of this buffer;
+        // the caller owns it
+        GLuint CreateVertexArray(const Buffers& geometry);
+
+        // Points the instance attributes of the bound VAO at firstInstance - GL 4.1 has no base instance
+        void BindInstances(GLuint firstInstance) const;
+
+        const InstanceBufferStats& getStats() const;
+        void resetStats();
+
+    private:
+        GLuint buffer;
+        size_t capacity;
+        std::vector<glm::mat4> staged;
+        InstanceBufferStats stats;
+
+        void CreateBuffer();
+
+        InstanceBuffer(const InstanceBuffer&);
+        InstanceBuffer& operator=(const InstanceBuffer&);
+    };
+}
+
+#endif /* InstanceBuffer_hpp */
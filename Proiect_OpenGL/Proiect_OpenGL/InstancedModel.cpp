@@ -0,0 +1,175 @@
+#include "InstancedModel.hpp"
+
+#include <cfloat>
+
+namespace gps {
+
+    InstancedModel::InstancedModel() : model(NULL), instances(NULL), vao(0), lodCount(1) {
+
+        bounds.min = glm::vec3(0.0f);
+        bounds.max = glm::vec3(0.0f);
+    }
+
+    InstancedModel::~InstancedModel() {
+
+        if (vao != 0) {
+            glDeleteVertexArrays(1, &vao);
+        }
+    }
+
+    void InstancedModel::Init(const gps::Model3D& model, gps::InstanceBuffer& instances) {
+
+        this->model = &model;
+        this->instances = &instances;
+        vao = instances.CreateVertexArray(model.getBuffers());
+
+        const std::vector<gps::Mesh>& meshes = model.getMeshes();
+        lodCount = 1;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            lodCount = glm::max(lodCount, meshes[i].getLodCount());
+        }
+        for (uint32_t level = 0; level < lodCount; level++) {
+            lodErrors[level] = 0.0f;
+            for (size_t i = 0; i < meshes.size(); i++) {
+                uint32_t meshLevel = glm::min(level, meshes[i].getLodCount() - 1);
+                lodErrors[level] = glm::max(lodErrors[level], meshes[i].getLodErrors()[meshLevel]);
+            }
+        }
+    }
+
+    void InstancedModel::SetInstances(const std::vector<glm::mat4>& transforms) {
+
+        this->transforms = transforms;
+        instanceBounds.Clear();
+        instanceBoxes.resize(transforms.size());
+        visible.assign(transforms.size(), 0);
+        instanceSpheres.resize(transforms.size());
+        instanceScales.resize(transforms.size());
+        for (int slot = 0; slot < LOD_SLOT_COUNT; slot++) {
+            lodLevels[slot].assign(transforms.size(), 0);
+        }
+
+        gps::BoundingBox modelBounds = model->getBounds();
+        glm::vec3 modelCenter = (modelBounds.min + modelBounds.max) * 0.5f;
+        float modelRadius = glm::length(modelBounds.max - modelBounds.min) * 0.5f;
+        bounds.min = glm::vec3(FLT_MAX);
+        bounds.max = glm::vec3(-FLT_MAX);
+
+        for (size_t i = 0; i < transforms.size(); i++) {
+
+            // world box around the transformed model box
+            gps::BoundingBox box;
+            box.min = glm::vec3(FLT_MAX);
+            box.max = glm::vec3(-FLT_MAX);
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 point((corner & 1) ? modelBounds.max.x : modelBounds.min.x,
+                    (corner & 2) ? modelBounds.max.y : modelBounds.min.y,
+                    (corner & 4) ? modelBounds.max.z : modelBounds.min.z);
+                glm::vec3 world = glm::vec3(transforms[i] * glm::vec4(point, 1.0f));
+                box.min = glm::min(box.min, world);
+                box.max = glm::max(box.max, world);
+            }
+
+            instanceBounds.Add(box);
+            instanceBoxes[i] = box;
+
+            float scale = glm::max(glm::length(glm::vec3(transforms[i][0])),
+                glm::max(glm::length(glm::vec3(transforms[i][1])), glm::length(glm::vec3(transforms[i][2]))));
+            instanceSpheres[i] = glm::vec4(glm::vec3(transforms[i] * glm::vec4(modelCenter, 1.0f)), modelRadius * scale);
+            instanceScales[i] = scale;
+            bounds.min = glm::min(bounds.min, box.min);
+            bounds.max = glm::max(bounds.max, box.max);
+        }
+
+        if (transforms.empty()) {
+            bounds.min = glm::vec3(0.0f);
+            bounds.max = glm::vec3(0.0f);
+        }
+    }
+
+    size_t InstancedModel::getInstanceCount() const {
+
+        return transforms.size();
+    }
+
+    gps::BoundingBox InstancedModel::getBounds() const {
+
+        return bounds;
+    }
+
+    void InstancedModel::Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, uint32_t transform,
+        const gps::Frustum& frustum, gps::CullStats& stats, const gps::LodView* lod, const gps::OcclusionTest* occlusion) {
+
+        if (transforms.empty()) {
+            return;
+        }
+
+        size_t visibleCount = instanceBounds.Cull(frustum, visible.data());
+        stats.tested += transforms.size();
+        stats.boxTests += transforms.size();
+
+        if (occlusion != NULL && visibleCount > 0) {
+            size_t occluded = occlusion->culler->Cull(instanceBoxes.data(), instanceBoxes.size(), occlusion->objectToClip, visible.data());
+            stats.occluded += occluded;
+            visibleCount -= occluded;
+        }
+        stats.visible += visibleCount;
+
+        if (visibleCount == 0) {
+            return;
+        }
+
+        const std::vector<gps::Mesh>& meshes = model->getMeshes();
+
+        if (lod == NULL || lodCount <= 1) {
+
+            visibleTransforms.clear();
+            for (size_t i = 0; i < transforms.size(); i++) {
+                if (visible[i]) {
+                    visibleTransforms.push_back(transforms[i]);
+                }
+            }
+
+            GLuint first = instances->Add(visibleTransforms.data(), visibleTransforms.size());
+            for (size_t i = 0; i < meshes.size(); i++) {
+                queue.PushInstanced(pass, shaderProgram, meshes[i], transform, vao, *instances, first, (GLsizei)visibleCount);
+            }
+            return;
+        }
+
+        for (uint32_t level = 0; level < lodCount; level++) {
+            levelTransforms[level].clear();
+        }
+
+        // the errors are in object space, so the distance is measured in units of the copy
+        std::vector<uint8_t>& levels = lodLevels[lod->slot];
+        for (size_t i = 0; i < transforms.size(); i++) {
+            if (visible[i]) {
+                float distance = (glm::length(lod->eye - glm::vec3(instanceSpheres[i])) - instanceSpheres[i].w) / instanceScales[i];
+                uint32_t level = gps::SelectLod(lodErrors, lodCount, distance, *lod, levels[i]);
+                levelTransforms[level].push_back(transforms[i]);
+            }
+        }
+
+        for (uint32_t level = 0; level < lodCount; level++) {
+
+            GLsizei count = (GLsizei)levelTransforms[level].size();
+            if (count == 0) {
+                continue;
+            }
+
+            GLuint first = instances->Add(levelTransforms[level].data(), levelTransforms[level].size());
+            for (size_t i = 0; i < meshes.size(); i++) {
+
+                uint32_t meshLevel = glm::min(level, meshes[i].getLodCount() - 1);
+                queue.PushInstanced(pass, shaderProgram, meshes[i], transform, vao, *instances, first, count, meshLevel);
+
+                if (lod->stats != NULL) {
+                    lod->stats->triangles += (uint64_t)count * (meshes[i].getLodRange(meshLevel).indexCount / 3);
+                    lod->stats->fullTriangles += (uint64_t)count * (meshes[i].getIndexCount() / 3);
+                    lod->stats->levelDraws[meshLevel] += count;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef InstancedModel_hpp
+#define InstancedModel_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Bounds.hpp"
+#include "InstanceBuffer.hpp"
+#include "MeshLod.hpp"
+#include "Model3D.hpp"
+#include "OcclusionCuller.hpp"
+#include "RenderQueue.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Many copies of one Model3D, drawn with one instanced draw per mesh and pass.
+    // The copies are culled on the CPU against world space frustums and the transforms of
+    // the visible ones go to the shared InstanceBuffer.
+    class InstancedModel {
+
+    public:
+        InstancedModel();
+        ~InstancedModel();
+
+        // The model and the instance buffer must outlive this object
+        void Init(const gps::Model3D& model, gps::InstanceBuffer& instances);
+
+        // World transform of every copy
+        void SetInstances(const std::vector<glm::mat4>& transforms);
+
+        size_t getInstanceCount() const;
+
+        // World space box around all the copies
+        gps::BoundingBox getBounds() const;
+
+        // Queues every mesh once for the copies whose bounds touch the frustum; the frustum is in
+        // world space, the shader reads the instance matrices from INSTANCE_ATTRIBUTE.
+        // With a view (eye in world space) each copy picks a level of detail for the whole model and
+        // the meshes are queued once per level in use. With an occlusion test (objectToClip taking world
+        // space to clip space) the copies hidden behind its occluders are dropped as well.
+        void Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, uint32_t transform,
+            const gps::Frustum& frustum, gps::CullStats& stats, const gps::LodView* lod = NULL,
+            const gps::OcclusionTest* occlusion = NULL);
+
+    private:
+        const gps::Model3D* model;
+        gps::InstanceBuffer* instances;
+        GLuint vao;
+        std::vector<glm::mat4> transforms;
+        gps::BoxList instanceBounds;
+        // the same boxes one by one, for the occlusion test
+        std::vector<gps::BoundingBox> instanceBoxes;
+        gps::BoundingBox bounds;
+        std::vector<uint8_t> visible;
+        std::vector<glm::mat4> visibleTransforms;
+
+        // level l of the model draws level min(l, count - 1) of each mesh; its error is the largest of those
+        uint32_t lodCount;
+        float lodErrors[MAX_LOD_LEVELS];
+        // world space bounding sphere and scale of each copy
+        std::vector<glm::vec4> instanceSpheres;
+        std::vector<float> instanceScales;
+        std::vector<uint8_t> lodLevels[LOD_SLOT_COUNT];
+        std::vector<glm::mat4> levelTransforms[MAX_LOD_LEVELS];
+
+        InstancedModel(const InstancedModel&);
+        InstancedModel& operator=(const InstancedModel&);
+    };
+}
+
+#endif /* InstancedModel_hpp */
@@ -0,0 +1,27 @@
+#include "Json.hpp"
+
+namespace gps {
+
+    void WriteJsonString(FILE* file, const char* text) {
+
+        fputc('"', file);
+        for (const char* c = text; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', file);
+                fputc(*c, file);
+            }
+            else if ((unsigned char)*c < 0x20) {
+                fprintf(file, "\\u%04x", (unsigned)(unsigned char)*c);
+            }
+            else {
+                fputc(*c, file);
+            }
+        }
+        fputc('"', file);
+    }
+
+    void WriteJsonString(FILE* file, const std::string& text) {
+
+        WriteJsonString(file, text.c_str());
+    }
+}
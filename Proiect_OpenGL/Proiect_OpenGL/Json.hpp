@@ -0,0 +1,14 @@
+#ifndef Json_hpp
+#define Json_hpp
+
+#include <cstdio>
+#include <string>
+
+namespace gps {
+
+    // Writes text as a quoted JSON string, escaping quotes, backslashes and control characters
+    void WriteJsonString(FILE* file, const char* text);
+    void WriteJsonString(FILE* file, const std::string& text);
+}
+
+#endif /* Json_hpp */
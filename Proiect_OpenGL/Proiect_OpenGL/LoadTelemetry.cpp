@@ -0,0 +1,242 @@
+#include "LoadTelemetry.hpp"
+#include "Json.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace gps {
+
+    // set during static initialization, as close to the start of the program as it gets
+    static const std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+
+    static const char* const assetKindNames[] = { "model", "texture", "shader", "skybox" };
+
+    LoadTelemetry& LoadTelemetry::Current() {
+
+        static LoadTelemetry telemetry;
+        return telemetry;
+    }
+
+    LoadTelemetry::LoadTelemetry() : firstFrameMilliseconds(-1.0) {}
+
+    double LoadTelemetry::Now() {
+
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - programStart).count();
+    }
+
+    void LoadTelemetry::BeginStage(const char* name) {
+
+        LoadStageTime stage;
+        stage.name = name;
+        stage.depth = (uint32_t)openStages.size();
+        stage.startMilliseconds = Now();
+        stage.milliseconds = 0.0;
+
+        openStages.push_back(stages.size());
+        stages.push_back(stage);
+    }
+
+    void LoadTelemetry::EndStage() {
+
+        if (openStages.empty()) {
+            return;
+        }
+
+        LoadStageTime& stage = stages[openStages.back()];
+        stage.milliseconds = Now() - stage.startMilliseconds;
+        openStages.pop_back();
+    }
+
+    LoadAsset LoadTelemetry::NewAsset(LoadAssetKind kind, const std::string& file) const {
+
+        LoadAsset asset;
+        asset.kind = kind;
+        asset.file = file;
+        asset.stage = openStages.empty() ? "" : stages[openStages.back()].name;
+        asset.owner = openAssets.empty() ? "" : openAssets.back()->file;
+        asset.cached = false;
+        asset.startMilliseconds = Now();
+        asset.milliseconds = 0.0;
+        asset.parseMilliseconds = 0.0;
+        asset.uploadMilliseconds = 0.0;
+        asset.bytesRead = 0;
+        asset.vertices = 0;
+        asset.indices = 0;
+        asset.gpuBytes = 0;
+        return asset;
+    }
+
+    LoadAsset& LoadTelemetry::BeginAsset(LoadAssetKind kind, const std::string& file) {
+
+        assets.push_back(NewAsset(kind, file));
+        openAssets.push_back(&assets.back());
+        return assets.back();
+    }
+
+    void LoadTelemetry::EndAsset(LoadAsset& asset) {
+
+        asset.milliseconds = Now() - asset.startMilliseconds;
+
+        std::vector<LoadAsset*>::iterator open = std::find(openAssets.begin(), openAssets.end(), &asset);
+        if (open != openAssets.end()) {
+            openAssets.erase(open);
+        }
+    }
+
+    void LoadTelemetry::AddAsset(const LoadAsset& asset) {
+
+        assets.push_back(asset);
+    }
+
+    void LoadTelemetry::FirstFrame() {
+
+        if (firstFrameMilliseconds < 0.0) {
+            firstFrameMilliseconds = Now();
+        }
+    }
+
+    uint64_t LoadTelemetry::FileSize(const std::string& fileName) {
+
+        FileStamp stamp;
+        return MappedFile::Stat(fileName, &stamp) ? stamp.size : 0;
+    }
+
+    // A skybox has no cache of its own, its faces do
+    static bool HasCache(LoadAssetKind kind) {
+
+        return kind != LOAD_ASSET_SKYBOX;
+    }
+
+    // What a model or skybox cost with its textures
+    struct OwnerTotals {
+
+        const LoadAsset* asset;
+        size_t textures;
+        double decodeMilliseconds;
+        double uploadMilliseconds;
+        uint64_t bytesRead;
+        uint64_t gpuBytes;
+    };
+
+    void LoadTelemetry::PrintSummary() const {
+
+        double startup = firstFrameMilliseconds >= 0.0 ? firstFrameMilliseconds : Now();
+        fprintf(stdout, "Startup : %.1f ms to the first frame\n", startup);
+        double staged = 0.0;
+        for (size_t i = 0; i < stages.size(); i++) {
+            fprintf(stdout, "  %*s%-*s %9.1f ms\n", 2 * (int)stages[i].depth, "", 22 - 2 * (int)stages[i].depth,
+                stages[i].name, stages[i].milliseconds);
+            if (stages[i].depth == 0) {
+                staged += stages[i].milliseconds;
+            }
+        }
+        fprintf(stdout, "  %-22s %9.1f ms\n", "(outside the stages)", startup - staged);
+
+        std::vector<OwnerTotals> owners;
+        size_t cached = 0;
+        size_t cacheable = 0;
+        uint64_t bytesRead = 0;
+        uint64_t gpuBytes = 0;
+        for (size_t i = 0; i < assets.size(); i++) {
+
+            const LoadAsset& asset = assets[i];
+            cached += asset.cached ? 1 : 0;
+            cacheable += HasCache(asset.kind) ? 1 : 0;
+            bytesRead += asset.bytesRead;
+            gpuBytes += asset.gpuBytes;
+
+            if (asset.kind != LOAD_ASSET_TEXTURE || asset.owner.empty()) {
+                OwnerTotals totals = { &asset, 0, 0.0, asset.uploadMilliseconds, asset.bytesRead, asset.gpuBytes };
+                owners.push_back(totals);
+                continue;
+            }
+            for (size_t o = owners.size(); o-- > 0; ) {
+                if (owners[o].asset->file == asset.owner) {
+                    owners[o].textures++;
+                    owners[o].decodeMilliseconds += asset.parseMilliseconds;
+                    owners[o].uploadMilliseconds += asset.uploadMilliseconds;
+                    owners[o].bytesRead += asset.bytesRead;
+                    owners[o].gpuBytes += asset.gpuBytes;
+                    break;
+                }
+            }
+        }
+
+        std::stable_sort(owners.begin(), owners.end(), [](const OwnerTotals& a, const OwnerTotals& b) {
+            return a.asset->milliseconds > b.asset->milliseconds;
+        });
+        for (size_t i = 0; i < owners.size(); i++) {
+
+            const OwnerTotals& owner = owners[i];
+            fprintf(stdout, "  %-7s %9.1f ms  %s%s\n", assetKindNames[owner.asset->kind], owner.asset->milliseconds,
+                owner.asset->file.c_str(), owner.asset->cached ? " (cached)" : "");
+            if (owner.asset->kind == LOAD_ASSET_SHADER) {
+                fprintf(stdout, "          %s in %.1f ms, %.1f KB read\n", owner.asset->cached ? "binary loaded" : "compiled and linked",
+                    owner.asset->parseMilliseconds, owner.bytesRead / 1024.0);
+                continue;
+            }
+            fprintf(stdout, "          parse %.1f ms, %zu textures decoded in %.1f ms, upload %.1f ms; "
+                "%.2f MB read, %.2f MB on the GPU\n", owner.asset->parseMilliseconds, owner.textures, owner.decodeMilliseconds,
+                owner.uploadMilliseconds, owner.bytesRead / (1024.0 * 1024.0), owner.gpuBytes / (1024.0 * 1024.0));
+        }
+        fprintf(stdout, "  %zu of %zu files read from their caches, %.2f MB read, %.2f MB allocated on the GPU\n",
+            cached, cacheable, bytesRead / (1024.0 * 1024.0), gpuBytes / (1024.0 * 1024.0));
+        fflush(stdout);
+    }
+
+    bool LoadTelemetry::WriteReport(const std::string& fileName) const {
+
+        FILE* file = fopen(fileName.c_str(), "w");
+        if (file == NULL) {
+            std::cerr << "ERROR: could not write load report " << fileName << std::endl;
+            return false;
+        }
+
+        // a warm start reads every cacheable file from its cache
+        size_t cached = 0;
+        size_t cacheable = 0;
+        for (size_t i = 0; i < assets.size(); i++) {
+            cached += assets[i].cached ? 1 : 0;
+            cacheable += HasCache(assets[i].kind) ? 1 : 0;
+        }
+
+        fprintf(file, "{\n  \"startup_ms\": %.3f,\n  \"cached_files\": %zu,\n  \"cacheable_files\": %zu,\n  \"stages\": [\n",
+            firstFrameMilliseconds >= 0.0 ? firstFrameMilliseconds : Now(), cached, cacheable);
+        for (size_t i = 0; i < stages.size(); i++) {
+            fprintf(file, "    { \"name\": ");
+            WriteJsonString(file, stages[i].name);
+            fprintf(file, ", \"depth\": %u, \"start_ms\": %.3f, \"ms\": %.3f }%s\n", stages[i].depth,
+                stages[i].startMilliseconds, stages[i].milliseconds, i + 1 < stages.size() ? "," : "");
+        }
+
+        fprintf(file, "  ],\n  \"assets\": [\n");
+        for (size_t i = 0; i < assets.size(); i++) {
+
+            const LoadAsset& asset = assets[i];
+            fprintf(file, "    { \"kind\": \"%s\", \"file\": ", assetKindNames[asset.kind]);
+            WriteJsonString(file, asset.file);
+            fprintf(file, ", \"owner\": ");
+            WriteJsonString(file, asset.owner);
+            fprintf(file, ", \"stage\": ");
+            WriteJsonString(file, asset.stage);
+            fprintf(file, ", \"cached\": %s, \"start_ms\": %.3f, \"ms\": %.3f, \"parse_ms\": %.3f, \"upload_ms\": %.3f, "
+                "\"bytes_read\": %llu, \"vertices\": %llu, \"indices\": %llu, \"gpu_bytes\": %llu }%s\n",
+                asset.cached ? "true" : "false", asset.startMilliseconds, asset.milliseconds, asset.parseMilliseconds,
+                asset.uploadMilliseconds, (unsigned long long)asset.bytesRead, (unsigned long long)asset.vertices,
+                (unsigned long long)asset.indices, (unsigned long long)asset.gpuBytes, i + 1 < assets.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+
+        bool written = ferror(file) == 0;
+        written = fclose(file) == 0 && written;
+        if (!written) {
+            std::cerr << "ERROR: could not write load report " << fileName << std::endl;
+            return false;
+        }
+        std::cout << "Load report : " << assets.size() << " assets written to " << fileName << std::endl;
+        return true;
+    }
+}
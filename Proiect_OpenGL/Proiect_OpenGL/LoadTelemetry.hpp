@@ -0,0 +1,105 @@
+#ifndef LoadTelemetry_hpp
+#define LoadTelemetry_hpp
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum LoadAssetKind {
+
+        LOAD_ASSET_MODEL = 0,
+        LOAD_ASSET_TEXTURE = 1,
+        LOAD_ASSET_SHADER = 2,
+        LOAD_ASSET_SKYBOX = 3
+    };
+
+    // One file loaded during startup. The times are wall time on the GL thread, except the
+    // decode time of a model texture, spent on a worker while other textures decode too.
+    struct LoadAsset {
+
+        LoadAssetKind kind;
+        std::string file;
+        std::string stage;              // startup stage it was loaded in
+        std::string owner;              // model or skybox a texture belongs to
+        bool cached;                    // read from its .gpsmesh / .gpstex / .gpsprog sidecar, a skybox has none
+        double startMilliseconds;       // since the program started
+        double milliseconds;
+        double parseMilliseconds;       // reading and parsing, decoding for a texture, compiling and linking for a shader
+        double uploadMilliseconds;      // the GL calls creating its buffers or textures
+        uint64_t bytesRead;
+        uint64_t vertices;              // in its geometry arena, with the levels of detail
+        uint64_t indices;
+        uint64_t gpuBytes;              // buffer and texture memory, estimated for uncompressed mip chains
+    };
+
+    struct LoadStageTime {
+
+        const char* name;
+        uint32_t depth;                 // stages open around it
+        double startMilliseconds;
+        double milliseconds;
+    };
+
+    // Where the startup time goes: the wall time of each init stage and what each asset cost to read,
+    // parse and upload. Startup ends with the first frame on screen. Only used on the GL thread.
+    class LoadTelemetry {
+
+    public:
+        static LoadTelemetry& Current();
+
+        LoadTelemetry();
+
+        // Milliseconds since the program started
+        static double Now();
+
+        // name must be a string literal; stages may nest
+        void BeginStage(const char* name);
+        void EndStage();
+
+        // Opens the record of an asset; the assets added until EndAsset are its parts, e.g. the
+        // textures of a model. The record stays valid, records are never moved.
+        LoadAsset& BeginAsset(LoadAssetKind kind, const std::string& file);
+        void EndAsset(LoadAsset& asset);
+
+        // Adds a finished part of the open asset, with its times already filled in
+        void AddAsset(const LoadAsset& asset);
+
+        // A record of kind for file in the current stage, under the open asset
+        LoadAsset NewAsset(LoadAssetKind kind, const std::string& file) const;
+
+        void FirstFrame();
+
+        // Stages, then the models, skybox and shaders slowest first with what their textures cost
+        void PrintSummary() const;
+
+        // The stages and every asset as JSON, for comparing cold and warm starts across asset changes
+        bool WriteReport(const std::string& fileName) const;
+
+        // Size of a file on disk, 0 if it can not be read
+        static uint64_t FileSize(const std::string& fileName);
+
+    private:
+        std::vector<LoadStageTime> stages;
+        std::vector<size_t> openStages;
+        std::deque<LoadAsset> assets;
+        std::vector<LoadAsset*> openAssets;
+        double firstFrameMilliseconds;
+    };
+
+    // Times the rest of the scope as a startup stage
+    class LoadStage {
+
+    public:
+        explicit LoadStage(const char* name) { LoadTelemetry::Current().BeginStage(name); }
+        ~LoadStage() { LoadTelemetry::Current().EndStage(); }
+
+    private:
+        LoadStage(const LoadStage&);
+        LoadStage& operator=(const LoadStage&);
+    };
+}
+
+#endif /* LoadTelemetry_hpp */
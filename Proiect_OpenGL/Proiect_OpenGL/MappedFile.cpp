@@ -0,0 +1,163 @@
+#include "MappedFile.hpp"
+
+#if defined (_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace gps {
+
+#if defined (_WIN32)
+
+    MappedFile::MappedFile() : data(NULL), size(0), fileHandle(NULL), mappingHandle(NULL) {
+    }
+
+    bool MappedFile::Open(const std::string& fileName) {
+
+        Close();
+
+        HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+            CloseHandle(file);
+            return false;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == NULL) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        this->fileHandle = file;
+        this->mappingHandle = mapping;
+        this->data = (const unsigned char*)view;
+        this->size = (size_t)fileSize.QuadPart;
+        return true;
+    }
+
+    void MappedFile::Close() {
+
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle) {
+            CloseHandle((HANDLE)mappingHandle);
+        }
+        if (fileHandle) {
+            CloseHandle((HANDLE)fileHandle);
+        }
+        data = NULL;
+        size = 0;
+        fileHandle = NULL;
+        mappingHandle = NULL;
+    }
+
+    bool MappedFile::Stat(const std::string& fileName, FileStamp* stamp) {
+
+        struct _stat64 info;
+        if (_stat64(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+
+        stamp->modifiedTime = (int64_t)info.st_mtime;
+        stamp->size = (uint64_t)info.st_size;
+        return true;
+    }
+
+#else
+
+    MappedFile::MappedFile() : data(NULL), size(0), fileDescriptor(-1) {
+    }
+
+    bool MappedFile::Open(const std::string& fileName) {
+
+        Close();
+
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        this->fileDescriptor = fd;
+        this->data = (const unsigned char*)view;
+        this->size = (size_t)info.st_size;
+        return true;
+    }
+
+    void MappedFile::Close() {
+
+        if (data) {
+            munmap((void*)data, size);
+        }
+        if (fileDescriptor >= 0) {
+            close(fileDescriptor);
+        }
+        data = NULL;
+        size = 0;
+        fileDescriptor = -1;
+    }
+
+    bool MappedFile::Stat(const std::string& fileName, FileStamp* stamp) {
+
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+
+        stamp->modifiedTime = (int64_t)info.st_mtime;
+        stamp->size = (uint64_t)info.st_size;
+        return true;
+    }
+
+#endif
+
+    MappedFile::~MappedFile() {
+
+        Close();
+    }
+
+    const unsigned char* MappedFile::getData() const {
+        return data;
+    }
+
+    size_t MappedFile::getSize() const {
+        return size;
+    }
+
+    bool MappedFile::isOpen() const {
+        return data != NULL;
+    }
+}
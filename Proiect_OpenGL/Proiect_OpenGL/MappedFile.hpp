@@ -0,0 +1,51 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Last modification time and size of a file on disk
+    struct FileStamp {
+
+        int64_t modifiedTime;
+        uint64_t size;
+    };
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // Maps the file into memory, returns false if it can not be opened
+        bool Open(const std::string& fileName);
+        void Close();
+
+        const unsigned char* getData() const;
+        size_t getSize() const;
+        bool isOpen() const;
+
+        // Reads the modification time and size of a file without opening it
+        static bool Stat(const std::string& fileName, FileStamp* stamp);
+
+    private:
+        const unsigned char* data;
+        size_t size;
+#if defined (_WIN32)
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        // a mapping can not be shared between two owners
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+}
+
+#endif /* MappedFile_hpp */
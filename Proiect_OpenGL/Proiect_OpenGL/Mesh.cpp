@@ -1,47 +1,77 @@
 #include "Mesh.hpp"
+#include "GeometryArena.hpp"
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) : arena(NULL) {
 
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
 
-		this->setupMesh();
+		this->setupMesh(this->vertices.data(), (GLsizei)this->vertices.size(), this->indices.data(), (GLsizei)this->indices.size());
 	}
 
-	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	Mesh::Mesh(const GeometryArena* arena, GeometryRange range, std::vector<Texture> textures) : arena(arena), range(range) {
+
+		this->textures = textures;
+		this->buffers.VAO = 0;
+		this->buffers.VBO = 0;
+		this->buffers.EBO = 0;
+		this->bounds.min = glm::vec3(0.0f);
+		this->bounds.max = glm::vec3(0.0f);
+		this->sphere.center = glm::vec3(0.0f);
+		this->sphere.radius = 0.0f;
 	}
 
-	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	Buffers Mesh::getBuffers() const {
+	    return this->arena != NULL ? this->arena->getBuffers() : this->buffers;
+	}
 
-		shader.useShaderProgram();
+	GLsizei Mesh::getIndexCount() const {
+	    return this->range.indexCount;
+	}
 
-		//set textures
-		for (GLuint i = 0; i < textures.size(); i++) {
+	GeometryRange Mesh::getRange() const {
+	    return this->range;
+	}
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-		}
+	void Mesh::AddLod(GeometryRange range, float error) {
+	    if (this->lodRanges.empty()) {
+	        this->lodRanges.push_back(this->range);
+	        this->lodErrors.push_back(0.0f);
+	    }
+	    this->lodRanges.push_back(range);
+	    this->lodErrors.push_back(error);
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	uint32_t Mesh::getLodCount() const {
+	    return this->lodRanges.empty() ? 1 : (uint32_t)this->lodRanges.size();
+	}
 
-        for(GLuint i = 0; i < this->textures.size(); i++) {
+	GeometryRange Mesh::getLodRange(uint32_t level) const {
+	    return level == 0 || this->lodRanges.empty() ? this->range : this->lodRanges[level];
+	}
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+	const float* Mesh::getLodErrors() const {
+	    static const float fullMesh = 0.0f;
+	    return this->lodErrors.empty() ? &fullMesh : this->lodErrors.data();
+	}
 
-    }
+	bool Mesh::ownsBuffers() const {
+	    return this->arena == NULL;
+	}
 
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh() {
+	void Mesh::setupMesh(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount) {
+
+		this->range.baseVertex = 0;
+		this->range.vertexCount = vertexCount;
+		this->range.firstIndex = 0;
+		this->range.indexCount = indexCount;
+
+		ComputeBounds(vertexData, vertexCount, sizeof(Vertex), &this->bounds, &this->sphere);
 
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
@@ -51,10 +81,10 @@ namespace gps {
 		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indexData, GL_STATIC_DRAW);
 
 		// Set the vertex attribute pointers
 		// Vertex Positions
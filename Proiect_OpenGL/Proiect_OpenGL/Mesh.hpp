@@ -11,8 +11,10 @@
 
 #include <glm/glm.hpp>
 
+#include "Bounds.hpp"
 #include "Shader.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -47,25 +49,55 @@ namespace gps {
         GLuint EBO;
     };
 
+    // Where a mesh lives inside its buffers - indices are relative to baseVertex
+    struct GeometryRange {
+        GLint baseVertex;
+        GLsizei vertexCount;
+        GLuint firstIndex;
+        GLsizei indexCount;
+    };
+
+    class GeometryArena;
+
     class Mesh {
 
     public:
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
+        // object space bounds, filled in by the owner for arena meshes
+        BoundingBox bounds;
+        BoundingSphere sphere;
 
 	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
-	    Buffers getBuffers();
+	    // Draws a range of a model's shared arena, the arena keeps ownership of the buffers
+	    Mesh(const GeometryArena* arena, GeometryRange range, std::vector<Texture> textures);
+
+	    Buffers getBuffers() const;
+	    GLsizei getIndexCount() const;
+	    GeometryRange getRange() const;
+
+	    // Coarser index lists into the same vertices, level 0 is the mesh itself
+	    void AddLod(GeometryRange range, float error);
+	    uint32_t getLodCount() const;
+	    GeometryRange getLodRange(uint32_t level) const;
+	    // Object space error of each level, starting with 0 for the mesh itself
+	    const float* getLodErrors() const;
 
-	    void Draw(gps::Shader shader);
+	    // False for meshes drawn from an arena - their buffers are not theirs to delete
+	    bool ownsBuffers() const;
 
     private:
         /*  Render data  */
         Buffers buffers;
+        const GeometryArena* arena;
+        GeometryRange range;
+        std::vector<GeometryRange> lodRanges;
+        std::vector<float> lodErrors;
 
 	    // Initializes all the buffer objects/arrays
-	    void setupMesh();
+	    void setupMesh(const Vertex* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount);
 
     };
 
@@ -0,0 +1,460 @@
+#include "MeshCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    static const char MESH_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'M', 'E', 'S', 'H', '\0' };
+
+    static uint64_t AlignTo16(uint64_t offset) {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    // Whether size bytes starting at offset lie inside a block of blockSize bytes, without overflowing
+    static bool RangeFits(uint64_t offset, uint64_t size, uint64_t blockSize) {
+        return offset <= blockSize && size <= blockSize - offset;
+    }
+
+    // 64-bit FNV-1a style hash, consuming 8 bytes per step
+    static uint64_t HashBytes(const unsigned char* data, size_t size) {
+
+        uint64_t hash = 14695981039346656037ull;
+        size_t i = 0;
+
+        for (; i + 8 <= size; i += 8) {
+
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * 1099511628211ull;
+            hash ^= hash >> 32;
+        }
+
+        for (; i < size; i++) {
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        }
+
+        return hash ^ (uint64_t)size;
+    }
+
+    static bool HashFile(const std::string& fileName, uint64_t* hash) {
+
+        MappedFile source;
+        if (!source.Open(fileName)) {
+            return false;
+        }
+
+        *hash = HashBytes(source.getData(), source.getSize());
+        return true;
+    }
+
+    // Collects the file names following "mtllib" in an .obj file
+    static std::vector<std::string> FindMaterialLibraries(const MappedFile& obj) {
+
+        std::vector<std::string> libraries;
+        const char* cursor = (const char*)obj.getData();
+        const char* end = cursor + obj.getSize();
+
+        while (cursor < end) {
+
+            const char* lineEnd = (const char*)memchr(cursor, '\n', end - cursor);
+            if (lineEnd == NULL) {
+                lineEnd = end;
+            }
+
+            while (cursor < lineEnd && (*cursor == ' ' || *cursor == '\t')) {
+                cursor++;
+            }
+
+            if (lineEnd - cursor > 7 && strncmp(cursor, "mtllib", 6) == 0 && (cursor[6] == ' ' || cursor[6] == '\t')) {
+
+                const char* name = cursor + 7;
+                while (name < lineEnd && (*name == ' ' || *name == '\t')) {
+                    name++;
+                }
+                const char* nameEnd = name;
+                while (nameEnd < lineEnd && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r') {
+                    nameEnd++;
+                }
+                if (nameEnd > name) {
+                    libraries.push_back(std::string(name, nameEnd));
+                }
+            }
+
+            cursor = lineEnd + 1;
+        }
+
+        return libraries;
+    }
+
+    MeshCache::MeshCache() : header(NULL) {
+    }
+
+    std::string MeshCache::CachePathFor(const std::string& objFileName) {
+
+        return SidecarPathFor(objFileName, ".gpsmesh");
+    }
+
+    std::string MeshCache::SidecarPathFor(const std::string& sourcePath, const char* extension) {
+
+        size_t dot = sourcePath.find_last_of('.');
+        size_t slash = sourcePath.find_last_of("/\\");
+
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return sourcePath + extension;
+        }
+
+        return sourcePath.substr(0, dot) + extension;
+    }
+
+    bool MeshCache::WriteSidecar(const std::string& path, const std::function<bool(std::ostream&)>& write) {
+
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+
+            if (!write(out) || !out.good()) {
+                out.close();
+                remove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        // rename does not replace an existing file on Windows
+        remove(path.c_str());
+        return rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+
+    bool MeshCache::StampSidecar(const std::string& sourcePath, const char magic[8], uint32_t version, SidecarStamp* stamp) {
+
+        FileStamp source;
+        if (!MappedFile::Stat(sourcePath, &source)) {
+            return false;
+        }
+
+        memset(stamp, 0, sizeof(*stamp));
+        memcpy(stamp->magic, magic, sizeof(stamp->magic));
+        stamp->version = version;
+        stamp->sourceModifiedTime = source.modifiedTime;
+        stamp->sourceSize = source.size;
+        return true;
+    }
+
+    bool MeshCache::MatchesSidecarStamp(const SidecarStamp& stamp, const std::string& sourcePath, const char magic[8], uint32_t version) {
+
+        FileStamp source;
+        return MappedFile::Stat(sourcePath, &source) &&
+            memcmp(stamp.magic, magic, sizeof(stamp.magic)) == 0 && stamp.version == version &&
+            stamp.sourceModifiedTime == source.modifiedTime && stamp.sourceSize == source.size;
+    }
+
+    bool MeshCache::Open(const std::string& cachePath) {
+
+        Close();
+
+        if (!file.Open(cachePath)) {
+            return false;
+        }
+
+        if (file.getSize() < sizeof(MeshCacheHeader)) {
+            Close();
+            return false;
+        }
+
+        header = (const MeshCacheHeader*)file.getData();
+
+        if (memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+            header->version != MESH_CACHE_VERSION || !IsWellFormed()) {
+
+            std::cout << "Mesh cache " << cachePath << " has an old or unknown format" << std::endl;
+            Close();
+            return false;
+        }
+
+        if (!IsUpToDate()) {
+
+            std::cout << "Mesh cache " << cachePath << " is out of date" << std::endl;
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MeshCache::Close() {
+
+        file.Close();
+        header = NULL;
+    }
+
+    // Every table, block and range the getters hand out lies inside the file
+    bool MeshCache::IsWellFormed() const {
+
+        uint64_t size = file.getSize();
+        if (!RangeFits(header->sourcesOffset, (uint64_t)header->sourceCount * sizeof(MeshCacheSource), size) ||
+            !RangeFits(header->meshesOffset, (uint64_t)header->meshCount * sizeof(MeshCacheEntry), size) ||
+            !RangeFits(header->texturesOffset, (uint64_t)header->textureCount * sizeof(MeshCacheTexture), size) ||
+            !RangeFits(header->stringsOffset, header->stringsSize, size) ||
+            !RangeFits(header->vertexDataOffset, header->vertexDataSize, size) ||
+            !RangeFits(header->indexDataOffset, header->indexDataSize, size) ||
+            header->vertexDataSize % sizeof(Vertex) != 0 || header->indexDataSize % sizeof(GLuint) != 0) {
+            return false;
+        }
+
+        const MeshCacheSource* sources = (const MeshCacheSource*)(file.getData() + header->sourcesOffset);
+        for (uint32_t i = 0; i < header->sourceCount; i++) {
+            if (!RangeFits(sources[i].pathOffset, sources[i].pathLength, header->stringsSize)) {
+                return false;
+            }
+        }
+
+        const MeshCacheTexture* textures = (const MeshCacheTexture*)(file.getData() + header->texturesOffset);
+        for (uint32_t i = 0; i < header->textureCount; i++) {
+            if (!RangeFits(textures[i].pathOffset, textures[i].pathLength, header->stringsSize) ||
+                !RangeFits(textures[i].typeOffset, textures[i].typeLength, header->stringsSize)) {
+                return false;
+            }
+        }
+
+        const MeshCacheEntry* meshes = (const MeshCacheEntry*)(file.getData() + header->meshesOffset);
+        for (uint32_t i = 0; i < header->meshCount; i++) {
+            if (!RangeFits(meshes[i].firstVertex, meshes[i].vertexCount, getVertexCount()) ||
+                !RangeFits(meshes[i].firstIndex, meshes[i].indexCount, getIndexCount()) ||
+                !RangeFits(meshes[i].firstTexture, meshes[i].textureCount, header->textureCount) ||
+                !RangeFits(meshes[i].nameOffset, meshes[i].nameLength, header->stringsSize)) {
+                return false;
+            }
+        }
+
+        // indices are relative to the first vertex of their mesh and read straight into collision data and the arena
+        const GLuint* indices = getIndexData();
+        for (uint32_t i = 0; i < header->meshCount; i++) {
+            for (uint32_t j = 0; j < meshes[i].indexCount; j++) {
+                if (indices[meshes[i].firstIndex + j] >= meshes[i].vertexCount) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool MeshCache::IsUpToDate() const {
+
+        const MeshCacheSource* sources = (const MeshCacheSource*)(file.getData() + header->sourcesOffset);
+
+        for (uint32_t i = 0; i < header->sourceCount; i++) {
+
+            std::string path = getString(sources[i].pathOffset, sources[i].pathLength);
+
+            FileStamp stamp;
+            if (!MappedFile::Stat(path, &stamp) || stamp.size != sources[i].size) {
+                return false;
+            }
+
+            // an unchanged stamp is trusted; a touched file of the same size (a checkout, a copy)
+            // is only stale if its contents changed
+            if (stamp.modifiedTime == sources[i].modifiedTime) {
+                continue;
+            }
+
+            uint64_t hash;
+            if (!HashFile(path, &hash) || hash != sources[i].hash) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    uint32_t MeshCache::getMeshCount() const {
+        return header->meshCount;
+    }
+
+    const MeshCacheEntry& MeshCache::getMesh(uint32_t index) const {
+        return ((const MeshCacheEntry*)(file.getData() + header->meshesOffset))[index];
+    }
+
+    const MeshCacheTexture& MeshCache::getTexture(uint32_t index) const {
+        return ((const MeshCacheTexture*)(file.getData() + header->texturesOffset))[index];
+    }
+
+    const Vertex* MeshCache::getVertices(const MeshCacheEntry& mesh) const {
+        return (const Vertex*)(file.getData() + header->vertexDataOffset) + mesh.firstVertex;
+    }
+
+    const GLuint* MeshCache::getIndices(const MeshCacheEntry& mesh) const {
+        return (const GLuint*)(file.getData() + header->indexDataOffset) + mesh.firstIndex;
+    }
+
+    const Vertex* MeshCache::getVertexData() const {
+        return (const Vertex*)(file.getData() + header->vertexDataOffset);
+    }
+
+    size_t MeshCache::getVertexCount() const {
+        return (size_t)(header->vertexDataSize / sizeof(Vertex));
+    }
+
+    const GLuint* MeshCache::getIndexData() const {
+        return (const GLuint*)(file.getData() + header->indexDataOffset);
+    }
+
+    size_t MeshCache::getIndexCount() const {
+        return (size_t)(header->indexDataSize / sizeof(GLuint));
+    }
+
+    std::string MeshCache::getString(uint32_t offset, uint32_t length) const {
+        return std::string((const char*)file.getData() + header->stringsOffset + offset, length);
+    }
+
+    size_t MeshCache::getFileSize() const {
+        return file.getSize();
+    }
+
+    // Appends a string to the string table and returns its offset
+    static uint32_t AddString(std::string& strings, const std::string& value) {
+
+        uint32_t offset = (uint32_t)strings.size();
+        strings += value;
+        return offset;
+    }
+
+    bool MeshCache::Write(const std::string& cachePath, const std::string& objFileName, const std::string& basePath,
+        const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const std::vector<std::string>& names) {
+
+        std::string strings;
+        std::vector<MeshCacheSource> sources;
+        std::vector<MeshCacheEntry> entries;
+        std::vector<MeshCacheTexture> textures;
+
+        // stamp the .obj and every .mtl it references
+        std::vector<std::string> sourcePaths;
+        sourcePaths.push_back(objFileName);
+        {
+            MappedFile obj;
+            if (!obj.Open(objFileName)) {
+                return false;
+            }
+            std::vector<std::string> libraries = FindMaterialLibraries(obj);
+            for (size_t i = 0; i < libraries.size(); i++) {
+                sourcePaths.push_back(basePath + libraries[i]);
+            }
+        }
+
+        for (size_t i = 0; i < sourcePaths.size(); i++) {
+
+            MeshCacheSource source;
+            memset(&source, 0, sizeof(source));
+
+            FileStamp stamp;
+            if (!MappedFile::Stat(sourcePaths[i], &stamp) || !HashFile(sourcePaths[i], &source.hash)) {
+                // a missing .mtl is not fatal for tinyobj, so it is not for the cache either
+                continue;
+            }
+
+            source.pathOffset = AddString(strings, sourcePaths[i]);
+            source.pathLength = (uint32_t)sourcePaths[i].size();
+            source.modifiedTime = stamp.modifiedTime;
+            source.size = stamp.size;
+            sources.push_back(source);
+        }
+
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+
+            MeshCacheEntry entry;
+            memset(&entry, 0, sizeof(entry));
+
+            entry.firstVertex = vertexCount;
+            entry.vertexCount = (uint32_t)meshes[i].vertices.size();
+            entry.firstIndex = indexCount;
+            entry.indexCount = (uint32_t)meshes[i].indices.size();
+            entry.firstTexture = (uint32_t)textures.size();
+            entry.textureCount = (uint32_t)meshes[i].textures.size();
+            entry.nameOffset = AddString(strings, names[i]);
+            entry.nameLength = (uint32_t)names[i].size();
+
+            for (int c = 0; c < 3; c++) {
+                entry.ambient[c] = materials[i].ambient[c];
+                entry.diffuse[c] = materials[i].diffuse[c];
+                entry.specular[c] = materials[i].specular[c];
+                entry.boundsMin[c] = meshes[i].bounds.min[c];
+                entry.boundsMax[c] = meshes[i].bounds.max[c];
+                entry.sphereCenter[c] = meshes[i].sphere.center[c];
+            }
+            entry.sphereRadius = meshes[i].sphere.radius;
+
+            for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+
+                std::string path = meshes[i].textures[t].path;
+                if (path.compare(0, basePath.size(), basePath) == 0) {
+                    path = path.substr(basePath.size());
+                }
+
+                MeshCacheTexture texture;
+                texture.pathOffset = AddString(strings, path);
+                texture.pathLength = (uint32_t)path.size();
+                texture.typeOffset = AddString(strings, meshes[i].textures[t].type);
+                texture.typeLength = (uint32_t)meshes[i].textures[t].type.size();
+                textures.push_back(texture);
+            }
+
+            vertexCount += entry.vertexCount;
+            indexCount += entry.indexCount;
+            entries.push_back(entry);
+        }
+
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.version = MESH_CACHE_VERSION;
+        header.meshCount = (uint32_t)entries.size();
+        header.sourceCount = (uint32_t)sources.size();
+        header.textureCount = (uint32_t)textures.size();
+        header.sourcesOffset = sizeof(MeshCacheHeader);
+        header.meshesOffset = header.sourcesOffset + sources.size() * sizeof(MeshCacheSource);
+        header.texturesOffset = header.meshesOffset + entries.size() * sizeof(MeshCacheEntry);
+        header.stringsOffset = header.texturesOffset + textures.size() * sizeof(MeshCacheTexture);
+        header.stringsSize = strings.size();
+        header.vertexDataOffset = AlignTo16(header.stringsOffset + header.stringsSize);
+        header.vertexDataSize = (uint64_t)vertexCount * sizeof(Vertex);
+        header.indexDataOffset = AlignTo16(header.vertexDataOffset + header.vertexDataSize);
+        header.indexDataSize = (uint64_t)indexCount * sizeof(GLuint);
+
+        // written under a temporary name, so a reader never sees half a cache
+        return WriteSidecar(cachePath, [&](std::ostream& out) {
+
+            const char zeros[16] = { 0 };
+
+            out.write((const char*)&header, sizeof(header));
+            if (!sources.empty()) {
+                out.write((const char*)sources.data(), sources.size() * sizeof(MeshCacheSource));
+            }
+            if (!entries.empty()) {
+                out.write((const char*)entries.data(), entries.size() * sizeof(MeshCacheEntry));
+            }
+            if (!textures.empty()) {
+                out.write((const char*)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+            }
+            out.write(strings.data(), strings.size());
+            out.write(zeros, header.vertexDataOffset - (header.stringsOffset + header.stringsSize));
+
+            for (size_t i = 0; i < meshes.size(); i++) {
+                out.write((const char*)meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+            }
+            out.write(zeros, header.indexDataOffset - (header.vertexDataOffset + header.vertexDataSize));
+
+            for (size_t i = 0; i < meshes.size(); i++) {
+                out.write((const char*)meshes[i].indices.data(), meshes[i].indices.size() * sizeof(GLuint));
+            }
+            return true;
+        });
+    }
+}
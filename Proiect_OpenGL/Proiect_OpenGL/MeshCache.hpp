@@ -0,0 +1,141 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the layout below or the processing of the meshes changes - older caches are then rebuilt
+    const uint32_t MESH_CACHE_VERSION = 3;
+
+    // On-disk layout of a .gpsmesh file:
+    //   header | sources | mesh entries | textures | strings | vertex data | index data
+    // Offsets are in bytes from the start of the file, data blocks are 16 byte aligned.
+    struct MeshCacheHeader {
+
+        char magic[8];
+        uint32_t version;
+        uint32_t meshCount;
+        uint32_t sourceCount;
+        uint32_t textureCount;
+        uint64_t sourcesOffset;
+        uint64_t meshesOffset;
+        uint64_t texturesOffset;
+        uint64_t stringsOffset;
+        uint64_t stringsSize;
+        uint64_t vertexDataOffset;
+        uint64_t vertexDataSize;
+        uint64_t indexDataOffset;
+        uint64_t indexDataSize;
+    };
+
+    // A file the cache was built from (.obj or .mtl) - the cache is stale once any of them changes
+    struct MeshCacheSource {
+
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        int64_t modifiedTime;
+        uint64_t size;
+        uint64_t hash;
+    };
+
+    struct MeshCacheEntry {
+
+        // first vertex / index of the mesh inside the shared data blocks
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+        // object space bounds of the mesh vertices
+        float boundsMin[3];
+        float boundsMax[3];
+        float sphereCenter[3];
+        float sphereRadius;
+        uint32_t padding;
+    };
+
+    // Texture paths are stored relative to the model base path
+    struct MeshCacheTexture {
+
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        uint32_t typeOffset;
+        uint32_t typeLength;
+    };
+
+    // Start of the sidecars built from a single source file (.gpsbvh, .gpslod, .gpstex): which format they
+    // hold and the stamp of the source they were built from - they are stale once it changes
+    struct SidecarStamp {
+
+        char magic[8];
+        uint32_t version;
+        uint32_t padding;
+        int64_t sourceModifiedTime;
+        uint64_t sourceSize;
+    };
+
+    class MeshCache {
+
+    public:
+        MeshCache();
+
+        // Maps the cache file and checks its version and source stamps
+        bool Open(const std::string& cachePath);
+        void Close();
+
+        uint32_t getMeshCount() const;
+        const MeshCacheEntry& getMesh(uint32_t index) const;
+        const MeshCacheTexture& getTexture(uint32_t index) const;
+        const Vertex* getVertices(const MeshCacheEntry& mesh) const;
+        const GLuint* getIndices(const MeshCacheEntry& mesh) const;
+        // The whole vertex / index blocks - every mesh indexes them from its firstVertex / firstIndex
+        const Vertex* getVertexData() const;
+        size_t getVertexCount() const;
+        const GLuint* getIndexData() const;
+        size_t getIndexCount() const;
+        std::string getString(uint32_t offset, uint32_t length) const;
+        size_t getFileSize() const;
+
+        // Serializes the meshes of a freshly parsed .obj next to it
+        static bool Write(const std::string& cachePath, const std::string& objFileName, const std::string& basePath,
+            const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const std::vector<std::string>& names);
+
+        // Name of the sidecar cache belonging to an .obj file
+        static std::string CachePathFor(const std::string& objFileName);
+
+        // Name of a sidecar file next to a source file: the source path with its extension replaced
+        static std::string SidecarPathFor(const std::string& sourcePath, const char* extension);
+
+        // Writes a sidecar under a temporary name and renames it into place once write returned true
+        // and the stream is still good, so a reader never sees half a file
+        static bool WriteSidecar(const std::string& path, const std::function<bool(std::ostream&)>& write);
+
+        // Fills a sidecar stamp for the current state of sourcePath, false if it can not be read
+        static bool StampSidecar(const std::string& sourcePath, const char magic[8], uint32_t version, SidecarStamp* stamp);
+        // Whether a sidecar stamp has the given format and matches the current state of sourcePath
+        static bool MatchesSidecarStamp(const SidecarStamp& stamp, const std::string& sourcePath, const char magic[8], uint32_t version);
+
+    private:
+        MappedFile file;
+        const MeshCacheHeader* header;
+
+        bool IsWellFormed() const;
+        bool IsUpToDate() const;
+    };
+}
+
+#endif /* MeshCache_hpp */
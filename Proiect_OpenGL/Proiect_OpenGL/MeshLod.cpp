@@ -0,0 +1,655 @@
+#include "MeshLod.hpp"
+#include "CpuProfiler.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    static const char LOD_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'L', 'O', 'D', 0, 0 };
+    static const uint32_t LOD_CACHE_VERSION = 2;
+
+    // Each level aims for this fraction of the triangles of the previous one
+    static const float LEVEL_REDUCTION = 0.5f;
+    // A level that removes less than this fraction of the previous one is not worth its indices
+    static const float MIN_LEVEL_GAIN = 0.1f;
+    // Meshes this small are cheaper to draw than to switch
+    static const size_t MIN_LOD_TRIANGLES = 32;
+    // Largest error of a level, as a fraction of the mesh radius
+    static const float MAX_RELATIVE_ERROR = 0.25f;
+    // How much more a border or seam edge weighs than the faces around it
+    static const double BORDER_WEIGHT = 10.0;
+    // Collapses dearer than this times the cost the pass would need to reach its target are left for the next pass
+    static const double PASS_COST_MARGIN = 1.5;
+    // A coarser level has to be this far under the threshold before it is picked
+    static const float LOD_HYSTERESIS = 0.75f;
+
+    // How much a change of vertex normal counts next to the same change of position, see Simplify
+    static const double NORMAL_ERROR_WEIGHT = 1.0;
+    // Vertices whose normals are further apart than this (cosine) are a hard edge that stays
+    static const float MIN_NORMAL_SIMILARITY = 0.9f;
+
+    static const GLuint REMOVED = 0xffffffffu;
+
+    struct LodCacheHeader {
+
+        SidecarStamp stamp;
+        uint64_t meshCount;
+        uint64_t indexCount;
+    };
+
+    struct LodCacheMesh {
+
+        uint32_t sourceIndexCount;
+        uint32_t levelCount;
+        uint32_t indexCounts[MAX_LOD_LEVELS - 1];
+        float errors[MAX_LOD_LEVELS - 1];
+    };
+
+    // Sum of area weighted squared distances to a set of planes
+    struct Quadric {
+
+        double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+        double area;
+    };
+
+    static void AddPlane(Quadric& q, const glm::dvec3& n, double d, double weight) {
+
+        q.a2 += weight * n.x * n.x; q.b2 += weight * n.y * n.y; q.c2 += weight * n.z * n.z;
+        q.ab += weight * n.x * n.y; q.ac += weight * n.x * n.z; q.bc += weight * n.y * n.z;
+        q.ad += weight * n.x * d; q.bd += weight * n.y * d; q.cd += weight * n.z * d;
+        q.d2 += weight * d * d;
+    }
+
+    static void AddQuadric(Quadric& q, const Quadric& other) {
+
+        q.a2 += other.a2; q.b2 += other.b2; q.c2 += other.c2;
+        q.ab += other.ab; q.ac += other.ac; q.bc += other.bc;
+        q.ad += other.ad; q.bd += other.bd; q.cd += other.cd;
+        q.d2 += other.d2;
+        q.area += other.area;
+    }
+
+    static double Evaluate(const Quadric& q, const glm::vec3& point) {
+
+        double x = point.x, y = point.y, z = point.z;
+        double value = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+            + 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+            + 2.0 * (q.ad * x + q.bd * y + q.cd * z) + q.d2;
+        return value > 0.0 ? value : 0.0;
+    }
+
+    // Edge collapses over the welded positions of one mesh. The triangles keep the original vertex
+    // indices; a collapse moves every vertex at one position to a vertex at the other position: the one
+    // it shares an edge with across a UV seam, otherwise the one with the closest normal.
+    class LodBuilder {
+
+    public:
+        LodBuilder(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+        // Collapses the cheapest edges until at most targetTriangles are left or every remaining collapse
+        // would exceed maxError; returns the triangles left
+        size_t Simplify(size_t targetTriangles, float maxError);
+
+        const std::vector<GLuint>& getIndices() const { return indices; }
+        float getError() const { return error; }
+
+    private:
+        struct Collapse {
+
+            double cost;
+            uint32_t from;
+            uint32_t to;
+        };
+
+        const Vertex* vertexData;
+        std::vector<uint32_t> weld;                 // vertex -> position
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;             // average of the vertex normals at each position
+        std::vector<Quadric> quadrics;
+        std::vector<uint8_t> locked;
+        std::vector<uint8_t> uvSeam;                // the vertices at a position do not share one UV
+        std::vector<uint32_t> variantOffsets;       // vertices at each position
+        std::vector<GLuint> variants;
+        std::vector<GLuint> indices;
+        float error;
+
+        // per pass, triangles around each position
+        std::vector<uint32_t> triangleOffsets;
+        std::vector<uint32_t> positionTriangles;
+        std::vector<uint8_t> touched;
+        std::vector<std::pair<GLuint, GLuint> > moves;
+
+        void BuildAdjacency();
+        size_t TryCollapse(uint32_t from, uint32_t to);
+    };
+
+    struct PositionHash {
+
+        size_t operator()(const glm::vec3& p) const {
+
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+
+    LodBuilder::LodBuilder(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount)
+        : vertexData(vertexData), error(0.0f) {
+
+        // vertices split by normals or UVs share a position
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> positionIds;
+        weld.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            std::pair<std::unordered_map<glm::vec3, uint32_t, PositionHash>::iterator, bool> inserted =
+                positionIds.insert(std::make_pair(vertexData[i].Position, (uint32_t)positions.size()));
+            if (inserted.second) {
+                positions.push_back(vertexData[i].Position);
+            }
+            weld[i] = inserted.first->second;
+        }
+
+        Quadric zero;
+        memset(&zero, 0, sizeof(zero));
+        quadrics.assign(positions.size(), zero);
+        locked.assign(positions.size(), 0);
+
+        // vertices split only by their normals (flat shading, hard edges) can be swapped for each other
+        uvSeam.assign(positions.size(), 0);
+        variantOffsets.assign(positions.size() + 1, 0);
+        for (size_t i = 0; i < vertexCount; i++) {
+            variantOffsets[weld[i] + 1]++;
+        }
+        for (size_t p = 0; p < positions.size(); p++) {
+            variantOffsets[p + 1] += variantOffsets[p];
+        }
+        variants.resize(vertexCount);
+        normals.assign(positions.size(), glm::vec3(0.0f));
+        std::vector<uint32_t> cursor(variantOffsets.begin(), variantOffsets.end() - 1);
+        for (size_t i = 0; i < vertexCount; i++) {
+            uint32_t p = weld[i];
+            if (glm::dot(vertexData[i].Normal, vertexData[i].Normal) > 0.0f) {
+                normals[p] += glm::normalize(vertexData[i].Normal);
+            }
+            if (vertexData[i].TexCoords != vertexData[variants[variantOffsets[p]]].TexCoords && cursor[p] != variantOffsets[p]) {
+                uvSeam[p] = 1;
+            }
+            variants[cursor[p]++] = (GLuint)i;
+        }
+        for (size_t p = 0; p < positions.size(); p++) {
+            if (glm::dot(normals[p], normals[p]) > 0.0f) {
+                normals[p] = glm::normalize(normals[p]);
+            }
+        }
+
+        // degenerate triangles are dropped right away
+        size_t triangleCount = indexCount / 3;
+        indices.reserve(3 * triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            const GLuint* corner = indexData + 3 * t;
+            uint32_t a = weld[corner[0]], b = weld[corner[1]], c = weld[corner[2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            indices.insert(indices.end(), corner, corner + 3);
+
+            glm::dvec3 pa(positions[a]), pb(positions[b]), pc(positions[c]);
+            glm::dvec3 normal = glm::cross(pb - pa, pc - pa);
+            double length = glm::length(normal);
+            if (length <= 0.0) {
+                continue;
+            }
+            normal /= length;
+            double area = 0.5 * length;
+            double d = -glm::dot(normal, pa);
+            for (int k = 0; k < 3; k++) {
+                Quadric& q = quadrics[weld[corner[k]]];
+                AddPlane(q, normal, d, area);
+                q.area += area;
+            }
+        }
+
+        // undirected edges, once per triangle side
+        struct Side {
+
+            uint64_t key;
+            GLuint a;
+            GLuint b;
+            uint32_t triangle;
+        };
+        std::vector<Side> sides;
+        sides.reserve(indices.size());
+        for (size_t t = 0; t < indices.size() / 3; t++) {
+            for (int k = 0; k < 3; k++) {
+                GLuint a = indices[3 * t + k];
+                GLuint b = indices[3 * t + (k + 1) % 3];
+                uint32_t pa = weld[a], pb = weld[b];
+                Side side;
+                side.key = pa < pb ? ((uint64_t)pa << 32 | pb) : ((uint64_t)pb << 32 | pa);
+                side.a = pa < pb ? a : b;
+                side.b = pa < pb ? b : a;
+                side.triangle = (uint32_t)t;
+                sides.push_back(side);
+            }
+        }
+        std::sort(sides.begin(), sides.end(), [](const Side& x, const Side& y) { return x.key < y.key; });
+
+        for (size_t first = 0; first < sides.size(); ) {
+
+            size_t last = first + 1;
+            while (last < sides.size() && sides[last].key == sides[first].key) {
+                last++;
+            }
+
+            uint32_t pa = (uint32_t)(sides[first].key >> 32);
+            uint32_t pb = (uint32_t)(sides[first].key & 0xffffffffu);
+            if (last - first > 2) {
+                // more than two faces on an edge, moving its ends could tear anything
+                locked[pa] = 1;
+                locked[pb] = 1;
+            }
+            else {
+                // an open border or two faces that do not share the UVs of the edge; a normal crease is
+                // already held by the planes of its faces
+                bool border = last - first == 1 ||
+                    vertexData[sides[first].a].TexCoords != vertexData[sides[first + 1].a].TexCoords ||
+                    vertexData[sides[first].b].TexCoords != vertexData[sides[first + 1].b].TexCoords;
+                for (size_t s = first; border && s < last; s++) {
+
+                    const GLuint* corner = &indices[3 * sides[s].triangle];
+                    glm::dvec3 p0(vertexData[corner[0]].Position), p1(vertexData[corner[1]].Position), p2(vertexData[corner[2]].Position);
+                    glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+                    glm::dvec3 edge = glm::dvec3(positions[pb]) - glm::dvec3(positions[pa]);
+
+                    // plane through the edge, across the face, so sliding the edge costs and moving along it does not
+                    glm::dvec3 normal = glm::cross(edge, faceNormal);
+                    double length = glm::length(normal);
+                    if (length <= 0.0) {
+                        continue;
+                    }
+                    normal /= length;
+                    double d = -glm::dot(normal, glm::dvec3(positions[pa]));
+                    double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+                    AddPlane(quadrics[pa], normal, d, weight);
+                    AddPlane(quadrics[pb], normal, d, weight);
+                }
+            }
+            first = last;
+        }
+    }
+
+    void LodBuilder::BuildAdjacency() {
+
+        triangleOffsets.assign(positions.size() + 1, 0);
+        for (size_t i = 0; i < indices.size(); i++) {
+            triangleOffsets[weld[indices[i]] + 1]++;
+        }
+        for (size_t p = 0; p < positions.size(); p++) {
+            triangleOffsets[p + 1] += triangleOffsets[p];
+        }
+
+        positionTriangles.resize(indices.size());
+        std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            positionTriangles[cursor[weld[indices[i]]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    size_t LodBuilder::TryCollapse(uint32_t from, uint32_t to) {
+
+        // every vertex at from needs exactly one partner at to, otherwise a seam would tear
+        bool seam = uvSeam[from] || uvSeam[to];
+        moves.clear();
+        for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++) {
+
+            const GLuint* corner = &indices[3 * positionTriangles[i]];
+            for (int k = 0; k < 3; k++) {
+                if (weld[corner[k]] != from) {
+                    continue;
+                }
+                GLuint partner = REMOVED;
+                for (int j = 0; j < 3; j++) {
+                    if (weld[corner[j]] == to) {
+                        partner = corner[j];
+                    }
+                }
+
+                size_t m = 0;
+                while (m < moves.size() && moves[m].first != corner[k]) {
+                    m++;
+                }
+                if (m == moves.size()) {
+                    moves.push_back(std::make_pair(corner[k], partner));
+                }
+                else if (moves[m].second == REMOVED) {
+                    moves[m].second = partner;
+                }
+                else if (partner != REMOVED && partner != moves[m].second) {
+                    return 0;
+                }
+            }
+        }
+        for (size_t m = 0; m < moves.size(); m++) {
+
+            if (moves[m].second != REMOVED) {
+                continue;
+            }
+            if (seam) {
+                return 0;
+            }
+
+            // no edge to to, any vertex there has the same UV; a normal far from all of them is a crease
+            glm::vec3 normal = glm::normalize(vertexData[moves[m].first].Normal);
+            float closest = MIN_NORMAL_SIMILARITY;
+            for (uint32_t v = variantOffsets[to]; v < variantOffsets[to + 1]; v++) {
+                float similarity = glm::dot(normal, glm::normalize(vertexData[variants[v]].Normal));
+                if (similarity > closest) {
+                    closest = similarity;
+                    moves[m].second = variants[v];
+                }
+            }
+            if (moves[m].second == REMOVED) {
+                return 0;
+            }
+        }
+
+        // the faces that stay must not turn over
+        for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++) {
+
+            const GLuint* corner = &indices[3 * positionTriangles[i]];
+            if (weld[corner[0]] == to || weld[corner[1]] == to || weld[corner[2]] == to) {
+                continue;
+            }
+
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = positions[weld[corner[k]]];
+                after[k] = weld[corner[k]] == from ? positions[to] : before[k];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+                return 0;
+            }
+        }
+
+        // the faces around from change, nothing else touching them may collapse in this pass
+        for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++) {
+            const GLuint* corner = &indices[3 * positionTriangles[i]];
+            for (int k = 0; k < 3; k++) {
+                touched[weld[corner[k]]] = 1;
+            }
+        }
+
+        size_t removed = 0;
+        for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++) {
+
+            GLuint* corner = &indices[3 * positionTriangles[i]];
+            if (weld[corner[0]] == to || weld[corner[1]] == to || weld[corner[2]] == to) {
+                corner[0] = corner[1] = corner[2] = REMOVED;
+                removed++;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                for (size_t m = 0; m < moves.size(); m++) {
+                    if (corner[k] == moves[m].first) {
+                        corner[k] = moves[m].second;
+                        break;
+                    }
+                }
+            }
+        }
+        return removed;
+    }
+
+    size_t LodBuilder::Simplify(size_t targetTriangles, float maxError) {
+
+        std::vector<Collapse> collapses;
+        bool relaxed = false;
+
+        while (indices.size() / 3 > targetTriangles) {
+
+            BuildAdjacency();
+
+            // both directions of every edge
+            collapses.clear();
+            for (size_t t = 0; t < indices.size() / 3; t++) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t a = weld[indices[3 * t + k]];
+                    uint32_t b = weld[indices[3 * t + (k + 1) % 3]];
+                    for (int direction = 0; direction < 2; direction++) {
+                        uint32_t from = direction ? b : a;
+                        uint32_t to = direction ? a : b;
+                        if (locked[from]) {
+                            continue;
+                        }
+                        Quadric q = quadrics[from];
+                        AddQuadric(q, quadrics[to]);
+                        // a flat region shades differently once its vertex normals go, counted as if the
+                        // surface moved by the edge length times the change of normal
+                        glm::vec3 edge = positions[to] - positions[from];
+                        glm::vec3 turn = normals[to] - normals[from];
+                        double shading = NORMAL_ERROR_WEIGHT * (double)glm::dot(edge, edge) * (double)glm::dot(turn, turn);
+
+                        Collapse collapse;
+                        collapse.cost = (q.area > 0.0 ? Evaluate(q, positions[to]) / q.area : 0.0) + shading;
+                        collapse.from = from;
+                        collapse.to = to;
+                        collapses.push_back(collapse);
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                return x.cost < y.cost || (x.cost == y.cost && (x.from < y.from || (x.from == y.from && x.to < y.to)));
+            });
+
+            // the cheapest collapses that do not share a face go in one pass; a collapse removes about two
+            // faces, the ones much dearer than the cheapest that could reach the target wait for the next pass
+            touched.assign(positions.size(), 0);
+            size_t excess = indices.size() / 3 - targetTriangles;
+            size_t removed = 0;
+            double maxCost = (double)maxError * (double)maxError;
+            if (!collapses.empty() && !relaxed) {
+                size_t goal = glm::min(glm::max(excess / 2, (size_t)1), collapses.size());
+                maxCost = glm::min(maxCost, glm::max(collapses[goal - 1].cost * PASS_COST_MARGIN, 1e-12));
+            }
+            for (size_t c = 0; c < collapses.size() && removed < excess; c++) {
+
+                const Collapse& collapse = collapses[c];
+                if (collapse.cost > maxCost) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+
+                size_t collapsed = TryCollapse(collapse.from, collapse.to);
+                if (collapsed == 0) {
+                    continue;
+                }
+                removed += collapsed;
+                AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+                error = glm::max(error, (float)std::sqrt(collapse.cost));
+            }
+
+            // when nothing that cheap can go, the next pass tries everything under maxError
+            if (removed == 0) {
+                if (relaxed) {
+                    break;
+                }
+                relaxed = true;
+                continue;
+            }
+            relaxed = false;
+
+            size_t kept = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                if (indices[i] != REMOVED) {
+                    indices[kept++] = indices[i];
+                    indices[kept++] = indices[i + 1];
+                    indices[kept++] = indices[i + 2];
+                }
+            }
+            indices.resize(kept);
+        }
+
+        return indices.size() / 3;
+    }
+
+    void BuildLodChain(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, MeshLodChain* chain) {
+
+        GPS_CPU_ZONE("BuildLodChain");
+
+        chain->levelCount = 0;
+        chain->indices.clear();
+
+        size_t triangles = indexCount / 3;
+        if (triangles < MIN_LOD_TRIANGLES) {
+            return;
+        }
+
+        BoundingBox box;
+        BoundingSphere sphere;
+        ComputeBounds(vertexData, vertexCount, sizeof(Vertex), &box, &sphere);
+        float maxError = sphere.radius * MAX_RELATIVE_ERROR;
+
+        LodBuilder builder(vertexData, vertexCount, indexData, indexCount);
+        while (chain->levelCount < MAX_LOD_LEVELS - 1 && triangles >= MIN_LOD_TRIANGLES) {
+
+            size_t left = builder.Simplify((size_t)(triangles * LEVEL_REDUCTION), maxError);
+            if (left == 0 || (float)left > (1.0f - MIN_LEVEL_GAIN) * triangles) {
+                break;
+            }
+
+            const std::vector<GLuint>& indices = builder.getIndices();
+            chain->indexCounts[chain->levelCount] = (uint32_t)indices.size();
+            chain->errors[chain->levelCount] = builder.getError();
+            // the collapses leave holes in the cache order of the full mesh
+            size_t first = chain->indices.size();
+            chain->indices.insert(chain->indices.end(), indices.begin(), indices.end());
+            OptimizeVertexCache(chain->indices.data() + first, indices.size(), vertexCount);
+            chain->levelCount++;
+            triangles = left;
+        }
+    }
+
+    uint32_t SelectLod(const float* errors, uint32_t levelCount, float distance, const LodView& view, uint8_t& level) {
+
+        if (levelCount <= 1) {
+            level = 0;
+            return 0;
+        }
+
+        // inside the bounds every level is as close as it gets
+        float pixelsPerError = view.pixelsPerUnit / glm::max(distance, 1e-3f);
+        float threshold = view.maxPixelError;
+
+        uint32_t current = glm::min((uint32_t)level, levelCount - 1);
+        while (current > 0 && errors[current] * pixelsPerError > threshold) {
+            current--;
+        }
+        while (current + 1 < levelCount && errors[current + 1] * pixelsPerError <= threshold * LOD_HYSTERESIS) {
+            current++;
+        }
+
+        level = (uint8_t)current;
+        return current;
+    }
+
+    std::string LodCachePathFor(const std::string& objFileName) {
+
+        return MeshCache::SidecarPathFor(objFileName, ".gpslod");
+    }
+
+    bool WriteLodCache(const std::string& cachePath, const std::string& objFileName,
+        const std::vector<uint32_t>& meshIndexCounts, const std::vector<MeshLodChain>& chains) {
+
+        LodCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        if (meshIndexCounts.size() != chains.size() ||
+            !MeshCache::StampSidecar(objFileName, LOD_CACHE_MAGIC, LOD_CACHE_VERSION, &header.stamp)) {
+            return false;
+        }
+        header.meshCount = chains.size();
+        for (size_t m = 0; m < chains.size(); m++) {
+            header.indexCount += chains[m].indices.size();
+        }
+
+        return MeshCache::WriteSidecar(cachePath, [&](std::ostream& out) {
+            out.write((const char*)&header, sizeof(header));
+            for (size_t m = 0; m < chains.size(); m++) {
+                LodCacheMesh mesh;
+                memset(&mesh, 0, sizeof(mesh));
+                mesh.sourceIndexCount = meshIndexCounts[m];
+                mesh.levelCount = chains[m].levelCount;
+                memcpy(mesh.indexCounts, chains[m].indexCounts, mesh.levelCount * sizeof(uint32_t));
+                memcpy(mesh.errors, chains[m].errors, mesh.levelCount * sizeof(float));
+                out.write((const char*)&mesh, sizeof(mesh));
+            }
+            for (size_t m = 0; m < chains.size(); m++) {
+                out.write((const char*)chains[m].indices.data(), chains[m].indices.size() * sizeof(GLuint));
+            }
+            return true;
+        });
+    }
+
+    bool ReadLodCache(const std::string& cachePath, const std::string& objFileName, const std::vector<uint32_t>& meshIndexCounts,
+        const std::vector<uint32_t>& meshVertexCounts, std::vector<MeshLodChain>* chains) {
+
+        MappedFile file;
+        if (!file.Open(cachePath) || file.getSize() < sizeof(LodCacheHeader)) {
+            return false;
+        }
+
+        LodCacheHeader header;
+        memcpy(&header, file.getData(), sizeof(header));
+        if (!MeshCache::MatchesSidecarStamp(header.stamp, objFileName, LOD_CACHE_MAGIC, LOD_CACHE_VERSION) ||
+            header.meshCount != meshIndexCounts.size() || meshVertexCounts.size() != meshIndexCounts.size() ||
+            file.getSize() != sizeof(header) + header.meshCount * sizeof(LodCacheMesh) + header.indexCount * sizeof(GLuint)) {
+            return false;
+        }
+
+        const unsigned char* meshData = file.getData() + sizeof(header);
+        const GLuint* indexData = (const GLuint*)(meshData + header.meshCount * sizeof(LodCacheMesh));
+        uint64_t indexOffset = 0;
+
+        chains->resize(meshIndexCounts.size());
+        for (size_t m = 0; m < meshIndexCounts.size(); m++) {
+
+            LodCacheMesh mesh;
+            memcpy(&mesh, meshData + m * sizeof(LodCacheMesh), sizeof(mesh));
+            if (mesh.sourceIndexCount != meshIndexCounts[m] || mesh.levelCount > MAX_LOD_LEVELS - 1) {
+                chains->clear();
+                return false;
+            }
+
+            MeshLodChain& chain = (*chains)[m];
+            chain.levelCount = mesh.levelCount;
+            uint64_t count = 0;
+            for (uint32_t level = 0; level < mesh.levelCount; level++) {
+                chain.indexCounts[level] = mesh.indexCounts[level];
+                chain.errors[level] = mesh.errors[level];
+                count += mesh.indexCounts[level];
+            }
+            if (indexOffset + count > header.indexCount) {
+                chains->clear();
+                return false;
+            }
+            chain.indices.assign(indexData + indexOffset, indexData + indexOffset + count);
+            indexOffset += count;
+
+            for (size_t i = 0; i < chain.indices.size(); i++) {
+                if (chain.indices[i] >= meshVertexCounts[m]) {
+                    chains->clear();
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
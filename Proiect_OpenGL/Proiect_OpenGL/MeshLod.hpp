@@ -0,0 +1,82 @@
+#ifndef MeshLod_hpp
+#define MeshLod_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Levels a mesh can have, the full mesh included
+    const uint32_t MAX_LOD_LEVELS = 5;
+
+    // Hysteresis state kept per object: the camera pass and the shadow passes pick their levels apart
+    enum LodSlot {
+
+        LOD_SLOT_MAIN = 0,
+        LOD_SLOT_SHADOW = 1,
+        LOD_SLOT_COUNT = 2
+    };
+
+    // Triangles queued through LodView, next to what the full meshes would have cost
+    struct LodStats {
+
+        uint64_t triangles;
+        uint64_t fullTriangles;
+        uint64_t levelDraws[MAX_LOD_LEVELS];
+    };
+
+    // Camera the levels are chosen for. A level is used while its error, projected at the distance
+    // of the object, stays under maxPixelError pixels.
+    struct LodView {
+
+        glm::vec3 eye;              // in the space of the frustum culled against
+        float pixelsPerUnit;        // pixels covered by one unit at distance one, viewport height * projection[1][1] / 2
+        float maxPixelError;
+        LodSlot slot;
+        LodStats* stats;            // may be NULL
+    };
+
+    // Coarser index lists of one mesh, into the vertices of the full mesh
+    struct MeshLodChain {
+
+        uint32_t levelCount;                            // without the full mesh
+        uint32_t indexCounts[MAX_LOD_LEVELS - 1];
+        float errors[MAX_LOD_LEVELS - 1];               // object space, grows with the level
+        std::vector<GLuint> indices;                    // the levels back to back
+    };
+
+    // Simplifies a mesh with quadric error metrics into up to MAX_LOD_LEVELS - 1 levels of about half
+    // the triangles of the previous one. Edges collapse onto one of their vertices, so the levels only
+    // need new indices; UV seams, hard edges and open borders are kept in place.
+    void BuildLodChain(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, MeshLodChain* chain);
+
+    // Level to draw for a mesh whose closest point is distance away. level holds the level of the previous
+    // frame and is updated; coarser levels need some margin, so an object at the threshold does not flicker.
+    uint32_t SelectLod(const float* errors, uint32_t levelCount, float distance, const LodView& view, uint8_t& level);
+
+    // Name of the sidecar holding the levels of an .obj file
+    std::string LodCachePathFor(const std::string& objFileName);
+
+    // The file is stamped with the .obj so an edited model is simplified again
+    bool WriteLodCache(const std::string& cachePath, const std::string& objFileName,
+        const std::vector<uint32_t>& meshIndexCounts, const std::vector<MeshLodChain>& chains);
+
+    // Fails if the file is missing, stale, built for other meshes or indexes past their vertices
+    bool ReadLodCache(const std::string& cachePath, const std::string& objFileName, const std::vector<uint32_t>& meshIndexCounts,
+        const std::vector<uint32_t>& meshVertexCounts, std::vector<MeshLodChain>* chains);
+}
+
+#endif /* MeshLod_hpp */
@@ -0,0 +1,436 @@
+#include "MeshOptimizer.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    // LRU cache the Forsyth scores model; larger than the simulated FIFO, as in the original algorithm
+    static const int SCORE_CACHE_SIZE = 32;
+    static const float CACHE_DECAY_POWER = 1.5f;
+    // The last triangle's vertices score a bit lower, it is better to move on than to spin around them
+    static const float LAST_TRIANGLE_SCORE = 0.75f;
+    // Vertices with few triangles left are finished first, so they leave the working set
+    static const float VALENCE_BOOST_SCALE = 2.0f;
+    static const float VALENCE_BOOST_POWER = 0.5f;
+    // Valences with a precomputed boost, higher ones use the last entry
+    static const uint32_t MAX_SCORED_VALENCE = 64;
+
+    // Clusters may cost this much more ACMR than the cache order they were cut from
+    static const float OVERDRAW_THRESHOLD = 1.05f;
+
+    static const GLuint UNUSED = 0xffffffffu;
+
+    VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+
+        VertexCacheStats stats;
+        stats.triangles = indexCount / 3;
+        stats.vertices = 0;
+        stats.transforms = 0;
+
+        // a vertex is still cached while fewer than cacheSize misses happened since its own
+        std::vector<uint64_t> missTime(vertexCount, 0);
+        std::vector<uint8_t> referenced(vertexCount, 0);
+        uint64_t time = cacheSize + 1;
+
+        for (size_t i = 0; i < stats.triangles * 3; i++) {
+
+            GLuint v = indices[i];
+            if (time - missTime[v] > cacheSize) {
+                missTime[v] = time++;
+                stats.transforms++;
+            }
+            if (!referenced[v]) {
+                referenced[v] = 1;
+                stats.vertices++;
+            }
+        }
+        return stats;
+    }
+
+    size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+
+        // equal vertices end up next to each other, the first of a run in the original order keeps its slot
+        std::vector<GLuint> order(vertices.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = (GLuint)i;
+        }
+        std::sort(order.begin(), order.end(), [&](GLuint a, GLuint b) {
+            int compare = memcmp(&vertices[a], &vertices[b], sizeof(Vertex));
+            return compare != 0 ? compare < 0 : a < b;
+        });
+
+        std::vector<GLuint> canonical(vertices.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            bool same = i > 0 && memcmp(&vertices[order[i]], &vertices[order[i - 1]], sizeof(Vertex)) == 0;
+            canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+        }
+
+        std::vector<GLuint> remap(vertices.size());
+        size_t kept = 0;
+        for (size_t i = 0; i < vertices.size(); i++) {
+            if (canonical[i] == i) {
+                vertices[kept] = vertices[i];
+                remap[i] = (GLuint)kept++;
+            }
+        }
+
+        size_t welded = vertices.size() - kept;
+        for (size_t i = 0; i < indices.size(); i++) {
+            indices[i] = remap[canonical[indices[i]]];
+        }
+        vertices.resize(kept);
+        return welded;
+    }
+
+    // Tom Forsyth's scoring: recently used vertices and vertices with few triangles left score high,
+    // the next triangle is the one whose vertices add up to the best score
+    class ForsythOptimizer {
+
+    public:
+        ForsythOptimizer(const GLuint* indices, size_t triangleCount, size_t vertexCount);
+
+        void Run(GLuint* destination);
+
+    private:
+        const GLuint* indices;
+        size_t triangleCount;
+        // triangles still to be emitted around each vertex: adjacency[offsets[v] .. offsets[v] + remaining[v] - 1]
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> remaining;
+        std::vector<uint32_t> adjacency;
+        std::vector<int> cachePositions;
+        std::vector<float> vertexScores;
+        std::vector<float> triangleScores;
+        std::vector<uint8_t> emitted;
+        float cacheScores[SCORE_CACHE_SIZE];
+        float valenceScores[MAX_SCORED_VALENCE + 1];
+
+        float Score(GLuint vertex) const;
+    };
+
+    ForsythOptimizer::ForsythOptimizer(const GLuint* indices, size_t triangleCount, size_t vertexCount) :
+        indices(indices), triangleCount(triangleCount), offsets(vertexCount + 1, 0), remaining(vertexCount, 0),
+        adjacency(3 * triangleCount), cachePositions(vertexCount, -1), vertexScores(vertexCount, 0.0f),
+        triangleScores(triangleCount, 0.0f), emitted(triangleCount, 0) {
+
+        for (int i = 0; i < SCORE_CACHE_SIZE; i++) {
+            float scaler = 1.0f / (SCORE_CACHE_SIZE - 3);
+            cacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - (i - 3) * scaler, CACHE_DECAY_POWER);
+        }
+        valenceScores[0] = 0.0f;
+        for (uint32_t i = 1; i <= MAX_SCORED_VALENCE; i++) {
+            valenceScores[i] = VALENCE_BOOST_SCALE * std::pow((float)i, -VALENCE_BOOST_POWER);
+        }
+
+        for (size_t i = 0; i < 3 * triangleCount; i++) {
+            remaining[indices[i]]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] = offsets[v] + remaining[v];
+        }
+        std::vector<uint32_t> filled(vertexCount, 0);
+        for (size_t i = 0; i < 3 * triangleCount; i++) {
+            GLuint v = indices[i];
+            adjacency[offsets[v] + filled[v]++] = (uint32_t)(i / 3);
+        }
+
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScores[v] = Score((GLuint)v);
+        }
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        }
+    }
+
+    float ForsythOptimizer::Score(GLuint vertex) const {
+
+        uint32_t valence = remaining[vertex];
+        if (valence == 0) {
+            return -1.0f;
+        }
+        int position = cachePositions[vertex];
+        float score = position >= 0 ? cacheScores[position] : 0.0f;
+        return score + valenceScores[std::min(valence, MAX_SCORED_VALENCE)];
+    }
+
+    void ForsythOptimizer::Run(GLuint* destination) {
+
+        // the cache holds up to three vertices more while a triangle is pushed in
+        int cache[SCORE_CACHE_SIZE + 3];
+        int cacheSize = 0;
+        size_t scanCursor = 0;
+
+        int64_t best = -1;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (triangleScores[t] > bestScore) {
+                bestScore = triangleScores[t];
+                best = (int64_t)t;
+            }
+        }
+
+        for (size_t output = 0; output < triangleCount; output++) {
+
+            // nothing in the cache has triangles left: start over from the next one in the input
+            if (best < 0) {
+                while (emitted[scanCursor]) {
+                    scanCursor++;
+                }
+                best = (int64_t)scanCursor;
+            }
+
+            size_t triangle = (size_t)best;
+            emitted[triangle] = 1;
+            const GLuint* corners = indices + 3 * triangle;
+            destination[3 * output + 0] = corners[0];
+            destination[3 * output + 1] = corners[1];
+            destination[3 * output + 2] = corners[2];
+
+            // the triangle is taken off the lists of its vertices
+            for (int i = 0; i < 3; i++) {
+                GLuint v = corners[i];
+                uint32_t* first = &adjacency[offsets[v]];
+                uint32_t* last = first + remaining[v] - 1;
+                for (uint32_t* t = first; t <= last; t++) {
+                    if (*t == triangle) {
+                        std::swap(*t, *last);
+                        break;
+                    }
+                }
+                remaining[v]--;
+            }
+
+            // its vertices move to the front, the rest shifts back
+            int newCache[SCORE_CACHE_SIZE + 3];
+            int newSize = 0;
+            // degenerate triangles repeat a vertex
+            newCache[newSize++] = (int)corners[0];
+            if (corners[1] != corners[0]) {
+                newCache[newSize++] = (int)corners[1];
+            }
+            if (corners[2] != corners[0] && corners[2] != corners[1]) {
+                newCache[newSize++] = (int)corners[2];
+            }
+            for (int i = 0; i < cacheSize; i++) {
+                int v = cache[i];
+                if (v != (int)corners[0] && v != (int)corners[1] && v != (int)corners[2]) {
+                    newCache[newSize++] = v;
+                }
+            }
+
+            // rescore everything that moved, those pushed out of the cache included
+            for (int i = 0; i < newSize; i++) {
+
+                GLuint v = (GLuint)newCache[i];
+                cachePositions[v] = i < SCORE_CACHE_SIZE ? i : -1;
+                float score = Score(v);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+
+                const uint32_t* adjacent = &adjacency[offsets[v]];
+                for (uint32_t a = 0; a < remaining[v]; a++) {
+                    triangleScores[adjacent[a]] += delta;
+                }
+            }
+
+            cacheSize = std::min(newSize, SCORE_CACHE_SIZE);
+            memcpy(cache, newCache, cacheSize * sizeof(int));
+
+            // the next triangle is one of those around the cache
+            best = -1;
+            bestScore = -1.0f;
+            for (int i = 0; i < cacheSize; i++) {
+                GLuint v = (GLuint)cache[i];
+                const uint32_t* adjacent = &adjacency[offsets[v]];
+                for (uint32_t a = 0; a < remaining[v]; a++) {
+                    uint32_t t = adjacent[a];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        best = (int64_t)t;
+                    }
+                }
+            }
+        }
+    }
+
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        std::vector<GLuint> source(indices, indices + 3 * triangleCount);
+        ForsythOptimizer optimizer(source.data(), triangleCount, vertexCount);
+        optimizer.Run(indices);
+    }
+
+    size_t OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold) {
+
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return 0;
+        }
+
+        // hard boundaries: the cache order had all three vertices of the triangle miss anyway,
+        // so starting there again costs nothing
+        std::vector<size_t> hardStarts;
+        {
+            std::vector<uint64_t> missTime(vertexCount, 0);
+            uint64_t time = SIMULATED_VERTEX_CACHE_SIZE + 1;
+            for (size_t t = 0; t < triangleCount; t++) {
+                int misses = 0;
+                for (int i = 0; i < 3; i++) {
+                    GLuint v = indices[3 * t + i];
+                    if (time - missTime[v] > SIMULATED_VERTEX_CACHE_SIZE) {
+                        missTime[v] = time++;
+                        misses++;
+                    }
+                }
+                if (t == 0 || misses == 3) {
+                    hardStarts.push_back(t);
+                }
+            }
+            hardStarts.push_back(triangleCount);
+        }
+
+        // soft boundaries: within a hard cluster, a cluster ends as soon as its ACMR from a cold cache
+        // is within the threshold of the whole hard cluster's
+        std::vector<size_t> starts;
+        std::vector<uint64_t> missTime(vertexCount, 0);
+        uint64_t time = 0;
+        for (size_t h = 0; h + 1 < hardStarts.size(); h++) {
+
+            size_t begin = hardStarts[h];
+            size_t end = hardStarts[h + 1];
+
+            time += SIMULATED_VERTEX_CACHE_SIZE + 1;
+            uint64_t misses = 0;
+            for (size_t i = 3 * begin; i < 3 * end; i++) {
+                GLuint v = indices[i];
+                if (time - missTime[v] > SIMULATED_VERTEX_CACHE_SIZE) {
+                    missTime[v] = time++;
+                    misses++;
+                }
+            }
+            float limit = threshold * (float)misses / (float)(end - begin);
+
+            size_t clusterStart = begin;
+            time += SIMULATED_VERTEX_CACHE_SIZE + 1;
+            misses = 0;
+            for (size_t t = begin; t < end; t++) {
+                for (int i = 0; i < 3; i++) {
+                    GLuint v = indices[3 * t + i];
+                    if (time - missTime[v] > SIMULATED_VERTEX_CACHE_SIZE) {
+                        missTime[v] = time++;
+                        misses++;
+                    }
+                }
+                if (t + 1 < end && (float)misses / (float)(t + 1 - clusterStart) <= limit) {
+                    starts.push_back(clusterStart);
+                    clusterStart = t + 1;
+                    time += SIMULATED_VERTEX_CACHE_SIZE + 1;
+                    misses = 0;
+                }
+            }
+            starts.push_back(clusterStart);
+        }
+        size_t clusterCount = starts.size();
+        starts.push_back(triangleCount);
+
+        // clusters facing away from the middle of the mesh and far out along their normal go first
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+        std::vector<float> areas(clusterCount, 0.0f);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+                const glm::vec3& a = vertices[indices[3 * t + 0]].Position;
+                const glm::vec3& b = vertices[indices[3 * t + 1]].Position;
+                const glm::vec3& p = vertices[indices[3 * t + 2]].Position;
+                glm::vec3 normal = glm::cross(b - a, p - a);
+                float area = glm::length(normal);
+                centroids[c] += (a + b + p) * (area / 3.0f);
+                normals[c] += normal;
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+
+        std::vector<float> keys(clusterCount, 0.0f);
+        for (size_t c = 0; c < clusterCount; c++) {
+            float normalLength = glm::length(normals[c]);
+            if (areas[c] > 0.0f && normalLength > 0.0f) {
+                keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+            }
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+        std::vector<GLuint> source(indices, indices + 3 * triangleCount);
+        GLuint* destination = indices;
+        for (size_t c = 0; c < clusterCount; c++) {
+            size_t cluster = order[c];
+            size_t count = 3 * (starts[cluster + 1] - starts[cluster]);
+            memcpy(destination, source.data() + 3 * starts[cluster], count * sizeof(GLuint));
+            destination += count;
+        }
+        return clusterCount;
+    }
+
+    void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& index = remap[indices[i]];
+            if (index == UNUSED) {
+                index = (GLuint)ordered.size();
+                ordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = index;
+        }
+        vertices.swap(ordered);
+    }
+
+    static void AddCacheStats(VertexCacheStats& total, const VertexCacheStats& mesh) {
+
+        total.triangles += mesh.triangles;
+        total.vertices += mesh.vertices;
+        total.transforms += mesh.transforms;
+    }
+
+    void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, MeshOptimizeStats* stats) {
+
+        GPS_CPU_ZONE("OptimizeMesh");
+
+        if (stats != NULL) {
+            AddCacheStats(stats->before, AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), SIMULATED_VERTEX_CACHE_SIZE));
+        }
+
+        size_t welded = WeldVertices(vertices, indices);
+        OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+        size_t clusters = OptimizeOverdraw(indices.data(), indices.size(), vertices.data(), vertices.size(), OVERDRAW_THRESHOLD);
+        OptimizeVertexFetch(vertices, indices);
+
+        if (stats != NULL) {
+            AddCacheStats(stats->after, AnalyzeVertexCache(indices.data(), indices.size(), vertices.size(), SIMULATED_VERTEX_CACHE_SIZE));
+            stats->weldedVertices += welded;
+            stats->overdrawClusters += clusters;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Post-transform cache the triangle orders are measured with: a FIFO of this many vertices,
+    // on the small side of what GPUs have, so the numbers do not flatter the order
+    const uint32_t SIMULATED_VERTEX_CACHE_SIZE = 16;
+
+    // Vertex shader runs of a triangle order. ACMR = transforms / triangles (0.5 at best on a large
+    // regular grid, 3 at worst), ATVR = transforms / vertices (1 at best).
+    struct VertexCacheStats {
+
+        uint64_t triangles;
+        uint64_t vertices;
+        uint64_t transforms;
+    };
+
+    struct MeshOptimizeStats {
+
+        VertexCacheStats before;
+        VertexCacheStats after;
+        uint64_t weldedVertices;
+        uint64_t overdrawClusters;
+    };
+
+    // Runs the triangles through a FIFO cache of cacheSize vertices
+    VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize);
+
+    // Merges the vertices whose attributes are bit for bit the same, returns how many went away
+    size_t WeldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Reorders the triangles so they reuse the vertices still in the post-transform cache,
+    // with Tom Forsyth's linear-speed vertex cache optimisation
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    // Cuts a cache-ordered triangle list into clusters that can be moved around while the ACMR stays
+    // within threshold times that of the cache order, then draws the clusters facing out of the mesh
+    // first so they hide the rest (Sander et al.); returns how many clusters there were
+    size_t OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold);
+
+    // Renumbers the vertices in the order the triangles first use them, unreferenced ones are dropped
+    void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+    // Welding, vertex cache, overdraw and vertex fetch order, in that order.
+    // stats may be NULL, otherwise the counts of this mesh are added to it.
+    void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, MeshOptimizeStats* stats);
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -1,27 +1,233 @@
 #include "Model3D.hpp"
+#include "CpuProfiler.hpp"
+#include "GLInterceptor.hpp"
+#include "LoadTelemetry.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjParser.hpp"
+#include "ThreadPool.hpp"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include <unordered_map>
 
 namespace gps {
 
+	// Largest level of detail error of an occluder, relative to the radius of its mesh
+	static const float OCCLUDER_MAX_ERROR = 0.01f;
+
+	// Identifies a unique face corner by its (position, normal, texcoord) index triple
+	struct VertexKey {
+
+		int vertex_index;
+		int normal_index;
+		int texcoord_index;
+
+		bool operator==(const VertexKey& other) const {
+
+			return vertex_index == other.vertex_index &&
+				normal_index == other.normal_index &&
+				texcoord_index == other.texcoord_index;
+		}
+	};
+
+	struct VertexKeyHash {
+
+		size_t operator()(const VertexKey& key) const {
+
+			size_t h = (size_t)(unsigned int)key.vertex_index * 73856093u;
+			h ^= (size_t)(unsigned int)key.normal_index * 19349663u;
+			h ^= (size_t)(unsigned int)key.texcoord_index * 83492791u;
+			return h;
+		}
+	};
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
 
-		ReadOBJ(fileName, basePath);
+		GPS_CPU_ZONE("Model3D::LoadModel");
+
+		gps::LoadAsset& record = gps::LoadTelemetry::Current().BeginAsset(gps::LOAD_ASSET_MODEL, fileName);
+
+		if (!ReadMeshCache(fileName, basePath, record)) {
+
+			ReadOBJ(fileName, basePath, record);
+		}
+
+		arena.PrintMemoryReport(fileName);
+		record.vertices = arena.getVertexCount();
+		record.indices = arena.getIndexCount();
+		record.gpuBytes = arena.getUploadedBytes();
+
+		BuildHierarchies(fileName);
+
+		for (int slot = 0; slot < gps::LOD_SLOT_COUNT; slot++) {
+			lodLevels[slot].assign(meshes.size(), 0);
+		}
+
+		UploadTextures();
+
+		// buffer setup and uploads bound VAOs and textures behind the state tracker
+		GLState::Current().Invalidate();
+
+		gps::LoadTelemetry::Current().EndAsset(record);
+	}
+
+	// Queue the meshes inside the frustum only
+	void Model3D::Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, uint32_t transform,
+		const gps::Frustum& frustum, gps::CullStats& stats, const gps::LodView* lod, const gps::OcclusionTest* occlusion) {
+
+		if (meshes.empty()) {
+			return;
+		}
+
+		visibleMeshes.clear();
+		stats.boxTests += meshBvh.Cull(frustum, visibleMeshes);
+		stats.tested += meshes.size();
+
+		if (occlusion != NULL) {
+
+			size_t kept = 0;
+			for (size_t i = 0; i < visibleMeshes.size(); i++) {
+				if (occlusion->culler->IsVisible(meshes[visibleMeshes[i]].bounds, occlusion->objectToClip))
+					visibleMeshes[kept++] = visibleMeshes[i];
+			}
+			stats.occluded += visibleMeshes.size() - kept;
+			visibleMeshes.resize(kept);
+		}
+		stats.visible += visibleMeshes.size();
+
+		if (lod == NULL) {
+
+			for (size_t i = 0; i < visibleMeshes.size(); i++)
+				queue.Push(pass, shaderProgram, meshes[visibleMeshes[i]], transform);
+			return;
+		}
+
+		for (size_t i = 0; i < visibleMeshes.size(); i++) {
+
+			uint32_t index = visibleMeshes[i];
+			const gps::Mesh& mesh = meshes[index];
+
+			// distance to the closest point of the bounds, the error can be anywhere on the mesh
+			float distance = glm::length(lod->eye - mesh.sphere.center) - mesh.sphere.radius;
+			uint32_t level = gps::SelectLod(mesh.getLodErrors(), mesh.getLodCount(), distance, *lod, lodLevels[lod->slot][index]);
+			queue.Push(pass, shaderProgram, mesh, transform, level);
+
+			if (lod->stats != NULL) {
+				lod->stats->triangles += mesh.getLodRange(level).indexCount / 3;
+				lod->stats->fullTriangles += mesh.getIndexCount() / 3;
+				lod->stats->levelDraws[level]++;
+			}
+		}
+	}
+
+	size_t Model3D::DrawOccluders(gps::OcclusionCuller& culler, const glm::mat4& objectToClip, float minRadius) const {
+
+		gps::Frustum frustum(objectToClip);
+		size_t drawn = 0;
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			if (meshes[i].sphere.radius < minRadius || frustum.Classify(meshes[i].bounds) == gps::FRUSTUM_OUTSIDE)
+				continue;
+
+			uint32_t first = occluderOffsets[i];
+			culler.AddOccluder(collisionPositions.data() + collisionBaseVertices[i], meshes[i].getRange().vertexCount,
+				occluderTriangles.data() + 3 * first, occluderOffsets[i + 1] - first, objectToClip);
+			drawn++;
+		}
+		return drawn;
+	}
+
+	// Moller-Trumbore, returns the distance along direction or -1 for a miss
+	static float IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+		const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+
+		// both faces are hit, the scene is not closed everywhere
+		if (std::fabs(determinant) < 1e-12f) {
+			return -1.0f;
+		}
+
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = origin - a;
+		float u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f) {
+			return -1.0f;
+		}
+
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f) {
+			return -1.0f;
+		}
+
+		return glm::dot(edge2, q) * inverse;
 	}
 
-	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	gps::BoundingBox Model3D::getBounds() const {
+
+		gps::BoundingBox bounds;
+		bounds.min = glm::vec3(FLT_MAX);
+		bounds.max = glm::vec3(-FLT_MAX);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			bounds.min = glm::min(bounds.min, meshes[i].bounds.min);
+			bounds.max = glm::max(bounds.max, meshes[i].bounds.max);
+		}
 
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		if (meshes.empty()) {
+			bounds.min = glm::vec3(0.0f);
+			bounds.max = glm::vec3(0.0f);
+		}
+		return bounds;
+	}
+
+	const std::vector<gps::Mesh>& Model3D::getMeshes() const {
+
+		return meshes;
+	}
+
+	gps::Buffers Model3D::getBuffers() const {
+
+		return arena.getBuffers();
+	}
+
+	bool Model3D::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, gps::RayHit* hit) const {
+
+		uint32_t triangle;
+		float distance;
+		bool found = triangleBvh.Raycast(origin, direction, maxDistance, [&](uint32_t t) {
+
+			return IntersectTriangle(origin, direction,
+				collisionPositions[collisionTriangles[3 * t + 0]],
+				collisionPositions[collisionTriangles[3 * t + 1]],
+				collisionPositions[collisionTriangles[3 * t + 2]]);
+		}, &triangle, &distance);
+
+		if (found) {
+			hit->distance = distance;
+			hit->mesh = triangleMeshes[triangle];
+			hit->triangle = triangle;
+			hit->position = origin + direction * distance;
+		}
+		return found;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+	void Model3D::ReadOBJ(std::string fileName, std::string basePath, gps::LoadAsset& record) {
+
+		GPS_CPU_ZONE("Model3D::ReadOBJ");
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
@@ -30,7 +236,10 @@ namespace gps {
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		double parseStart = gps::LoadTelemetry::Now();
+		bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		record.parseMilliseconds = gps::LoadTelemetry::Now() - parseStart;
+		record.bytesRead = gps::LoadTelemetry::FileSize(fileName);
 
 		if (!err.empty()) {
 
@@ -46,6 +255,15 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		size_t totalCorners = 0;
+		size_t totalVertices = 0;
+		gps::MeshOptimizeStats optimizeStats = gps::MeshOptimizeStats();
+		double optimizeMilliseconds = 0.0;
+
+		// kept for the mesh cache
+		std::vector<gps::Material> meshMaterials;
+		std::vector<std::string> meshNames;
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
@@ -53,6 +271,11 @@ namespace gps {
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
 
+			// Face corners sharing the same index triple are welded into one vertex
+			std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueVertices;
+			uniqueVertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
+
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
@@ -68,6 +291,16 @@ namespace gps {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					VertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+					std::unordered_map<VertexKey, GLuint, VertexKeyHash>::iterator found = uniqueVertices.find(key);
+
+					if (found != uniqueVertices.end()) {
+
+						//corner already emitted - reuse its index
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
@@ -92,14 +325,32 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					GLuint newIndex = (GLuint)vertices.size();
+					uniqueVertices.insert(std::make_pair(key, newIndex));
+
 					vertices.push_back(currentVertex);
 
-					indices.push_back((GLuint)(index_offset + v));
+					indices.push_back(newIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			std::cout << "  shape " << s << " (" << shapes[s].name << ") : "
+				<< indices.size() << " corners -> " << vertices.size() << " vertices" << std::endl;
+			totalCorners += indices.size();
+			totalVertices += vertices.size();
+
+			// the triangles come in file order; reorder them for the GPU before anything keeps an index
+			double optimizeStart = gps::LoadTelemetry::Now();
+			gps::OptimizeMesh(vertices, indices, &optimizeStats);
+			optimizeMilliseconds += gps::LoadTelemetry::Now() - optimizeStart;
+
+			gps::Material currentMaterial;
+			currentMaterial.ambient = glm::vec3(0.0f);
+			currentMaterial.diffuse = glm::vec3(0.0f);
+			currentMaterial.specular = glm::vec3(0.0f);
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			size_t a = shapes[s].mesh.material_ids.size();
@@ -109,7 +360,6 @@ namespace gps {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
 
-					gps::Material currentMaterial;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -146,7 +396,253 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.push_back(gps::Mesh(&arena, arena.Add(vertices.data(), (GLsizei)vertices.size(), indices.data(), (GLsizei)indices.size()), textures));
+			gps::ComputeBounds(vertices.data(), vertices.size(), sizeof(gps::Vertex), &meshes.back().bounds, &meshes.back().sphere);
+			AddCollisionMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+			// kept until the cache is written
+			meshes.back().vertices.swap(vertices);
+			meshes.back().indices.swap(indices);
+			meshMaterials.push_back(currentMaterial);
+			meshNames.push_back(shapes[s].name);
+		}
+
+		std::cout << "# of vertices  : " << totalCorners << " -> " << totalVertices;
+		if (totalVertices > 0) {
+			std::cout << " (" << (float)totalCorners / (float)totalVertices << "x fewer)";
+		}
+		std::cout << std::endl;
+
+		// simulated post-transform cache, so the gain shows without a GPU
+		const gps::VertexCacheStats& before = optimizeStats.before;
+		const gps::VertexCacheStats& after = optimizeStats.after;
+		if (before.triangles > 0) {
+			std::cout << "Vertex cache : ACMR " << (float)before.transforms / before.triangles << " -> " << (float)after.transforms / after.triangles
+				<< ", ATVR " << (float)before.transforms / before.vertices << " -> " << (float)after.transforms / after.vertices
+				<< " (FIFO of " << gps::SIMULATED_VERTEX_CACHE_SIZE << "), " << optimizeStats.weldedVertices << " duplicate vertices welded, "
+				<< optimizeStats.overdrawClusters << " overdraw clusters (" << optimizeMilliseconds << " ms)" << std::endl;
+		}
+
+		std::vector<const gps::Vertex*> meshVertices(meshes.size());
+		std::vector<const GLuint*> meshIndices(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshVertices[i] = meshes[i].vertices.data();
+			meshIndices[i] = meshes[i].indices.data();
+		}
+		BuildLods(fileName, meshVertices, meshIndices);
+
+		double uploadStart = gps::LoadTelemetry::Now();
+		arena.Upload();
+		record.uploadMilliseconds = gps::LoadTelemetry::Now() - uploadStart;
+
+		std::string cachePath = gps::MeshCache::CachePathFor(fileName);
+		if (!gps::MeshCache::Write(cachePath, fileName, basePath, meshes, meshMaterials, meshNames)) {
+
+			std::cerr << "WARNING: could not write mesh cache " << cachePath << std::endl;
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			std::vector<gps::Vertex>().swap(meshes[i].vertices);
+			std::vector<GLuint>().swap(meshes[i].indices);
+		}
+	}
+
+	// Loads the meshes from the .gpsmesh sidecar, returns false if it is missing or stale
+	bool Model3D::ReadMeshCache(std::string fileName, std::string basePath, gps::LoadAsset& record) {
+
+		GPS_CPU_ZONE("Model3D::ReadMeshCache");
+
+		double parseStart = gps::LoadTelemetry::Now();
+
+		gps::MeshCache cache;
+		std::string cachePath = gps::MeshCache::CachePathFor(fileName);
+
+		if (!cache.Open(cachePath)) {
+
+			return false;
+		}
+
+		std::cout << "Loading : " << fileName << " (cached in " << cachePath << ")" << std::endl;
+		std::cout << "# of meshes    : " << cache.getMeshCount() << std::endl;
+		record.cached = true;
+		record.bytesRead = cache.getFileSize();
+
+		std::vector<const gps::Vertex*> meshVertices;
+		std::vector<const GLuint*> meshIndices;
+
+		for (uint32_t m = 0; m < cache.getMeshCount(); m++) {
+
+			const gps::MeshCacheEntry& entry = cache.getMesh(m);
+			meshVertices.push_back(cache.getVertices(entry));
+			meshIndices.push_back(cache.getIndices(entry));
+
+			std::vector<gps::Texture> textures;
+			for (uint32_t t = 0; t < entry.textureCount; t++) {
+
+				const gps::MeshCacheTexture& texture = cache.getTexture(entry.firstTexture + t);
+				std::string path = cache.getString(texture.pathOffset, texture.pathLength);
+				std::string type = cache.getString(texture.typeOffset, texture.typeLength);
+				textures.push_back(LoadTexture(basePath + path, type));
+			}
+
+			// the cache already stores the meshes back to back with mesh local indices
+			meshes.push_back(gps::Mesh(&arena, arena.AddRange((GLint)entry.firstVertex, (GLsizei)entry.vertexCount,
+				entry.firstIndex, (GLsizei)entry.indexCount), textures));
+
+			gps::Mesh& mesh = meshes.back();
+			mesh.bounds.min = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+			mesh.bounds.max = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+			mesh.sphere.center = glm::vec3(entry.sphereCenter[0], entry.sphereCenter[1], entry.sphereCenter[2]);
+			mesh.sphere.radius = entry.sphereRadius;
+
+			AddCollisionMesh(cache.getVertices(entry), entry.vertexCount, cache.getIndices(entry), entry.indexCount);
+		}
+
+		record.parseMilliseconds = gps::LoadTelemetry::Now() - parseStart;
+
+		BuildLods(fileName, meshVertices, meshIndices);
+
+		// the mapped blocks go straight to glBufferData, the levels of detail after them
+		double uploadStart = gps::LoadTelemetry::Now();
+		arena.Upload(cache.getVertexData(), cache.getVertexCount(), cache.getIndexData(), cache.getIndexCount());
+		record.uploadMilliseconds = gps::LoadTelemetry::Now() - uploadStart;
+
+		return true;
+	}
+
+	void Model3D::AddCollisionMesh(const gps::Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount) {
+
+		GLuint baseVertex = (GLuint)collisionPositions.size();
+		uint32_t mesh = (uint32_t)(meshes.size() - 1);
+		collisionBaseVertices.push_back(baseVertex);
+
+		collisionPositions.reserve(collisionPositions.size() + vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			collisionPositions.push_back(vertexData[i].Position);
+		}
+
+		// a trailing partial triangle is dropped, as GL_TRIANGLES does
+		size_t triangleCount = indexCount / 3;
+		collisionTriangles.reserve(collisionTriangles.size() + 3 * triangleCount);
+		for (size_t i = 0; i < 3 * triangleCount; i++) {
+			collisionTriangles.push_back(baseVertex + indexData[i]);
+		}
+		triangleMeshes.insert(triangleMeshes.end(), triangleCount, mesh);
+	}
+
+	void Model3D::BuildHierarchies(std::string fileName) {
+
+		GPS_CPU_ZONE("Model3D::BuildHierarchies");
+
+		std::string cachePath = gps::BvhCachePathFor(fileName);
+		size_t triangleCount = triangleMeshes.size();
+
+		if (gps::ReadBvhCache(cachePath, fileName, meshes.size(), triangleCount, &meshBvh, &triangleBvh)) {
+
+			std::cout << "BVH : " << meshBvh.getNodeCount() << " mesh nodes, " << triangleBvh.getNodeCount()
+				<< " triangle nodes (cached in " << cachePath << ")" << std::endl;
+			return;
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		std::vector<gps::BoundingBox> boxes(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			boxes[i] = meshes[i].bounds;
+		}
+		meshBvh.Build(boxes.data(), boxes.size(), 1);
+
+		boxes.resize(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::vec3& a = collisionPositions[collisionTriangles[3 * t + 0]];
+			const glm::vec3& b = collisionPositions[collisionTriangles[3 * t + 1]];
+			const glm::vec3& c = collisionPositions[collisionTriangles[3 * t + 2]];
+			boxes[t].min = glm::min(a, glm::min(b, c));
+			boxes[t].max = glm::max(a, glm::max(b, c));
+		}
+		triangleBvh.Build(boxes.data(), boxes.size(), 4);
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "BVH : " << meshBvh.getNodeCount() << " mesh nodes, " << triangleBvh.getNodeCount()
+			<< " triangle nodes (built in " << milliseconds << " ms)" << std::endl;
+
+		if (!gps::WriteBvhCache(cachePath, fileName, meshBvh, triangleBvh)) {
+
+			std::cerr << "WARNING: could not write BVH cache " << cachePath << std::endl;
+		}
+	}
+
+	void Model3D::BuildLods(std::string fileName, const std::vector<const gps::Vertex*>& vertexData,
+		const std::vector<const GLuint*>& indexData) {
+
+		std::string cachePath = gps::LodCachePathFor(fileName);
+		std::vector<uint32_t> indexCounts(meshes.size());
+		std::vector<uint32_t> vertexCounts(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			indexCounts[i] = (uint32_t)meshes[i].getIndexCount();
+			vertexCounts[i] = (uint32_t)meshes[i].getRange().vertexCount;
+		}
+
+		std::vector<gps::MeshLodChain> chains;
+		bool cached = gps::ReadLodCache(cachePath, fileName, indexCounts, vertexCounts, &chains);
+		double milliseconds = 0.0;
+
+		if (!cached) {
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+			chains.resize(meshes.size());
+			gps::ThreadPool::Shared().ParallelFor(meshes.size(), [&](size_t i) {
+				gps::GeometryRange range = meshes[i].getRange();
+				gps::BuildLodChain(vertexData[i], range.vertexCount, indexData[i], range.indexCount, &chains[i]);
+			});
+
+			milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			if (!gps::WriteLodCache(cachePath, fileName, indexCounts, chains)) {
+
+				std::cerr << "WARNING: could not write LOD cache " << cachePath << std::endl;
+			}
+		}
+
+		size_t levels = 0;
+		size_t fullTriangles = 0;
+		size_t coarsestTriangles = 0;
+		occluderTriangles.clear();
+		occluderOffsets.assign(1, 0);
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			const gps::MeshLodChain& chain = chains[i];
+			const GLuint* levelIndices = chain.indices.data();
+			for (uint32_t level = 0; level < chain.levelCount; level++) {
+				meshes[i].AddLod(arena.AddIndices(meshes[i].getRange(), levelIndices, (GLsizei)chain.indexCounts[level]), chain.errors[level]);
+				levelIndices += chain.indexCounts[level];
+			}
+
+			// occluders take the coarsest level that stays close to the mesh: the levels keep a subset of
+			// its vertices, so they only leave it where they fill in hollows
+			uint32_t occluderLevel = 0;
+			while (occluderLevel < chain.levelCount && chain.errors[occluderLevel] <= OCCLUDER_MAX_ERROR * meshes[i].sphere.radius)
+				occluderLevel++;
+			const GLuint* occluderIndices = occluderLevel == 0 ? indexData[i] : chain.indices.data();
+			for (uint32_t level = 0; level + 1 < occluderLevel; level++)
+				occluderIndices += chain.indexCounts[level];
+			size_t occluderIndexCount = occluderLevel == 0 ? meshes[i].getIndexCount() / 3 * 3 : chain.indexCounts[occluderLevel - 1];
+			occluderTriangles.insert(occluderTriangles.end(), occluderIndices, occluderIndices + occluderIndexCount);
+			occluderOffsets.push_back((uint32_t)(occluderTriangles.size() / 3));
+
+			levels += chain.levelCount;
+			fullTriangles += meshes[i].getIndexCount() / 3;
+			coarsestTriangles += meshes[i].getLodRange(meshes[i].getLodCount() - 1).indexCount / 3;
+		}
+
+		std::cout << "LOD : " << levels << " levels over " << meshes.size() << " meshes, " << fullTriangles << " -> "
+			<< coarsestTriangles << " triangles at the coarsest";
+		if (cached) {
+			std::cout << " (cached in " << cachePath << ")" << std::endl;
+		}
+		else {
+			std::cout << " (built in " << milliseconds << " ms)" << std::endl;
 		}
 	}
 
@@ -163,77 +659,36 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = 0;
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
 			loadedTextures.push_back(currentTexture);
+			textureLoader.Request(path);
 
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+	// Decodes the queued textures in parallel, uploads them and patches their ids into the meshes
+	void Model3D::UploadTextures() {
 
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+		GPS_CPU_ZONE("Model3D::UploadTextures");
 
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
-		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
+		textureLoader.Finish([this](size_t slot, GLuint textureId) {
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
+			loadedTextures[slot].id = textureId;
 
-		for (int row = 0; row < half_height; row++) {
+			for (size_t i = 0; i < meshes.size(); i++) {
 
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
+				for (size_t t = 0; t < meshes[i].textures.size(); t++) {
 
-			for (int col = 0; col < width_in_bytes; col++) {
+					if (meshes[i].textures[t].path == loadedTextures[slot].path) {
 
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
+						meshes[i].textures[t].id = textureId;
+					}
+				}
 			}
-		}
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+		});
 	}
 
 	Model3D::~Model3D() {
@@ -241,10 +696,16 @@ namespace gps {
         for (size_t i = 0; i < loadedTextures.size(); i++) {
 
             glDeleteTextures(1, &loadedTextures.at(i).id);
+            gps::GLInterceptor::Current().NoteDeleteTextures(1, &loadedTextures.at(i).id);
         }
 
+        // arena meshes are freed with the arena
         for (size_t i = 0; i < meshes.size(); i++) {
 
+            if (!meshes.at(i).ownsBuffers()) {
+                continue;
+            }
+
             GLuint VBO = meshes.at(i).getBuffers().VBO;
             GLuint EBO = meshes.at(i).getBuffers().EBO;
             GLuint VAO = meshes.at(i).getBuffers().VAO;
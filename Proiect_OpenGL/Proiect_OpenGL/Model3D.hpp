@@ -1,7 +1,16 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "Bounds.hpp"
+#include "Bvh.hpp"
+#include "GeometryArena.hpp"
+#include "LoadTelemetry.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MeshLod.hpp"
+#include "OcclusionCuller.hpp"
+#include "RenderQueue.hpp"
+#include "TextureLoader.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -12,6 +21,15 @@
 
 namespace gps {
 
+    // Closest triangle found by Model3D::Raycast, in the object space of the model
+    struct RayHit {
+
+        float distance;
+        uint32_t mesh;
+        uint32_t triangle;
+        glm::vec3 position;
+    };
+
     class Model3D {
 
     public:
@@ -21,22 +39,78 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// Queues only the meshes whose bounds touch the frustum; the frustum must be in object space,
+		// i.e. built from clip * model. With a view, each mesh is drawn at the level of detail picked for it.
+		// With an occlusion test the meshes hidden behind its occluders are dropped too.
+		void Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, uint32_t transform,
+			const gps::Frustum& frustum, gps::CullStats& stats, const gps::LodView* lod = NULL,
+			const gps::OcclusionTest* occlusion = NULL);
+
+		// Rasterizes the meshes with a bounding sphere of at least minRadius that touch the frustum into the culler,
+		// using a coarse level of detail; returns how many there were
+		size_t DrawOccluders(gps::OcclusionCuller& culler, const glm::mat4& objectToClip, float minRadius) const;
+
+		// Closest triangle along origin + t * direction for t in [0, maxDistance], in object space
+		bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, gps::RayHit* hit) const;
+
+		// Union of the mesh bounds, in object space
+		gps::BoundingBox getBounds() const;
+
+		const std::vector<gps::Mesh>& getMeshes() const;
+
+		// Buffers of the arena all the meshes live in
+		gps::Buffers getBuffers() const;
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
+		// Vertex and index data of all the meshes, drawn through a single VAO
+		gps::GeometryArena arena;
+		// Hierarchy over the mesh bounds for culling and over the triangles for ray queries
+		gps::Bvh meshBvh;
+		gps::Bvh triangleBvh;
+		std::vector<uint32_t> visibleMeshes;
+		// Level of detail each mesh was drawn at last time, per slot
+		std::vector<uint8_t> lodLevels[gps::LOD_SLOT_COUNT];
+		// CPU copy of the geometry for ray queries - triangle indices point into collisionPositions
+		std::vector<glm::vec3> collisionPositions;
+		std::vector<GLuint> collisionTriangles;
+		std::vector<uint32_t> triangleMeshes;
+		// Coarse triangles of each mesh drawn as occluders, with mesh local indices;
+		// those of mesh i start at triangle occluderOffsets[i]
+		std::vector<GLuint> occluderTriangles;
+		std::vector<uint32_t> occluderOffsets;
+		// first position of each mesh in collisionPositions
+		std::vector<uint32_t> collisionBaseVertices;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Decodes the textures requested while parsing - same slots as loadedTextures
+		gps::TextureLoader textureLoader;
+
+		// Does the parsing of the .obj file and fills in the data structure;
+		// both readers note their parse and upload times and bytes read in record
+		void ReadOBJ(std::string fileName, std::string basePath, gps::LoadAsset& record);
 
-		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		// Loads the meshes from the .gpsmesh sidecar, returns false if it is missing or stale
+		bool ReadMeshCache(std::string fileName, std::string basePath, gps::LoadAsset& record);
 
 		// Retrieves a texture associated with the object - by its name and type
+		// New textures are only queued, their id is patched in by UploadTextures
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Keeps the positions and triangles of one mesh for ray queries
+		void AddCollisionMesh(const gps::Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+		// Loads the .gpsbvh sidecar or builds both hierarchies and writes it
+		void BuildHierarchies(std::string fileName);
+
+		// Loads the .gpslod sidecar or simplifies the meshes and writes it, then adds the levels to the arena;
+		// must run before the arena is uploaded, with the full geometry of every mesh
+		void BuildLods(std::string fileName, const std::vector<const gps::Vertex*>& vertexData,
+			const std::vector<const GLuint*>& indexData);
+
+		// Decodes the queued textures in parallel, uploads them and patches their ids into the meshes
+		void UploadTextures();
     };
 }
 
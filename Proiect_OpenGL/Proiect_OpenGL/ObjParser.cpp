@@ -0,0 +1,724 @@
+#include "ObjParser.hpp"
+#include "CpuProfiler.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace gps {
+
+    // Chunks smaller than this are not worth a task of their own
+    static const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+
+    enum ObjEventType {
+
+        OBJ_EVENT_USEMTL,
+        OBJ_EVENT_MTLLIB,
+        OBJ_EVENT_GROUP,
+        OBJ_EVENT_OBJECT
+    };
+
+    // A non-geometry statement, replayed in file order during the merge
+    struct ObjEvent {
+
+        ObjEventType type;
+        // number of faces of the chunk that precede the statement
+        size_t faceIndex;
+        std::string name;
+    };
+
+    // Everything parsed from one line aligned slice of the file
+    struct ObjChunk {
+
+        const char* begin;
+        const char* end;
+
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+
+        // zero based position/texcoord/normal indices of every face corner
+        std::vector<tinyobj::index_t> corners;
+        // first corner of every face, plus one past the last face
+        std::vector<uint32_t> faceOffsets;
+        std::vector<ObjEvent> events;
+
+        // corners holding a negative (relative) index; they are relative to the
+        // chunk until the merge adds the number of elements of preceding chunks
+        // - encoded as corner * 3 + component (0 = v, 1 = vt, 2 = vn)
+        std::vector<size_t> relativeFixups;
+
+        // set when the chunk uses a statement this parser leaves to tinyobj
+        bool unsupported;
+    };
+
+    static inline bool IsSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsDigit(char c) {
+        return (unsigned)(c - '0') < 10u;
+    }
+
+    static inline const char* SkipSpaces(const char* p, const char* end) {
+
+        while (p < end && IsSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    static inline const char* SkipToken(const char* p, const char* end) {
+
+        while (p < end && !IsSpace(*p) && *p != '\r') {
+            p++;
+        }
+        return p;
+    }
+
+    // Parses [sign] digits [. digits] [(e|E) [sign] digits] - anything else gives 0,
+    // the same grammar tinyobj's tryParseDouble accepts
+    static bool ParseDouble(const char* p, const char* end, double* result) {
+
+        static const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        if (p >= end) {
+            return false;
+        }
+
+        bool negative = false;
+        if (*p == '+' || *p == '-') {
+            negative = (*p == '-');
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool anyDigit = false;
+
+        while (p < end && IsDigit(*p)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa != 0) {
+                    digits++;
+                }
+            }
+            else {
+                exponent++;
+            }
+            anyDigit = true;
+            p++;
+        }
+
+        if (!anyDigit) {
+            return false;
+        }
+
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && IsDigit(*p)) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    if (mantissa != 0) {
+                        digits++;
+                    }
+                    exponent--;
+                }
+                p++;
+            }
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '+' || *p == '-')) {
+                negativeExponent = (*p == '-');
+                p++;
+            }
+            if (p >= end || !IsDigit(*p)) {
+                return false;
+            }
+            int value = 0;
+            while (p < end && IsDigit(*p)) {
+                if (value < 10000) {
+                    value = value * 10 + (*p - '0');
+                }
+                p++;
+            }
+            exponent += negativeExponent ? -value : value;
+        }
+
+        double number = (double)mantissa;
+        if (exponent < 0 && exponent >= -22) {
+            number /= POW10[-exponent];
+        }
+        else if (exponent > 0 && exponent <= 22) {
+            number *= POW10[exponent];
+        }
+        else if (exponent != 0) {
+            number *= pow(10.0, exponent);
+        }
+
+        *result = negative ? -number : number;
+        return true;
+    }
+
+    static inline const char* ParseFloat(const char* p, const char* end, float* out, double defaultValue) {
+
+        p = SkipSpaces(p, end);
+        const char* tokenEnd = SkipToken(p, end);
+
+        double value = defaultValue;
+        ParseDouble(p, tokenEnd, &value);
+        *out = (float)value;
+
+        return tokenEnd;
+    }
+
+    // atoi() on a bounded range
+    static inline const char* ParseInt(const char* p, const char* end, int* out) {
+
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative = (*p == '-');
+            p++;
+        }
+
+        int value = 0;
+        while (p < end && IsDigit(*p)) {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+
+        *out = negative ? -value : value;
+        return p;
+    }
+
+    static inline const char* SkipToDelimiter(const char* p, const char* end) {
+
+        while (p < end && *p != '/' && !IsSpace(*p) && *p != '\r') {
+            p++;
+        }
+        return p;
+    }
+
+    // Turns a 1-based/negative .obj index into the zero based one tinyobj uses;
+    // negative indices are resolved against the chunk and fixed up in the merge
+    static inline int FixIndex(int index, size_t localCount, ObjChunk& chunk, size_t fixup) {
+
+        if (index > 0) {
+            return index - 1;
+        }
+        if (index == 0) {
+            return 0;
+        }
+
+        chunk.relativeFixups.push_back(fixup);
+        return (int)localCount + index;
+    }
+
+    // Parses i, i/j, i//k and i/j/k
+    static const char* ParseCorner(const char* p, const char* end, ObjChunk& chunk) {
+
+        size_t corner = chunk.corners.size();
+        tinyobj::index_t index;
+        index.vertex_index = -1;
+        index.texcoord_index = -1;
+        index.normal_index = -1;
+
+        int value;
+        p = ParseInt(p, end, &value);
+        index.vertex_index = FixIndex(value, chunk.v.size() / 3, chunk, corner * 3 + 0);
+        p = SkipToDelimiter(p, end);
+
+        if (p < end && *p == '/') {
+            p++;
+
+            if (p < end && *p == '/') {
+                // i//k
+                p++;
+                p = ParseInt(p, end, &value);
+                index.normal_index = FixIndex(value, chunk.vn.size() / 3, chunk, corner * 3 + 2);
+                p = SkipToDelimiter(p, end);
+            }
+            else {
+                // i/j or i/j/k
+                p = ParseInt(p, end, &value);
+                index.texcoord_index = FixIndex(value, chunk.vt.size() / 2, chunk, corner * 3 + 1);
+                p = SkipToDelimiter(p, end);
+
+                if (p < end && *p == '/') {
+                    p++;
+                    p = ParseInt(p, end, &value);
+                    index.normal_index = FixIndex(value, chunk.vn.size() / 3, chunk, corner * 3 + 2);
+                    p = SkipToDelimiter(p, end);
+                }
+            }
+        }
+
+        chunk.corners.push_back(index);
+        return p;
+    }
+
+    static inline bool StartsWithKeyword(const char* p, const char* end, const char* keyword, size_t length) {
+
+        return (size_t)(end - p) > length && strncmp(p, keyword, length) == 0 && IsSpace(p[length]);
+    }
+
+    // First whitespace separated word after the keyword, like sscanf("%s")
+    static std::string ReadWord(const char* p, const char* end) {
+
+        p = SkipSpaces(p, end);
+        while (p < end && *p == '\r') {
+            p++;
+        }
+        const char* wordEnd = SkipToken(p, end);
+        return std::string(p, wordEnd);
+    }
+
+    static void ParseLine(const char* p, const char* end, ObjChunk& chunk) {
+
+        p = SkipSpaces(p, end);
+        if (p >= end || *p == '#' || *p == '\r') {
+            return;
+        }
+
+        if (p[0] == 'v' && end - p > 1) {
+
+            // vertex
+            if (IsSpace(p[1])) {
+                float x, y, z;
+                p = ParseFloat(p + 2, end, &x, 0.0);
+                p = ParseFloat(p, end, &y, 0.0);
+                p = ParseFloat(p, end, &z, 0.0);
+                chunk.v.push_back(x);
+                chunk.v.push_back(y);
+                chunk.v.push_back(z);
+                return;
+            }
+
+            // normal
+            if (p[1] == 'n' && end - p > 2 && IsSpace(p[2])) {
+                float x, y, z;
+                p = ParseFloat(p + 3, end, &x, 0.0);
+                p = ParseFloat(p, end, &y, 0.0);
+                p = ParseFloat(p, end, &z, 0.0);
+                chunk.vn.push_back(x);
+                chunk.vn.push_back(y);
+                chunk.vn.push_back(z);
+                return;
+            }
+
+            // texcoord
+            if (p[1] == 't' && end - p > 2 && IsSpace(p[2])) {
+                float x, y;
+                p = ParseFloat(p + 3, end, &x, 0.0);
+                p = ParseFloat(p, end, &y, 0.0);
+                chunk.vt.push_back(x);
+                chunk.vt.push_back(y);
+                return;
+            }
+
+            return;
+        }
+
+        // face
+        if (p[0] == 'f' && end - p > 1 && IsSpace(p[1])) {
+
+            p = SkipSpaces(p + 2, end);
+            while (p < end && *p != '\r') {
+                p = ParseCorner(p, end, chunk);
+                while (p < end && (IsSpace(*p) || *p == '\r')) {
+                    p++;
+                }
+            }
+            chunk.faceOffsets.push_back((uint32_t)chunk.corners.size());
+            return;
+        }
+
+        ObjEvent event;
+        event.faceIndex = chunk.faceOffsets.size() - 1;
+
+        if (StartsWithKeyword(p, end, "usemtl", 6)) {
+            event.type = OBJ_EVENT_USEMTL;
+            event.name = ReadWord(p + 7, end);
+            chunk.events.push_back(event);
+            return;
+        }
+
+        if (StartsWithKeyword(p, end, "mtllib", 6)) {
+            event.type = OBJ_EVENT_MTLLIB;
+            event.name = ReadWord(p + 7, end);
+            chunk.events.push_back(event);
+            return;
+        }
+
+        // group name - tinyobj keeps the second name of the line ("g name ...")
+        if (p[0] == 'g' && end - p > 1 && IsSpace(p[1])) {
+            event.type = OBJ_EVENT_GROUP;
+            event.name = ReadWord(p + 2, end);
+            chunk.events.push_back(event);
+            return;
+        }
+
+        // object name
+        if (p[0] == 'o' && end - p > 1 && IsSpace(p[1])) {
+            event.type = OBJ_EVENT_OBJECT;
+            event.name = ReadWord(p + 2, end);
+            chunk.events.push_back(event);
+            return;
+        }
+
+        // tags are rare enough to leave them to tinyobj
+        if (p[0] == 't' && end - p > 1 && IsSpace(p[1])) {
+            chunk.unsupported = true;
+        }
+
+        // Ignore unknown command.
+    }
+
+    static void ParseChunk(ObjChunk& chunk) {
+
+        GPS_CPU_ZONE("ParseChunk");
+
+        // rough guess: a face line is ~30 bytes
+        size_t estimatedFaces = (chunk.end - chunk.begin) / 64;
+        chunk.corners.reserve(estimatedFaces * 3);
+        chunk.faceOffsets.reserve(estimatedFaces + 1);
+        chunk.faceOffsets.push_back(0);
+
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+
+            const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+            if (lineEnd == NULL) {
+                lineEnd = chunk.end;
+            }
+
+            ParseLine(p, lineEnd, chunk);
+            p = lineEnd + 1;
+        }
+    }
+
+    // Position of a face in the merged face stream
+    struct ObjFaceCursor {
+
+        size_t chunk;
+        size_t face;
+    };
+
+    // Mirror of tinyobj's exportFaceGroupToShape, reading the faces between two cursors
+    static bool ExportFaceGroup(tinyobj::shape_t* shape, const std::vector<ObjChunk>& chunks,
+        ObjFaceCursor from, ObjFaceCursor to, int materialId, const std::string& name, bool triangulate) {
+
+        // the end of one chunk and the start of the next are the same position
+        bool empty = true;
+        for (size_t c = from.chunk; c <= to.chunk && empty; c++) {
+            size_t firstFace = (c == from.chunk) ? from.face : 0;
+            size_t lastFace = (c == to.chunk) ? to.face : chunks[c].faceOffsets.size() - 1;
+            empty = (firstFace >= lastFace);
+        }
+
+        if (empty) {
+            return false;
+        }
+
+        for (size_t c = from.chunk; c <= to.chunk; c++) {
+
+            const ObjChunk& chunk = chunks[c];
+            size_t firstFace = (c == from.chunk) ? from.face : 0;
+            size_t lastFace = (c == to.chunk) ? to.face : chunk.faceOffsets.size() - 1;
+
+            for (size_t f = firstFace; f < lastFace; f++) {
+
+                const tinyobj::index_t* face = &chunk.corners[chunk.faceOffsets[f]];
+                size_t npolys = chunk.faceOffsets[f + 1] - chunk.faceOffsets[f];
+
+                if (triangulate) {
+
+                    // Polygon -> triangle fan conversion
+                    for (size_t k = 2; k < npolys; k++) {
+                        shape->mesh.indices.push_back(face[0]);
+                        shape->mesh.indices.push_back(face[k - 1]);
+                        shape->mesh.indices.push_back(face[k]);
+                        shape->mesh.num_face_vertices.push_back(3);
+                        shape->mesh.material_ids.push_back(materialId);
+                    }
+                }
+                else {
+
+                    for (size_t k = 0; k < npolys; k++) {
+                        shape->mesh.indices.push_back(face[k]);
+                    }
+                    shape->mesh.num_face_vertices.push_back((unsigned char)npolys);
+                    shape->mesh.material_ids.push_back(materialId);
+                }
+            }
+        }
+
+        shape->name = name;
+        shape->mesh.tags.clear();
+        return true;
+    }
+
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basepath, bool triangulate) {
+
+        GPS_CPU_ZONE("LoadObjParallel");
+
+        MappedFile file;
+        if (!file.Open(filename)) {
+            // missing or empty file - let tinyobj report it the usual way
+            return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtl_basepath, triangulate);
+        }
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        ThreadPool& pool = ThreadPool::Shared();
+
+        // split at line boundaries, a few chunks per worker to even out the load
+        const char* data = (const char*)file.getData();
+        const char* dataEnd = data + file.getSize();
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(pool.getThreadCount() * 4, file.getSize() / OBJ_MIN_CHUNK_SIZE));
+        size_t chunkSize = file.getSize() / chunkCount;
+
+        std::vector<ObjChunk> chunks;
+        const char* chunkBegin = data;
+        for (size_t c = 0; c < chunkCount && chunkBegin < dataEnd; c++) {
+
+            const char* chunkEnd = (c == chunkCount - 1) ? dataEnd : std::min(dataEnd, chunkBegin + chunkSize);
+            const char* newline = (const char*)memchr(chunkEnd, '\n', dataEnd - chunkEnd);
+            chunkEnd = newline ? newline + 1 : dataEnd;
+
+            ObjChunk chunk;
+            chunk.begin = chunkBegin;
+            chunk.end = chunkEnd;
+            chunk.unsupported = false;
+            chunks.push_back(chunk);
+
+            chunkBegin = chunkEnd;
+        }
+
+        pool.ParallelFor(chunks.size(), [&chunks](size_t c) { ParseChunk(chunks[c]); });
+
+        for (size_t c = 0; c < chunks.size(); c++) {
+            if (chunks[c].unsupported) {
+                file.Close();
+                return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtl_basepath, triangulate);
+            }
+        }
+
+        // element counts of the preceding chunks
+        std::vector<size_t> vBase(chunks.size() + 1, 0);
+        std::vector<size_t> vtBase(chunks.size() + 1, 0);
+        std::vector<size_t> vnBase(chunks.size() + 1, 0);
+        for (size_t c = 0; c < chunks.size(); c++) {
+            vBase[c + 1] = vBase[c] + chunks[c].v.size();
+            vtBase[c + 1] = vtBase[c] + chunks[c].vt.size();
+            vnBase[c + 1] = vnBase[c] + chunks[c].vn.size();
+        }
+
+        attrib->vertices.resize(vBase[chunks.size()]);
+        attrib->texcoords.resize(vtBase[chunks.size()]);
+        attrib->normals.resize(vnBase[chunks.size()]);
+
+        pool.ParallelFor(chunks.size(), [&](size_t c) {
+
+            ObjChunk& chunk = chunks[c];
+            std::copy(chunk.v.begin(), chunk.v.end(), attrib->vertices.begin() + vBase[c]);
+            std::copy(chunk.vt.begin(), chunk.vt.end(), attrib->texcoords.begin() + vtBase[c]);
+            std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin() + vnBase[c]);
+
+            for (size_t i = 0; i < chunk.relativeFixups.size(); i++) {
+
+                tinyobj::index_t& corner = chunk.corners[chunk.relativeFixups[i] / 3];
+                switch (chunk.relativeFixups[i] % 3) {
+                case 0:
+                    corner.vertex_index += (int)(vBase[c] / 3);
+                    break;
+                case 1:
+                    corner.texcoord_index += (int)(vtBase[c] / 2);
+                    break;
+                default:
+                    corner.normal_index += (int)(vnBase[c] / 3);
+                    break;
+                }
+            }
+
+            std::vector<float>().swap(chunk.v);
+            std::vector<float>().swap(chunk.vt);
+            std::vector<float>().swap(chunk.vn);
+        });
+
+        // replay the statements in file order, exactly like tinyobj::LoadObj does
+        std::string errors;
+        std::string basePath = mtl_basepath ? mtl_basepath : "";
+        tinyobj::MaterialFileReader matFileReader(basePath);
+        std::map<std::string, int> material_map;
+        int material = -1;
+        std::string name;
+        tinyobj::shape_t shape;
+        ObjFaceCursor groupStart = { 0, 0 };
+
+        for (size_t c = 0; c < chunks.size(); c++) {
+
+            for (size_t e = 0; e < chunks[c].events.size(); e++) {
+
+                const ObjEvent& event = chunks[c].events[e];
+                ObjFaceCursor at = { c, event.faceIndex };
+
+                if (event.type == OBJ_EVENT_USEMTL) {
+
+                    int newMaterialId = -1;
+                    std::map<std::string, int>::iterator found = material_map.find(event.name);
+                    if (found != material_map.end()) {
+                        newMaterialId = found->second;
+                    }
+
+                    if (newMaterialId != material) {
+                        ExportFaceGroup(&shape, chunks, groupStart, at, material, name, triangulate);
+                        groupStart = at;
+                        material = newMaterialId;
+                    }
+                }
+                else if (event.type == OBJ_EVENT_MTLLIB) {
+
+                    std::string err_mtl;
+                    matFileReader(event.name, materials, &material_map, &err_mtl);
+                    errors += err_mtl;
+                }
+                else {
+
+                    // group or object - flush previous face group
+                    if (ExportFaceGroup(&shape, chunks, groupStart, at, material, name, triangulate)) {
+                        shapes->push_back(shape);
+                    }
+                    shape = tinyobj::shape_t();
+                    groupStart = at;
+                    name = event.name;
+                }
+            }
+        }
+
+        ObjFaceCursor last = { chunks.size() - 1, chunks.back().faceOffsets.size() - 1 };
+        bool ret = ExportFaceGroup(&shape, chunks, groupStart, last, material, name, triangulate);
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(shape);
+        }
+
+        if (err) {
+            (*err) += errors;
+        }
+
+        return true;
+    }
+
+    // Compares two parse results, returns the largest attribute difference or -1 on a layout mismatch
+    static double CompareObjResults(const tinyobj::attrib_t& a, const std::vector<tinyobj::shape_t>& shapesA,
+        const tinyobj::attrib_t& b, const std::vector<tinyobj::shape_t>& shapesB) {
+
+        if (a.vertices.size() != b.vertices.size() || a.normals.size() != b.normals.size() ||
+            a.texcoords.size() != b.texcoords.size() || shapesA.size() != shapesB.size()) {
+            return -1.0;
+        }
+
+        for (size_t s = 0; s < shapesA.size(); s++) {
+
+            const tinyobj::mesh_t& meshA = shapesA[s].mesh;
+            const tinyobj::mesh_t& meshB = shapesB[s].mesh;
+
+            if (shapesA[s].name != shapesB[s].name ||
+                meshA.indices.size() != meshB.indices.size() ||
+                meshA.num_face_vertices != meshB.num_face_vertices ||
+                meshA.material_ids != meshB.material_ids) {
+                return -1.0;
+            }
+
+            for (size_t i = 0; i < meshA.indices.size(); i++) {
+                if (meshA.indices[i].vertex_index != meshB.indices[i].vertex_index ||
+                    meshA.indices[i].normal_index != meshB.indices[i].normal_index ||
+                    meshA.indices[i].texcoord_index != meshB.indices[i].texcoord_index) {
+                    return -1.0;
+                }
+            }
+        }
+
+        double maxDifference = 0.0;
+        for (size_t i = 0; i < a.vertices.size(); i++) {
+            maxDifference = std::max(maxDifference, (double)fabs(a.vertices[i] - b.vertices[i]));
+        }
+        for (size_t i = 0; i < a.normals.size(); i++) {
+            maxDifference = std::max(maxDifference, (double)fabs(a.normals[i] - b.normals[i]));
+        }
+        for (size_t i = 0; i < a.texcoords.size(); i++) {
+            maxDifference = std::max(maxDifference, (double)fabs(a.texcoords[i] - b.texcoords[i]));
+        }
+
+        return maxDifference;
+    }
+
+    void BenchmarkObjParsers(const std::vector<std::string>& fileNames) {
+
+        const int RUNS = 3;
+
+        std::cout << "OBJ parser benchmark (" << ThreadPool::Shared().getThreadCount() << " worker threads, best of "
+            << RUNS << " runs)" << std::endl;
+        printf("%-48s %12s %12s %9s   %s\n", "file", "tinyobj ms", "parallel ms", "speedup", "result");
+
+        for (size_t f = 0; f < fileNames.size(); f++) {
+
+            std::string basePath = fileNames[f].substr(0, fileNames[f].find_last_of('/') + 1);
+
+            tinyobj::attrib_t attribA, attribB;
+            std::vector<tinyobj::shape_t> shapesA, shapesB;
+            double bestA = 1e30, bestB = 1e30;
+            bool ok = true;
+
+            for (int run = 0; run < RUNS; run++) {
+
+                std::vector<tinyobj::material_t> materials;
+                std::string err;
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                ok = tinyobj::LoadObj(&attribA, &shapesA, &materials, &err, fileNames[f].c_str(), basePath.c_str(), true) && ok;
+                std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+                materials.clear();
+                ok = LoadObjParallel(&attribB, &shapesB, &materials, &err, fileNames[f].c_str(), basePath.c_str(), true) && ok;
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+                bestA = std::min(bestA, std::chrono::duration<double, std::milli>(middle - start).count());
+                bestB = std::min(bestB, std::chrono::duration<double, std::milli>(end - middle).count());
+            }
+
+            char result[64];
+            double difference = CompareObjResults(attribA, shapesA, attribB, shapesB);
+            if (!ok) {
+                snprintf(result, sizeof(result), "load failed");
+            }
+            else if (difference < 0.0) {
+                snprintf(result, sizeof(result), "MISMATCH");
+            }
+            else {
+                snprintf(result, sizeof(result), "identical layout, max float diff %.2e", difference);
+            }
+
+            printf("%-48s %12.2f %12.2f %8.2fx   %s\n", fileNames[f].c_str(), bestA, bestB, bestA / bestB, result);
+        }
+    }
+}
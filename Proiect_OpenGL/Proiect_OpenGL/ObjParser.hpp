@@ -0,0 +1,22 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Drop-in replacement for tinyobj::LoadObj - maps the file, parses line aligned chunks
+    // on the shared thread pool and merges them in file order, so the shapes, usemtl groups
+    // and indices come out exactly as tinyobj would build them
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basepath = NULL, bool triangulate = true);
+
+    // Times LoadObjParallel against tinyobj::LoadObj on each file and checks the results match
+    void BenchmarkObjParsers(const std::vector<std::string>& fileNames);
+}
+
+#endif /* ObjParser_hpp */
@@ -0,0 +1,389 @@
+#include "OcclusionCuller.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GPS_OCCLUSION_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    // Rows a worker fills at once
+    static const int BAND_HEIGHT = 16;
+
+    // Boxes a worker tests at once in Cull
+    static const size_t CULL_CHUNK = 1024;
+
+    // Smallest w kept in front of the camera
+    static const float NEAR_W = 1e-5f;
+
+    OcclusionCuller::OcclusionCuller() : width(0), height(0) {
+
+        resetStats();
+    }
+
+    void OcclusionCuller::Init(int width, int height) {
+
+        this->width = (std::max(width, 4) + 3) & ~3;
+        this->height = std::max(height, 1);
+
+        levels.clear();
+        levelWidths.clear();
+        levelHeights.clear();
+
+        int levelWidth = this->width;
+        int levelHeight = this->height;
+        for (;;) {
+            levels.push_back(std::vector<float>((size_t)levelWidth * levelHeight, 1.0f));
+            levelWidths.push_back(levelWidth);
+            levelHeights.push_back(levelHeight);
+            if (levelWidth == 1 && levelHeight == 1) {
+                break;
+            }
+            levelWidth = (levelWidth + 1) / 2;
+            levelHeight = (levelHeight + 1) / 2;
+        }
+    }
+
+    void OcclusionCuller::Begin() {
+
+        frameStart = std::chrono::steady_clock::now();
+        triangles.clear();
+        for (size_t level = 0; level < levels.size(); level++) {
+            std::fill(levels[level].begin(), levels[level].end(), 1.0f);
+        }
+    }
+
+    void OcclusionCuller::AddOccluder(const glm::vec3* positions, size_t vertexCount, const uint32_t* indices, size_t triangleCount,
+        const glm::mat4& objectToClip) {
+
+        stats.occluderTriangles += triangleCount;
+
+        clipPositions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            clipPositions[i] = objectToClip * glm::vec4(positions[i], 1.0f);
+        }
+
+        for (size_t t = 0; t < triangleCount; t++) {
+
+            glm::vec4 corners[3];
+            int behind = 0;
+            int outside[5] = { 0, 0, 0, 0, 0 };
+            for (int i = 0; i < 3; i++) {
+                const glm::vec4& c = corners[i] = clipPositions[indices[3 * t + i]];
+                behind += c.z < -c.w ? 1 : 0;
+                outside[0] += c.x < -c.w ? 1 : 0;
+                outside[1] += c.x > c.w ? 1 : 0;
+                outside[2] += c.y < -c.w ? 1 : 0;
+                outside[3] += c.y > c.w ? 1 : 0;
+                outside[4] += c.z > c.w ? 1 : 0;
+            }
+            if (behind == 3 || outside[0] == 3 || outside[1] == 3 || outside[2] == 3 || outside[3] == 3 || outside[4] == 3) {
+                continue;
+            }
+            if (behind == 0) {
+                AddTriangle(corners[0], corners[1], corners[2]);
+                continue;
+            }
+
+            // clip against the near plane z = -w, leaving one or two triangles
+            glm::vec4 polygon[4];
+            int polygonSize = 0;
+            for (int i = 0; i < 3; i++) {
+                const glm::vec4& a = corners[i];
+                const glm::vec4& b = corners[(i + 1) % 3];
+                float da = a.z + a.w;
+                float db = b.z + b.w;
+                if (da >= 0.0f) {
+                    polygon[polygonSize++] = a;
+                }
+                if ((da >= 0.0f) != (db >= 0.0f)) {
+                    polygon[polygonSize++] = a + (b - a) * (da / (da - db));
+                }
+            }
+            for (int i = 2; i < polygonSize; i++) {
+                AddTriangle(polygon[0], polygon[i - 1], polygon[i]);
+            }
+        }
+    }
+
+    void OcclusionCuller::AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+
+        if (a.w < NEAR_W || b.w < NEAR_W || c.w < NEAR_W) {
+            return;
+        }
+
+        // pixel centers sit at half integers, depth maps to [0, 1] like glDepthRange(0, 1)
+        glm::vec3 p[3];
+        const glm::vec4* clip[3] = { &a, &b, &c };
+        for (int i = 0; i < 3; i++) {
+            float inverseW = 1.0f / clip[i]->w;
+            p[i] = glm::vec3((clip[i]->x * inverseW * 0.5f + 0.5f) * width,
+                (clip[i]->y * inverseW * 0.5f + 0.5f) * height,
+                clip[i]->z * inverseW * 0.5f + 0.5f);
+        }
+
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (std::fabs(area) < 1e-8f) {
+            return;
+        }
+        // no backface culling, occluders may be open surfaces
+        if (area < 0.0f) {
+            std::swap(p[1], p[2]);
+            area = -area;
+        }
+
+        ScreenTriangle triangle;
+        float minX = std::min(p[0].x, std::min(p[1].x, p[2].x));
+        float maxX = std::max(p[0].x, std::max(p[1].x, p[2].x));
+        float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+        float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+        // pixels whose centers fall in the bounds, clamped before the conversion so huge triangles do not overflow
+        triangle.minX = (int)std::ceil(std::max(minX - 0.5f, 0.0f));
+        triangle.maxX = (int)std::floor(std::min(maxX - 0.5f, (float)(width - 1)));
+        triangle.minY = (int)std::ceil(std::max(minY - 0.5f, 0.0f));
+        triangle.maxY = (int)std::floor(std::min(maxY - 0.5f, (float)(height - 1)));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+            return;
+        }
+
+        // edge i goes from p[i] to p[i + 1], the inside is where all three are positive
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& from = p[i];
+            const glm::vec3& to = p[(i + 1) % 3];
+            triangle.edgeA[i] = from.y - to.y;
+            triangle.edgeB[i] = to.x - from.x;
+            triangle.edgeC[i] = from.x * to.y - from.y * to.x;
+        }
+
+        glm::vec3 d1 = p[1] - p[0];
+        glm::vec3 d2 = p[2] - p[0];
+        triangle.depthA = (d1.z * d2.y - d2.z * d1.y) / area;
+        triangle.depthB = (d2.z * d1.x - d1.z * d2.x) / area;
+        // the farthest depth over the pixel rather than at its center, capped by the farthest corner,
+        // so a covered pixel never claims more occlusion than the triangle gives
+        triangle.depthC = p[0].z - triangle.depthA * p[0].x - triangle.depthB * p[0].y
+            + 0.5f * (std::fabs(triangle.depthA) + std::fabs(triangle.depthB));
+        triangle.maxDepth = std::max(p[0].z, std::max(p[1].z, p[2].z));
+
+        triangles.push_back(triangle);
+    }
+
+    void OcclusionCuller::Finish() {
+
+        if (levels.empty()) {
+            return;
+        }
+
+        int bandCount = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        ThreadPool::Shared().ParallelFor((size_t)bandCount, [this](size_t band) {
+            int firstRow = (int)band * BAND_HEIGHT;
+            RasterizeBand(firstRow, std::min(firstRow + BAND_HEIGHT, height) - 1);
+        });
+        BuildPyramid();
+
+        stats.frames++;
+        stats.rasterizedTriangles += triangles.size();
+        stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    }
+
+    void OcclusionCuller::RasterizeBand(int firstRow, int lastRow) {
+
+        float* depth = &levels[0][0];
+
+        for (size_t t = 0; t < triangles.size(); t++) {
+
+            const ScreenTriangle& triangle = triangles[t];
+            int rowStart = std::max(triangle.minY, firstRow);
+            int rowEnd = std::min(triangle.maxY, lastRow);
+            // rows start on a multiple of 4, the width is one too
+            int columnStart = triangle.minX & ~3;
+
+            for (int y = rowStart; y <= rowEnd; y++) {
+
+                float centerY = y + 0.5f;
+                float* row = depth + (size_t)y * width;
+
+#if defined (GPS_OCCLUSION_SSE2)
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 a0 = _mm_set1_ps(triangle.edgeA[0]), a1 = _mm_set1_ps(triangle.edgeA[1]), a2 = _mm_set1_ps(triangle.edgeA[2]);
+                __m128 row0 = _mm_set1_ps(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+                __m128 row1 = _mm_set1_ps(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+                __m128 row2 = _mm_set1_ps(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+                __m128 depthA = _mm_set1_ps(triangle.depthA);
+                __m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+                __m128 maxDepth = _mm_set1_ps(triangle.maxDepth);
+
+                for (int x = columnStart; x <= triangle.maxX; x += 4) {
+
+                    __m128 centerX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+                    __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, centerX), row0);
+                    __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, centerX), row1);
+                    __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, centerX), row2);
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+                    if (_mm_movemask_ps(inside) == 0) {
+                        continue;
+                    }
+
+                    __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow), maxDepth);
+                    __m128 stored = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_min_ps(stored, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+                }
+#else
+                float row0 = triangle.edgeB[0] * centerY + triangle.edgeC[0];
+                float row1 = triangle.edgeB[1] * centerY + triangle.edgeC[1];
+                float row2 = triangle.edgeB[2] * centerY + triangle.edgeC[2];
+                float depthRow = triangle.depthB * centerY + triangle.depthC;
+
+                for (int x = columnStart; x <= triangle.maxX; x++) {
+
+                    float centerX = x + 0.5f;
+                    if (triangle.edgeA[0] * centerX + row0 < 0.0f || triangle.edgeA[1] * centerX + row1 < 0.0f || triangle.edgeA[2] * centerX + row2 < 0.0f) {
+                        continue;
+                    }
+                    float z = std::min(triangle.depthA * centerX + depthRow, triangle.maxDepth);
+                    row[x] = std::min(row[x], z);
+                }
+#endif
+            }
+        }
+    }
+
+    void OcclusionCuller::BuildPyramid() {
+
+        for (size_t level = 1; level < levels.size(); level++) {
+
+            const std::vector<float>& source = levels[level - 1];
+            std::vector<float>& target = levels[level];
+            int sourceWidth = levelWidths[level - 1];
+            int sourceHeight = levelHeights[level - 1];
+
+            for (int y = 0; y < levelHeights[level]; y++) {
+                int y0 = 2 * y;
+                int y1 = std::min(y0 + 1, sourceHeight - 1);
+                for (int x = 0; x < levelWidths[level]; x++) {
+                    int x0 = 2 * x;
+                    int x1 = std::min(x0 + 1, sourceWidth - 1);
+                    target[(size_t)y * levelWidths[level] + x] = std::max(
+                        std::max(source[(size_t)y0 * sourceWidth + x0], source[(size_t)y0 * sourceWidth + x1]),
+                        std::max(source[(size_t)y1 * sourceWidth + x0], source[(size_t)y1 * sourceWidth + x1]));
+                }
+            }
+        }
+    }
+
+    bool OcclusionCuller::IsVisible(const BoundingBox& box, const glm::mat4& objectToClip) const {
+
+        if (levels.empty()) {
+            return true;
+        }
+
+        glm::vec3 minimum(FLT_MAX);
+        glm::vec3 maximum(-FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = objectToClip * glm::vec4(corner, 1.0f);
+            if (clip.w < NEAR_W || clip.z < -clip.w) {
+                return true;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            minimum = glm::min(minimum, ndc);
+            maximum = glm::max(maximum, ndc);
+        }
+        // whatever the frustum test let through there
+        if (maximum.x < -1.0f || minimum.x > 1.0f || maximum.y < -1.0f || minimum.y > 1.0f || minimum.z > 1.0f) {
+            return true;
+        }
+
+        // one texel of margin: a texel counts as covered when its center is, so the box may show
+        // through the rest of a texel along an occluder silhouette
+        float nearest = minimum.z * 0.5f + 0.5f;
+        int x0 = (int)std::floor(std::max((minimum.x * 0.5f + 0.5f) * width, 0.0f)) - 1;
+        int x1 = (int)std::floor(std::min((maximum.x * 0.5f + 0.5f) * width, (float)width)) + 1;
+        int y0 = (int)std::floor(std::max((minimum.y * 0.5f + 0.5f) * height, 0.0f)) - 1;
+        int y1 = (int)std::floor(std::min((maximum.y * 0.5f + 0.5f) * height, (float)height)) + 1;
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, width - 1);
+        y1 = std::min(y1, height - 1);
+
+        // the level where the rectangle spans at most 4x4 texels
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+            level++;
+        }
+
+        const std::vector<float>& depth = levels[level];
+        int levelWidth = levelWidths[level];
+        for (int y = y0 >> level; y <= (y1 >> level); y++) {
+            for (int x = x0 >> level; x <= (x1 >> level); x++) {
+                if (nearest <= depth[(size_t)y * levelWidth + x]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t OcclusionCuller::Cull(const BoundingBox* boxes, size_t count, const glm::mat4& objectToClip, uint8_t* visible) const {
+
+        size_t chunkCount = (count + CULL_CHUNK - 1) / CULL_CHUNK;
+        std::vector<size_t> hidden(chunkCount, 0);
+
+        auto cullChunk = [&](size_t chunk) {
+            size_t end = std::min(count, (chunk + 1) * CULL_CHUNK);
+            for (size_t i = chunk * CULL_CHUNK; i < end; i++) {
+                if (visible[i] && !IsVisible(boxes[i], objectToClip)) {
+                    visible[i] = 0;
+                    hidden[chunk]++;
+                }
+            }
+        };
+
+        if (chunkCount > 1) {
+            ThreadPool::Shared().ParallelFor(chunkCount, cullChunk);
+        } else if (chunkCount == 1) {
+            cullChunk(0);
+        }
+
+        size_t total = 0;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+            total += hidden[chunk];
+        }
+        return total;
+    }
+
+    int OcclusionCuller::getWidth() const {
+
+        return width;
+    }
+
+    int OcclusionCuller::getHeight() const {
+
+        return height;
+    }
+
+    float OcclusionCuller::getDepth(int x, int y) const {
+
+        return levels.empty() ? 1.0f : levels[0][(size_t)y * width + x];
+    }
+
+    const OcclusionStats& OcclusionCuller::getStats() const {
+
+        return stats;
+    }
+
+    void OcclusionCuller::resetStats() {
+
+        stats.frames = 0;
+        stats.occluderTriangles = 0;
+        stats.rasterizedTriangles = 0;
+        stats.milliseconds = 0.0;
+    }
+}
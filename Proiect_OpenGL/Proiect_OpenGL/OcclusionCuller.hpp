@@ -0,0 +1,99 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include <glm/glm.hpp>
+
+#include "Bounds.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    struct OcclusionStats {
+
+        uint64_t frames;
+        uint64_t occluderTriangles;
+        uint64_t rasterizedTriangles;
+        double milliseconds;
+    };
+
+    class OcclusionCuller;
+
+    // Boxes in object space tested against a culler, objectToClip = projection * view * model
+    struct OcclusionTest {
+
+        const OcclusionCuller* culler;
+        glm::mat4 objectToClip;
+    };
+
+    // Software occlusion culling. Occluder triangles are rasterized on the CPU into a small depth
+    // buffer, split into bands that the shared thread pool fills in parallel, four pixels at a time
+    // with SSE2. A pyramid of the farthest depth under each texel then rejects a box in a few reads:
+    // the box is hidden when its nearest point is behind every occluder over its screen rectangle.
+    // Nothing is read back from the GPU.
+    class OcclusionCuller {
+
+    public:
+        OcclusionCuller();
+
+        // Sizes the depth buffer, the width is rounded up to a multiple of 4
+        void Init(int width, int height);
+
+        // Clears the depth buffer and drops the occluders of the previous frame
+        void Begin();
+
+        // Queues the triangles of an occluder, three indices into its vertexCount positions each
+        void AddOccluder(const glm::vec3* positions, size_t vertexCount, const uint32_t* triangles, size_t triangleCount,
+            const glm::mat4& objectToClip);
+
+        // Rasterizes the queued occluders and builds the depth pyramid
+        void Finish();
+
+        // False if the box is behind the occluders; boxes off screen or through the near plane count as visible
+        bool IsVisible(const BoundingBox& box, const glm::mat4& objectToClip) const;
+
+        // Clears visible[i] for the boxes that have it set and are hidden, returns how many were;
+        // long lists are split over the thread pool
+        size_t Cull(const BoundingBox* boxes, size_t count, const glm::mat4& objectToClip, uint8_t* visible) const;
+
+        int getWidth() const;
+        int getHeight() const;
+
+        // Depth in [0, 1] at a texel of the buffer, 1 where nothing was drawn
+        float getDepth(int x, int y) const;
+
+        const OcclusionStats& getStats() const;
+        void resetStats();
+
+    private:
+        // Screen space triangle with its edge and depth planes, f(x, y) = a * x + b * y + c
+        struct ScreenTriangle {
+
+            float edgeA[3], edgeB[3], edgeC[3];
+            float depthA, depthB, depthC;
+            float maxDepth;
+            int minX, maxX, minY, maxY;
+        };
+
+        int width;
+        int height;
+        std::vector<ScreenTriangle> triangles;
+        // the positions of the occluder being added, transformed once
+        std::vector<glm::vec4> clipPositions;
+        // level 0 is the depth buffer, each next level holds the farthest depth of 2x2 texels
+        std::vector<std::vector<float> > levels;
+        std::vector<int> levelWidths;
+        std::vector<int> levelHeights;
+        OcclusionStats stats;
+        std::chrono::steady_clock::time_point frameStart;
+
+        void AddTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        void RasterizeBand(int firstRow, int lastRow);
+        void BuildPyramid();
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
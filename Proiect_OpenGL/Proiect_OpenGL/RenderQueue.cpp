@@ -0,0 +1,435 @@
+#include "RenderQueue.hpp"
+#include "InstanceBuffer.hpp"
+#include "GeometryArena.hpp"
+#include "GLInterceptor.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+    // Sort key layout, most significant first: pass | program | texture set | VAO
+    static const int KEY_PASS_SHIFT = 60;
+    static const int KEY_PROGRAM_SHIFT = 52;
+    static const int KEY_TEXTURE_SET_SHIFT = 32;
+    static const int KEY_VAO_SHIFT = 12;
+    static const uint64_t KEY_PROGRAM_MASK = 0xFF;
+    static const uint64_t KEY_TEXTURE_SET_MASK = 0xFFFFF;
+    static const uint64_t KEY_VAO_MASK = 0xFFFFF;
+
+    // Texture unit of the per-draw transforms of indirect draws, above the units of any mesh texture set
+    static const GLuint DRAW_TRANSFORM_UNIT = 5;
+    // Texels per transform in the texture buffer: model matrix columns, then normal matrix columns
+    static const size_t TEXELS_PER_TRANSFORM = 7;
+
+    RenderQueue::RenderQueue() : indirectEnabled(false), transformsUploaded(false), maxIndirectTransforms(0),
+        commandBuffer(0), transformBuffer(0), transformTexture(0) {
+
+        resetStats();
+    }
+
+    RenderQueue::~RenderQueue() {
+
+        if (commandBuffer != 0) {
+            glDeleteBuffers(1, &commandBuffer);
+            glDeleteBuffers(1, &transformBuffer);
+            glDeleteTextures(1, &transformTexture);
+            GLInterceptor::Current().NoteDeleteTextures(1, &transformTexture);
+        }
+    }
+
+    bool RenderQueue::IndirectSupported() {
+
+#if defined (__APPLE__)
+        return false;
+#else
+        return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+#endif
+    }
+
+    void RenderQueue::SetIndirectEnabled(bool enabled) {
+
+        indirectEnabled = enabled && IndirectSupported();
+    }
+
+    bool RenderQueue::isIndirectEnabled() const {
+
+        return indirectEnabled;
+    }
+
+    void RenderQueue::Clear() {
+
+        packets.clear();
+        sorted.clear();
+        transforms.clear();
+        transformsUploaded = false;
+        programs.clear();
+        programIndirect.clear();
+        textureSets.clear();
+        textureSetIds.clear();
+
+        // texture set 0 binds nothing
+        textureSets.push_back(TextureSet());
+        textureSetIds[std::string()] = 0;
+    }
+
+    uint32_t RenderQueue::AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix) {
+
+        DrawTransform transform;
+        transform.model = model;
+        transform.normalMatrix = normalMatrix;
+        transforms.push_back(transform);
+        transformsUploaded = false;
+        return (uint32_t)transforms.size() - 1;
+    }
+
+    uint32_t RenderQueue::InternProgram(const gps::Shader& shader) {
+
+        for (size_t i = 0; i < programs.size(); i++) {
+            if (programs[i].shaderProgram == shader.shaderProgram) {
+                return (uint32_t)i;
+            }
+        }
+
+        programs.push_back(shader);
+        programIndirect.push_back(shader.getUniform("indirectDraw") >= 0 && shader.getUniform("drawTransforms") >= 0);
+        return (uint32_t)programs.size() - 1;
+    }
+
+    uint32_t RenderQueue::InternTextureSet(const gps::Shader& shader, const std::vector<Texture>& textures) {
+
+        // meshes sharing the same textures on the same samplers share a set; textures the
+        // program never samples (e.g. in the depth pass) are left out altogether
+        TextureSet set;
+        std::string signature;
+
+        for (size_t i = 0; i < textures.size(); i++) {
+
+            if (shader.getUniform(textures[i].type.c_str()) < 0) {
+                continue;
+            }
+
+            set.textures.push_back(textures[i].id);
+            set.samplers.push_back(textures[i].type);
+
+            char id[16];
+            snprintf(id, sizeof(id), ":%u;", textures[i].id);
+            signature += textures[i].type;
+            signature += id;
+        }
+
+        std::map<std::string, uint32_t>::iterator found = textureSetIds.find(signature);
+        if (found != textureSetIds.end()) {
+            return found->second;
+        }
+
+        textureSets.push_back(set);
+        uint32_t index = (uint32_t)textureSets.size() - 1;
+        textureSetIds[signature] = index;
+        return index;
+    }
+
+    void RenderQueue::Push(RenderPass pass, const gps::Shader& shader, const gps::Mesh& mesh, uint32_t transform, uint32_t lod) {
+
+        DrawPacket packet;
+        packet.program = InternProgram(shader);
+        packet.textureSet = InternTextureSet(shader, mesh.textures);
+        packet.vao = mesh.getBuffers().VAO;
+        packet.range = mesh.getLodRange(lod);
+        packet.transform = transform;
+        packet.instances = NULL;
+        packet.firstInstance = 0;
+        packet.instanceCount = 1;
+        // only arena VAOs carry the draw index attribute
+        packet.indirect = !mesh.ownsBuffers() && transform < MAX_INDIRECT_DRAWS;
+
+        PushPacket(pass, packet, mesh.textures.size());
+    }
+
+    void RenderQueue::PushInstanced(RenderPass pass, const gps::Shader& shader, const gps::Mesh& mesh, uint32_t transform,
+        GLuint vao, const InstanceBuffer& instances, GLuint firstInstance, GLsizei instanceCount, uint32_t lod) {
+
+        DrawPacket packet;
+        packet.program = InternProgram(shader);
+        packet.textureSet = InternTextureSet(shader, mesh.textures);
+        packet.vao = vao;
+        packet.range = mesh.getLodRange(lod);
+        packet.transform = transform;
+        packet.instances = &instances;
+        packet.firstInstance = firstInstance;
+        packet.instanceCount = instanceCount;
+        packet.indirect = false;
+
+        PushPacket(pass, packet, mesh.textures.size());
+    }
+
+    void RenderQueue::PushPacket(RenderPass pass, const DrawPacket& packet, size_t textureCount) {
+
+        SortItem item;
+        item.key = ((uint64_t)pass << KEY_PASS_SHIFT) |
+            (((uint64_t)packet.program & KEY_PROGRAM_MASK) << KEY_PROGRAM_SHIFT) |
+            (((uint64_t)packet.textureSet & KEY_TEXTURE_SET_MASK) << KEY_TEXTURE_SET_SHIFT) |
+            (((uint64_t)packet.vao & KEY_VAO_MASK) << KEY_VAO_SHIFT);
+        item.packet = (uint32_t)packets.size();
+
+        packets.push_back(packet);
+        sorted.push_back(item);
+
+        // what drawing mesh by mesh used to issue: program, bind + unbind per texture, bind + unbind of the VAO,
+        // once per copy
+        stats.directBinds += (1 + 2 * textureCount + 2) * packet.instanceCount;
+    }
+
+    // LSD radix sort on the key bytes, skipping bytes all keys share; stable, so packets
+    // with equal keys keep their submission order
+    void RenderQueue::Sort() {
+
+        scratch.resize(sorted.size());
+
+        for (int shift = 0; shift < 64; shift += 8) {
+
+            size_t counts[256];
+            memset(counts, 0, sizeof(counts));
+            for (size_t i = 0; i < sorted.size(); i++) {
+                counts[(sorted[i].key >> shift) & 0xFF]++;
+            }
+
+            if (sorted.empty() || counts[(sorted[0].key >> shift) & 0xFF] == sorted.size()) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (int b = 0; b < 256; b++) {
+                size_t count = counts[b];
+                counts[b] = offset;
+                offset += count;
+            }
+
+            for (size_t i = 0; i < sorted.size(); i++) {
+                scratch[counts[(sorted[i].key >> shift) & 0xFF]++] = sorted[i];
+            }
+            sorted.swap(scratch);
+        }
+    }
+
+    void RenderQueue::BuildBatches(RenderPass pass) {
+
+        batches.clear();
+        commands.clear();
+
+        // a texture buffer is only guaranteed to address 65536 texels; draws whose transform lies past
+        // the limit of the driver are left out of the batches and drawn one by one
+        if (maxIndirectTransforms == 0) {
+            GLint maxTexels = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+            maxIndirectTransforms = (uint32_t)(std::max(maxTexels, (GLint)65536) / TEXELS_PER_TRANSFORM);
+        }
+
+        // the packets of a pass are contiguous in sorted order, so a batch is a run of equal keys
+        bool open = false;
+        for (size_t i = 0; i < sorted.size(); i++) {
+
+            if ((sorted[i].key >> KEY_PASS_SHIFT) != (uint64_t)pass) {
+                continue;
+            }
+
+            const DrawPacket& packet = packets[sorted[i].packet];
+            if (!packet.indirect || !programIndirect[packet.program] || packet.transform >= maxIndirectTransforms) {
+                open = false;
+                continue;
+            }
+
+            if (!open || sorted[batches.back().last].key != sorted[i].key) {
+                IndirectBatch batch;
+                batch.first = i;
+                batch.firstCommand = commands.size();
+                batch.count = 0;
+                batches.push_back(batch);
+                open = true;
+            }
+
+            DrawElementsIndirectCommand command;
+            command.count = (GLuint)packet.range.indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = packet.range.firstIndex;
+            command.baseVertex = packet.range.baseVertex;
+            command.baseInstance = packet.transform;
+            commands.push_back(command);
+
+            batches.back().last = i;
+            batches.back().count++;
+        }
+
+        if (commands.empty()) {
+            return;
+        }
+
+        if (commandBuffer == 0) {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &transformBuffer);
+            glGenTextures(1, &transformTexture);
+        }
+
+        // stays bound for the draws, the binding is not part of the VAO
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+    }
+
+    void RenderQueue::UploadTransforms(GLState& state) {
+
+        size_t count = std::min(transforms.size(), (size_t)maxIndirectTransforms);
+        transformTexels.resize(count * TEXELS_PER_TRANSFORM);
+        for (size_t i = 0; i < count; i++) {
+
+            glm::vec4* texels = &transformTexels[i * TEXELS_PER_TRANSFORM];
+            for (int column = 0; column < 4; column++) {
+                texels[column] = transforms[i].model[column];
+            }
+            for (int column = 0; column < 3; column++) {
+                texels[4 + column] = glm::vec4(transforms[i].normalMatrix[column], 0.0f);
+            }
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, transformBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, transformTexels.size() * sizeof(glm::vec4), transformTexels.data(), GL_STREAM_DRAW);
+
+        // the texture keeps pointing at the buffer when its storage is replaced
+        state.BindTexture(DRAW_TRANSFORM_UNIT, GL_TEXTURE_BUFFER, transformTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transformBuffer);
+
+        transformsUploaded = true;
+    }
+
+    void RenderQueue::Submit(RenderPass pass, GLState& state) {
+
+        // the commands of every batch in the pass go to GL in one upload
+        batches.clear();
+        if (indirectEnabled) {
+            BuildBatches(pass);
+            if (!batches.empty() && !transformsUploaded) {
+                UploadTransforms(state);
+            }
+        }
+
+        // the queue skips what it knows did not change between packets, the tracker
+        // what is still bound from before the pass
+        uint32_t currentProgram = UINT32_MAX;
+        uint32_t currentTextureSet = UINT32_MAX;
+        uint32_t currentTransform = UINT32_MAX;
+        GLuint currentVao = 0;
+        bool vaoKnown = false;
+        size_t boundUnits = 0;
+        int currentIndirect = -1;
+        size_t nextBatch = 0;
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+
+            if ((sorted[i].key >> KEY_PASS_SHIFT) != (uint64_t)pass) {
+                continue;
+            }
+
+            const DrawPacket& packet = packets[sorted[i].packet];
+            gps::Shader& shader = programs[packet.program];
+            stats.packets++;
+
+            if (packet.program != currentProgram) {
+                state.UseProgram(shader.shaderProgram);
+                stats.programBinds++;
+                currentProgram = packet.program;
+                currentTextureSet = UINT32_MAX;
+                currentTransform = UINT32_MAX;
+                currentIndirect = -1;
+
+                // left on unit 0 the buffer sampler would clash with the 2D ones even when unused
+                if (programIndirect[packet.program]) {
+                    shader.set("drawTransforms", (GLint)DRAW_TRANSFORM_UNIT);
+                }
+            }
+
+            if (packet.textureSet != currentTextureSet) {
+
+                const TextureSet& set = textureSets[packet.textureSet];
+                for (size_t unit = 0; unit < set.textures.size(); unit++) {
+                    shader.set(set.samplers[unit].c_str(), (GLint)unit);
+                }
+
+                // units the previous set used and this one does not are cleared by the tracker
+                if (!set.textures.empty() || boundUnits > 0) {
+                    state.BindTextureSet(set.textures.data(), (GLuint)set.textures.size());
+                    stats.textureBinds += std::max(set.textures.size(), boundUnits);
+                }
+
+                boundUnits = set.textures.size();
+                currentTextureSet = packet.textureSet;
+            }
+
+            if (!vaoKnown || packet.vao != currentVao) {
+                state.BindVertexArray(packet.vao);
+                stats.vaoBinds++;
+                currentVao = packet.vao;
+                vaoKnown = true;
+            }
+
+            bool batched = nextBatch < batches.size() && batches[nextBatch].first == i;
+            if (programIndirect[packet.program] && currentIndirect != (batched ? 1 : 0)) {
+                currentIndirect = batched ? 1 : 0;
+                shader.set("indirectDraw", (GLint)currentIndirect);
+                if (batched) {
+                    state.BindTexture(DRAW_TRANSFORM_UNIT, GL_TEXTURE_BUFFER, transformTexture);
+                }
+            }
+
+            if (batched) {
+                const IndirectBatch& batch = batches[nextBatch++];
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                    (GLvoid*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand)), batch.count, 0);
+
+                // the packets the batch covered
+                stats.packets += batch.count - 1;
+                stats.draws++;
+                stats.passDraws[pass]++;
+                stats.multiDraws++;
+                stats.indirectCommands += batch.count;
+                stats.instances += batch.count;
+                for (size_t covered = i; covered <= batch.last; covered++) {
+                    stats.triangles += packets[sorted[covered].packet].range.indexCount / 3;
+                }
+                i = batch.last;
+                continue;
+            }
+
+            if (packet.transform != currentTransform) {
+                const DrawTransform& transform = transforms[packet.transform];
+                shader.set("model", transform.model);
+                shader.set("normalMatrix", transform.normalMatrix);
+                currentTransform = packet.transform;
+            }
+
+            if (packet.instances != NULL) {
+                packet.instances->BindInstances(packet.firstInstance);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.range.indexCount, GL_UNSIGNED_INT,
+                    (GLvoid*)(packet.range.firstIndex * sizeof(GLuint)), packet.instanceCount, packet.range.baseVertex);
+            }
+            else {
+                glDrawElementsBaseVertex(GL_TRIANGLES, packet.range.indexCount, GL_UNSIGNED_INT,
+                    (GLvoid*)(packet.range.firstIndex * sizeof(GLuint)), packet.range.baseVertex);
+            }
+            stats.draws++;
+            stats.instances += packet.instanceCount;
+            stats.triangles += (uint64_t)(packet.range.indexCount / 3) * packet.instanceCount;
+            stats.passDraws[pass]++;
+        }
+
+    }
+
+    const RenderQueueStats& RenderQueue::getStats() const {
+
+        return stats;
+    }
+
+    void RenderQueue::resetStats() {
+
+        memset(&stats, 0, sizeof(stats));
+    }
+}
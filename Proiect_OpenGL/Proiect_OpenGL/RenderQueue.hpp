@@ -0,0 +1,181 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "GLState.hpp"
+#include "Mesh.hpp"
+#include "Shader.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    class InstanceBuffer;
+
+    // Passes in submission order - the pass is the most significant part of a sort key.
+    // The static and dynamic layers of shadow cascade i are drawn in PASS_SHADOW + i and
+    // PASS_SHADOW_DYNAMIC + i.
+    enum RenderPass {
+
+        PASS_SHADOW = 0,
+        PASS_SHADOW_DYNAMIC = 4,
+        PASS_MAIN = 8,
+        PASS_COUNT = 9
+    };
+
+    // Bind and draw calls requested by Submit, next to what drawing each mesh directly would cost
+    struct RenderQueueStats {
+
+        uint64_t packets;
+        uint64_t draws;
+        uint64_t passDraws[PASS_COUNT];
+        uint64_t triangles;
+        uint64_t instances;
+        uint64_t multiDraws;
+        uint64_t indirectCommands;
+        uint64_t programBinds;
+        uint64_t textureBinds;
+        uint64_t vaoBinds;
+        uint64_t directBinds;
+    };
+
+    // Per object uniforms shared by all the meshes of a model
+    struct DrawTransform {
+
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+    };
+
+    // Collects the draws of a frame as packets keyed by (pass, program, texture set, VAO),
+    // radix sorts them and submits each pass issuing state changes only where the key changes.
+    // With indirect drawing on, each run of packets sharing a key becomes one glMultiDrawElementsIndirect
+    // whose draws read their transforms from a texture buffer; programs opt in by declaring the
+    // indirectDraw and drawTransforms uniforms of basic.vert.
+    class RenderQueue {
+
+    public:
+        RenderQueue();
+        ~RenderQueue();
+
+        // Multi-draw indirect with base instances needs GL 4.3 or the matching extensions
+        static bool IndirectSupported();
+
+        // Off by default; has no effect where IndirectSupported is false
+        void SetIndirectEnabled(bool enabled);
+        bool isIndirectEnabled() const;
+
+        // Drops the packets of the previous frame
+        void Clear();
+
+        // Returns the index to pass to Push for the meshes drawn with this transform
+        uint32_t AddTransform(const glm::mat4& model, const glm::mat3& normalMatrix);
+
+        // lod picks one of the levels of detail of the mesh, 0 is the full mesh
+        void Push(RenderPass pass, const gps::Shader& shader, const gps::Mesh& mesh, uint32_t transform, uint32_t lod = 0);
+
+        // Draws instanceCount copies of the mesh through vao, a VAO of instances reading the mesh buffers;
+        // the copies start at firstInstance of the instance buffer
+        void PushInstanced(RenderPass pass, const gps::Shader& shader, const gps::Mesh& mesh, uint32_t transform,
+            GLuint vao, const InstanceBuffer& instances, GLuint firstInstance, GLsizei instanceCount, uint32_t lod = 0);
+
+        void Sort();
+
+        // Draws the packets of one pass; the framebuffer and viewport are up to the caller
+        void Submit(RenderPass pass, GLState& state = GLState::Current());
+
+        const RenderQueueStats& getStats() const;
+        void resetStats();
+
+    private:
+        struct DrawPacket {
+
+            uint32_t program;       // index into programs
+            uint32_t textureSet;    // index into textureSets
+            GLuint vao;
+            GeometryRange range;
+            uint32_t transform;
+            const InstanceBuffer* instances;    // NULL for a single draw
+            GLuint firstInstance;
+            GLsizei instanceCount;
+            bool indirect;                      // can be part of a multi-draw
+        };
+
+        // Layout glMultiDrawElementsIndirect reads
+        struct DrawElementsIndirectCommand {
+
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        // Sorted packets first .. last of a pass drawn by commands firstCommand .. firstCommand + count - 1
+        struct IndirectBatch {
+
+            size_t first;
+            size_t last;
+            size_t firstCommand;
+            GLsizei count;
+        };
+
+        struct SortItem {
+
+            uint64_t key;
+            uint32_t packet;
+        };
+
+        // Texture units 0..n-1 and the sampler uniform that reads each of them
+        struct TextureSet {
+
+            std::vector<GLuint> textures;
+            std::vector<std::string> samplers;
+        };
+
+        std::vector<DrawPacket> packets;
+        std::vector<SortItem> sorted;
+        std::vector<SortItem> scratch;
+        std::vector<DrawTransform> transforms;
+        std::vector<gps::Shader> programs;
+        std::vector<bool> programIndirect;
+        std::vector<TextureSet> textureSets;
+        std::map<std::string, uint32_t> textureSetIds;
+        RenderQueueStats stats;
+
+        bool indirectEnabled;
+        bool transformsUploaded;
+        uint32_t maxIndirectTransforms;     // transforms the texture buffer can address, 0 until queried
+        std::vector<IndirectBatch> batches;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<glm::vec4> transformTexels;
+        GLuint commandBuffer;
+        GLuint transformBuffer;
+        GLuint transformTexture;
+
+        // Groups the packets of a pass into batches and uploads their commands
+        void BuildBatches(RenderPass pass);
+        void UploadTransforms(GLState& state);
+
+        uint32_t InternProgram(const gps::Shader& shader);
+        uint32_t InternTextureSet(const gps::Shader& shader, const std::vector<Texture>& textures);
+        void PushPacket(RenderPass pass, const DrawPacket& packet, size_t textureCount);
+
+        // holds GL objects
+        RenderQueue(const RenderQueue&);
+        RenderQueue& operator=(const RenderQueue&);
+    };
+}
+
+#endif /* RenderQueue_hpp */
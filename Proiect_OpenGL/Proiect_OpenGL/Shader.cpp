@@ -7,8 +7,195 @@
 //
 
 #include "Shader.hpp"
+#include "CpuProfiler.hpp"
+#include "GLState.hpp"
+#include "LoadTelemetry.hpp"
+#include "MeshCache.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
 
 namespace gps {
+    
+    // Location and last uploaded value of an active uniform
+    struct UniformSlot {
+        
+        std::string name;
+        GLint location;
+        GLenum type;
+        bool hasValue;
+        unsigned char value[sizeof(glm::mat4)];
+    };
+    
+    // Active uniforms of a program in a flat, open addressed hash table
+    struct UniformTable {
+        
+        std::vector<UniformSlot> slots;
+        std::vector<GLint> buckets;     // slot index, -1 when empty; the size is a power of two
+    };
+    
+    static UniformStats uniformStats = { 0, 0 };
+    
+    static const char PROGRAM_BINARY_MAGIC[8] = { 'G', 'P', 'S', 'P', 'R', 'O', 'G', '\0' };
+    static const uint32_t PROGRAM_BINARY_VERSION = 1;
+    
+    // Start of a .gpsprog file, followed by binaryLength bytes from glGetProgramBinary
+    struct ProgramBinaryHeader {
+        
+        char magic[8];
+        uint32_t version;
+        uint32_t binaryFormat;
+        uint64_t key;
+        uint64_t binaryLength;
+    };
+    
+    static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    static uint64_t HashString(uint64_t hash, const std::string& text) {
+        
+        for (size_t i = 0; i < text.size(); i++) {
+            hash = (hash ^ (unsigned char)text[i]) * 1099511628211ull;
+        }
+        // separator, so "ab" + "c" and "a" + "bc" differ
+        return (hash ^ 0xFF) * 1099511628211ull;
+    }
+    
+    static std::string DriverString(GLenum name) {
+        
+        const GLubyte* value = glGetString(name);
+        return value ? std::string((const char*)value) : std::string();
+    }
+    
+    // A binary is only valid for the same sources on the same driver build
+    static uint64_t ProgramBinaryKey(const std::string& vertexSource, const std::string& fragmentSource) {
+        
+        uint64_t hash = 14695981039346656037ull;
+        hash = HashString(hash, vertexSource);
+        hash = HashString(hash, fragmentSource);
+        hash = HashString(hash, DriverString(GL_VENDOR));
+        hash = HashString(hash, DriverString(GL_RENDERER));
+        hash = HashString(hash, DriverString(GL_VERSION));
+        return hash;
+    }
+    
+    // File name without its directory and extension
+    static std::string FileStem(const std::string& fileName) {
+        
+        size_t slash = fileName.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? fileName : fileName.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+    
+    // shaders/basic.vert + shaders/basic.frag -> shaders/basic.gpsprog,
+    // shaders/instanced.vert + shaders/basic.frag -> shaders/instanced+basic.gpsprog
+    static std::string ProgramBinaryPathFor(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName) {
+        
+        std::string vertexStem = FileStem(vertexShaderFileName);
+        std::string fragmentStem = FileStem(fragmentShaderFileName);
+        if (vertexStem == fragmentStem) {
+            return MeshCache::SidecarPathFor(vertexShaderFileName, ".gpsprog");
+        }
+        return MeshCache::SidecarPathFor(vertexShaderFileName, ("+" + fragmentStem + ".gpsprog").c_str());
+    }
+    
+    static bool DriverSupportsBinaryFormat(GLenum binaryFormat) {
+        
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (formatCount <= 0) {
+            return false;
+        }
+        
+        std::vector<GLint> formats(formatCount);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        return std::find(formats.begin(), formats.end(), (GLint)binaryFormat) != formats.end();
+    }
+    
+    // Creates a program from a cached binary; fails quietly if the file is missing, was written
+    // for other sources or another driver, or the driver rejects the binary
+    static bool LoadProgramBinary(const std::string& fileName, uint64_t key, GLuint* program) {
+        
+        std::ifstream file(fileName.c_str(), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        
+        ProgramBinaryHeader header;
+        if (!file.read((char*)&header, sizeof(header)) ||
+            memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != PROGRAM_BINARY_VERSION || header.key != key ||
+            header.binaryLength == 0 || header.binaryLength > (1u << 30)) {
+            return false;
+        }
+        
+        std::vector<char> binary((size_t)header.binaryLength);
+        if (!file.read(binary.data(), binary.size()) || !DriverSupportsBinaryFormat(header.binaryFormat)) {
+            return false;
+        }
+        
+        *program = glCreateProgram();
+        glProgramBinary(*program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+        
+        GLint success = GL_FALSE;
+        glGetProgramiv(*program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::cout << "Program binary " << fileName << " was rejected by the driver, compiling from source" << std::endl;
+            glDeleteProgram(*program);
+            return false;
+        }
+        
+        return true;
+    }
+    
+    static bool SaveProgramBinary(const std::string& fileName, uint64_t key, GLuint program) {
+        
+        GLint success = GL_FALSE;
+        GLint length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (!success || length <= 0) {
+            return false;
+        }
+        
+        std::vector<char> binary(length);
+        GLenum binaryFormat = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &binaryFormat, binary.data());
+        if (written <= 0) {
+            return false;
+        }
+        
+        ProgramBinaryHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+        header.version = PROGRAM_BINARY_VERSION;
+        header.binaryFormat = binaryFormat;
+        header.key = key;
+        header.binaryLength = written;
+        
+        return MeshCache::WriteSidecar(fileName, [&](std::ostream& file) {
+            file.write((const char*)&header, sizeof(header));
+            file.write(binary.data(), written);
+            return true;
+        });
+    }
+    
+    static uint32_t HashName(const char* name) {
+        
+        uint32_t hash = 2166136261u;
+        for (; *name; name++) {
+            hash = (hash ^ (unsigned char)*name) * 16777619u;
+        }
+        return hash;
+    }
     std::string Shader::readShaderFile(std::string fileName) {
 
         std::ifstream shaderFile;
@@ -60,8 +247,39 @@ namespace gps {
     
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
 
-        //read, parse and compile the vertex shader
+        GPS_CPU_ZONE("Shader::loadShader");
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        
+        LoadTelemetry& telemetry = LoadTelemetry::Current();
+        LoadAsset& record = telemetry.BeginAsset(LOAD_ASSET_SHADER, vertexShaderFileName + " + " + fragmentShaderFileName);
+        
         std::string v = readShaderFile(vertexShaderFileName);
+        std::string f = readShaderFile(fragmentShaderFileName);
+        record.bytesRead = v.size() + f.size();
+        
+        //try the binary linked on a previous launch first
+        std::string binaryFileName = ProgramBinaryPathFor(vertexShaderFileName, fragmentShaderFileName);
+        uint64_t key = ProgramBinaryKey(v, f);
+        
+        double buildStart = LoadTelemetry::Now();
+        GLuint cachedProgram;
+        if (LoadProgramBinary(binaryFileName, key, &cachedProgram)) {
+            
+            record.cached = true;
+            record.parseMilliseconds = LoadTelemetry::Now() - buildStart;
+            record.bytesRead += LoadTelemetry::FileSize(binaryFileName);
+            
+            this->shaderProgram = cachedProgram;
+            reflectUniforms();
+            
+            std::cout << "Shader " << vertexShaderFileName << " + " << fragmentShaderFileName
+                << ": program binary loaded in " << MillisecondsSince(start) << " ms" << std::endl;
+            telemetry.EndAsset(record);
+            return;
+        }
+        
+        //parse and compile the vertex shader
         const GLchar* vertexShaderString = v.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -70,8 +288,7 @@ namespace gps {
         //check compilation status
         shaderCompileLog(vertexShader);
         
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        //parse and compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -84,16 +301,195 @@ namespace gps {
         this->shaderProgram = glCreateProgram();
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
+        glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->shaderProgram);
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+        record.parseMilliseconds = LoadTelemetry::Now() - buildStart;
+        
+        bool cached = SaveProgramBinary(binaryFileName, key, this->shaderProgram);
+        reflectUniforms();
+        
+        std::cout << "Shader " << vertexShaderFileName << " + " << fragmentShaderFileName
+            << ": compiled from source in " << MillisecondsSince(start) << " ms"
+            << (cached ? "" : " (program binary not cached)") << std::endl;
+        telemetry.EndAsset(record);
+    }
+    
+    void Shader::reflectUniforms() {
+        
+        uniforms = std::make_shared<UniformTable>();
+        
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++) {
+            
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->shaderProgram, i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            
+            // arrays are reported as "name[0]", look them up by their plain name
+            std::string name(nameBuffer.data(), length);
+            bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+            if (isArray) {
+                name.erase(name.size() - 3);
+            }
+            
+            // uniforms inside blocks have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, name.c_str());
+            if (location < 0) {
+                continue;
+            }
+            
+            UniformSlot slot;
+            slot.name = name;
+            slot.location = location;
+            slot.type = type;
+            slot.hasValue = false;
+            uniforms->slots.push_back(slot);
+            
+            // the other elements get a slot each, as "name[i]"
+            for (GLint element = 1; isArray && element < size; element++) {
+                
+                slot.name = name + "[" + std::to_string(element) + "]";
+                slot.location = glGetUniformLocation(this->shaderProgram, slot.name.c_str());
+                if (slot.location >= 0) {
+                    uniforms->slots.push_back(slot);
+                }
+            }
+        }
+        
+        size_t bucketCount = 8;
+        while (bucketCount < uniforms->slots.size() * 2) {
+            bucketCount *= 2;
+        }
+        uniforms->buckets.assign(bucketCount, -1);
+        
+        for (size_t i = 0; i < uniforms->slots.size(); i++) {
+            
+            size_t bucket = HashName(uniforms->slots[i].name.c_str()) & (bucketCount - 1);
+            while (uniforms->buckets[bucket] >= 0) {
+                bucket = (bucket + 1) & (bucketCount - 1);
+            }
+            uniforms->buckets[bucket] = (GLint)i;
+        }
+    }
+    
+    UniformHandle Shader::getUniform(const char* name) const {
+        
+        if (!uniforms) {
+            return -1;
+        }
+        
+        size_t mask = uniforms->buckets.size() - 1;
+        for (size_t bucket = HashName(name) & mask; uniforms->buckets[bucket] >= 0; bucket = (bucket + 1) & mask) {
+            
+            GLint slot = uniforms->buckets[bucket];
+            if (uniforms->slots[slot].name == name) {
+                return slot;
+            }
+        }
+        
+        // the first element of an array is stored under the plain name
+        size_t length = strlen(name);
+        if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+            return getUniform(std::string(name, length - 3).c_str());
+        }
+        
+        return -1;
+    }
+    
+    // Records the new value of a uniform, returns false if it is unknown or already uploaded
+    bool Shader::uniformChanged(UniformHandle handle, const void* value, size_t size, GLint* location) {
+        
+        if (!uniforms || handle < 0 || handle >= (GLint)uniforms->slots.size()) {
+            return false;
+        }
+        
+        uniformStats.setCalls++;
+        
+        UniformSlot& slot = uniforms->slots[handle];
+        if (slot.hasValue && memcmp(slot.value, value, size) == 0) {
+            return false;
+        }
+        
+        memcpy(slot.value, value, size);
+        slot.hasValue = true;
+        *location = slot.location;
+        
+        uniformStats.uploads++;
+        return true;
+    }
+    
+    void Shader::set(UniformHandle handle, GLint value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniform1i(this->shaderProgram, location, value);
+        }
+    }
+    
+    void Shader::set(UniformHandle handle, GLfloat value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniform1f(this->shaderProgram, location, value);
+        }
+    }
+    
+    void Shader::set(UniformHandle handle, const glm::vec3& value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniform3fv(this->shaderProgram, location, 1, glm::value_ptr(value));
+        }
+    }
+    
+    void Shader::set(UniformHandle handle, const glm::vec4& value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniform4fv(this->shaderProgram, location, 1, glm::value_ptr(value));
+        }
+    }
+    
+    void Shader::set(UniformHandle handle, const glm::mat3& value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniformMatrix3fv(this->shaderProgram, location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+    
+    void Shader::set(UniformHandle handle, const glm::mat4& value) {
+        
+        GLint location;
+        if (uniformChanged(handle, &value, sizeof(value), &location)) {
+            glProgramUniformMatrix4fv(this->shaderProgram, location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+    
+    const UniformStats& Shader::getUniformStats() {
+        
+        return uniformStats;
+    }
+    
+    void Shader::resetUniformStats() {
+        
+        uniformStats.setCalls = 0;
+        uniformStats.uploads = 0;
     }
     
     void Shader::useShaderProgram() {
 
-        glUseProgram(this->shaderProgram);
+        GLState::Current().UseProgram(this->shaderProgram);
     }
 
 }
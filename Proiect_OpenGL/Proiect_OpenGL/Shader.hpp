@@ -17,24 +17,65 @@
     #include <GL/glew.h>
 #endif
 
+#include <glm/glm.hpp>
+
+#include <cstdint>
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <iostream>
 
 
 namespace gps {
     
+    // Index of an active uniform in a shader's uniform table, -1 if the program has no such uniform
+    typedef GLint UniformHandle;
+    
+    // Uniform traffic since the last reset - values equal to the last uploaded one are skipped
+    struct UniformStats {
+        
+        uint64_t setCalls;
+        uint64_t uploads;
+    };
+    
+    struct UniformTable;
+    
     class Shader {
 
     public:
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
         void useShaderProgram();
+        
+        // Looks up an active uniform reflected at link time, no GL call involved
+        UniformHandle getUniform(const char* name) const;
+        
+        // Typed setters - they write to this program whether or not it is bound, and only
+        // call GL when the value differs from the one last uploaded
+        void set(UniformHandle handle, GLint value);
+        void set(UniformHandle handle, GLfloat value);
+        void set(UniformHandle handle, const glm::vec3& value);
+        void set(UniformHandle handle, const glm::vec4& value);
+        void set(UniformHandle handle, const glm::mat3& value);
+        void set(UniformHandle handle, const glm::mat4& value);
+        
+        template <typename T>
+        void set(const char* name, const T& value) {
+            set(getUniform(name), value);
+        }
+        
+        static const UniformStats& getUniformStats();
+        static void resetUniformStats();
     
     private:
+        // shared, because shaders are passed around by value
+        std::shared_ptr<UniformTable> uniforms;
+        
         std::string readShaderFile(std::string fileName);
         void shaderCompileLog(GLuint shaderId);
         void shaderLinkLog(GLuint shaderProgramId);
+        void reflectUniforms();
+        bool uniformChanged(UniformHandle handle, const void* value, size_t size, GLint* location);
     };
     
 }
@@ -0,0 +1,261 @@
+#include "ShadowCascades.hpp"
+#include "GLInterceptor.hpp"
+#include "RenderQueue.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    static_assert(PASS_SHADOW + SHADOW_CASCADE_COUNT <= PASS_SHADOW_DYNAMIC &&
+        PASS_SHADOW_DYNAMIC + SHADOW_CASCADE_COUNT <= PASS_MAIN, "every cascade layer needs its own render pass");
+
+    // Practical split scheme: 0 is uniform, 1 is logarithmic
+    static const float SPLIT_LAMBDA = 0.75f;
+    // World space depth bias of the single shadow map the cascades replace (0.005 of its 15 unit range)
+    static const float BASE_WORLD_BIAS = 0.075f;
+    // Larger texels need more bias against acne
+    static const float TEXEL_BIAS_SCALE = 1.5f;
+    // Radii are rounded up to this step so float noise does not move a cascade
+    static const float RADIUS_STEP = 1.0f / 16.0f;
+
+    ShadowCascades::ShadowCascades() : framebuffer(0), staticTexture(0), dynamicTexture(0), resolution(0) {
+
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            lightSpaceMatrices[i] = glm::mat4(1.0f);
+            casterMatrices[i] = glm::mat4(1.0f);
+            splits[i] = 0.0f;
+            biases[i] = 0.0f;
+            dirty[i] = true;
+            dynamicEmpty[i] = false;
+        }
+        resetStats();
+    }
+
+    ShadowCascades::~ShadowCascades() {
+
+        if (framebuffer != 0) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &staticTexture);
+            glDeleteTextures(1, &dynamicTexture);
+            GLInterceptor::Current().NoteDeleteTextures(1, &staticTexture);
+            GLInterceptor::Current().NoteDeleteTextures(1, &dynamicTexture);
+        }
+    }
+
+    void ShadowCascades::Init(GLsizei resolution) {
+
+        this->resolution = resolution;
+        staticTexture = CreateLayers();
+        dynamicTexture = CreateLayers();
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        Invalidate();
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            dynamicEmpty[i] = false;
+        }
+    }
+
+    GLuint ShadowCascades::CreateLayers() const {
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        GLInterceptor::Current().NoteBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, SHADOW_CASCADE_COUNT,
+            0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        return texture;
+    }
+
+    void ShadowCascades::Update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& lightDir,
+        const BoundingBox& sceneBounds, float shadowDistance) {
+
+        stats.updates++;
+
+        // near and far planes back out of the perspective matrix
+        float cameraNear = projection[3][2] / (projection[2][2] - 1.0f);
+        float cameraFar = projection[3][2] / (projection[2][2] + 1.0f);
+        float farthest = glm::min(cameraFar, shadowDistance);
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+
+        glm::vec3 direction = glm::normalize(lightDir);
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(direction, glm::vec3(0.0f), up);
+
+        // the depth range covers every caster of the scene and is shared by all cascades, so it does not move them
+        float sceneMinZ = FLT_MAX;
+        float sceneMaxZ = -FLT_MAX;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? sceneBounds.max.x : sceneBounds.min.x,
+                (corner & 2) ? sceneBounds.max.y : sceneBounds.min.y,
+                (corner & 4) ? sceneBounds.max.z : sceneBounds.min.z);
+            float z = (lightView * glm::vec4(point, 1.0f)).z;
+            sceneMinZ = glm::min(sceneMinZ, z);
+            sceneMaxZ = glm::max(sceneMaxZ, z);
+        }
+        float nearPlane = -sceneMaxZ - 1.0f;
+        float farPlane = -sceneMinZ + 1.0f;
+
+        float sliceNear = cameraNear;
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+
+            float t = (float)(i + 1) / SHADOW_CASCADE_COUNT;
+            float logarithmic = cameraNear * std::pow(farthest / cameraNear, t);
+            float uniform = cameraNear + (farthest - cameraNear) * t;
+            float sliceFar = SPLIT_LAMBDA * logarithmic + (1.0f - SPLIT_LAMBDA) * uniform;
+            splits[i] = sliceFar;
+
+            // corners of the slice, the view distances go through the projection to get their NDC depth
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int corner = 0; corner < 8; corner++) {
+                float distance = (corner & 4) ? sliceFar : sliceNear;
+                glm::vec4 clip = projection * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+                glm::vec4 ndc((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, clip.z / clip.w, 1.0f);
+                glm::vec4 world = inverseViewProjection * ndc;
+                corners[corner] = glm::vec3(world) / world.w;
+                center += corners[corner];
+            }
+            center /= 8.0f;
+
+            // a sphere keeps the same size however the camera turns
+            float radius = 0.0f;
+            for (int corner = 0; corner < 8; corner++) {
+                radius = glm::max(radius, glm::length(corners[corner] - center));
+            }
+            radius = std::ceil(radius / RADIUS_STEP) * RADIUS_STEP;
+
+            // whole texel steps, so a moving camera does not make the shadow edges crawl
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            float texel = 2.0f * radius / resolution;
+            float left = std::floor((lightCenter.x - radius) / texel) * texel;
+            float bottom = std::floor((lightCenter.y - radius) / texel) * texel;
+            float right = left + 2.0f * radius;
+            float top = bottom + 2.0f * radius;
+
+            glm::mat4 lightSpace = glm::ortho(left, right, bottom, top, nearPlane, farPlane) * lightView;
+
+            // casters further from the light than the slice can not shadow it; rounded out like the radius,
+            // the static layer is culled with this matrix and has to be redrawn whenever it changes
+            float casterFar = std::ceil(-(lightCenter.z - radius) / RADIUS_STEP) * RADIUS_STEP;
+            casterFar = glm::clamp(casterFar, nearPlane + RADIUS_STEP, farPlane);
+            glm::mat4 casterSpace = glm::ortho(left, right, bottom, top, nearPlane, casterFar) * lightView;
+
+            biases[i] = glm::max(BASE_WORLD_BIAS, texel * TEXEL_BIAS_SCALE) / (farPlane - nearPlane);
+
+            if (lightSpace != lightSpaceMatrices[i] || casterSpace != casterMatrices[i]) {
+                lightSpaceMatrices[i] = lightSpace;
+                casterMatrices[i] = casterSpace;
+                dirty[i] = true;
+            }
+
+            sliceNear = sliceFar;
+        }
+    }
+
+    void ShadowCascades::Invalidate() {
+
+        for (int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            dirty[i] = true;
+        }
+    }
+
+    bool ShadowCascades::isDirty(int cascade) const {
+
+        return dirty[cascade];
+    }
+
+    const glm::mat4& ShadowCascades::getLightSpaceMatrix(int cascade) const {
+
+        return lightSpaceMatrices[cascade];
+    }
+
+    const glm::mat4& ShadowCascades::getCasterMatrix(int cascade) const {
+
+        return casterMatrices[cascade];
+    }
+
+    glm::vec4 ShadowCascades::getSplits() const {
+
+        glm::vec4 result(0.0f);
+        for (int i = 0; i < SHADOW_CASCADE_COUNT && i < 4; i++) {
+            result[i] = splits[i];
+        }
+        return result;
+    }
+
+    glm::vec4 ShadowCascades::getBiases() const {
+
+        glm::vec4 result(0.0f);
+        for (int i = 0; i < SHADOW_CASCADE_COUNT && i < 4; i++) {
+            result[i] = biases[i];
+        }
+        return result;
+    }
+
+    void ShadowCascades::BeginLayer(GLuint texture, int cascade) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+        glViewport(0, 0, resolution, resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        GLInterceptor::Current().NoteCall(GL_CALL_Viewport);
+        GLInterceptor::Current().NoteCall(GL_CALL_Clear);
+    }
+
+    void ShadowCascades::BeginStaticLayer(int cascade) {
+
+        BeginLayer(staticTexture, cascade);
+        dirty[cascade] = false;
+        stats.staticRenders++;
+    }
+
+    bool ShadowCascades::BeginDynamicLayer(int cascade, bool hasCasters) {
+
+        if (!hasCasters && dynamicEmpty[cascade]) {
+            return false;
+        }
+
+        BeginLayer(dynamicTexture, cascade);
+        dynamicEmpty[cascade] = !hasCasters;
+        if (hasCasters) {
+            stats.dynamicRenders++;
+        }
+        return hasCasters;
+    }
+
+    GLuint ShadowCascades::getStaticTexture() const {
+
+        return staticTexture;
+    }
+
+    GLuint ShadowCascades::getDynamicTexture() const {
+
+        return dynamicTexture;
+    }
+
+    const ShadowCascadeStats& ShadowCascades::getStats() const {
+
+        return stats;
+    }
+
+    void ShadowCascades::resetStats() {
+
+        memset(&stats, 0, sizeof(stats));
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef ShadowCascades_hpp
+#define ShadowCascades_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Bounds.hpp"
+
+#include <cstdint>
+
+namespace gps {
+
+    // Must match CASCADE_COUNT in basic.frag
+    const int SHADOW_CASCADE_COUNT = 4;
+
+    struct ShadowCascadeStats {
+
+        uint64_t updates;
+        uint64_t staticRenders;
+        uint64_t dynamicRenders;
+    };
+
+    // Directional light shadow map split into cascades along the camera depth, one layer of a
+    // depth texture array each. Every cascade is an ortho box around a bounding sphere of its slice
+    // of the camera frustum, snapped to whole texels, so it only changes when the camera moves by
+    // more than a texel, turns enough to move the slice, or the light turns.
+    // Each cascade has a static layer, cached until its matrix changes or the static geometry is
+    // invalidated, and a dynamic layer for moving casters that is redrawn every frame; the
+    // receivers are in shadow if either layer occludes them.
+    class ShadowCascades {
+
+    public:
+        ShadowCascades();
+        ~ShadowCascades();
+
+        // Creates the depth texture array and the framebuffer the layers are rendered through
+        void Init(GLsizei resolution);
+
+        // Refits the cascades to the camera (practical split scheme up to shadowDistance) and marks the
+        // ones whose render or caster matrix changed as dirty; sceneBounds is in world space and bounds the casters
+        void Update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& lightDir,
+            const BoundingBox& sceneBounds, float shadowDistance);
+
+        // Forces the static layer of every cascade to re-render, e.g. after static geometry changed
+        void Invalidate();
+
+        // True if the static layer of the cascade has to be rendered this frame
+        bool isDirty(int cascade) const;
+
+        // World to light clip space of the cascade, as used for rendering and sampling it
+        const glm::mat4& getLightSpaceMatrix(int cascade) const;
+
+        // World to clip space of the casters that can shadow the slice of the cascade - tighter than
+        // the render matrix in depth, meant for culling only
+        const glm::mat4& getCasterMatrix(int cascade) const;
+
+        // Far view space distance of each cascade
+        glm::vec4 getSplits() const;
+
+        // Depth bias of each cascade in its normalized depth units
+        glm::vec4 getBiases() const;
+
+        // Binds the static layer of a cascade as depth target, sets the viewport and clears it. The
+        // cascade is considered up to date afterwards.
+        void BeginStaticLayer(int cascade);
+
+        // Same for the dynamic layer. A layer that is already empty is left alone when there is
+        // nothing to draw; returns whether the casters should be drawn.
+        bool BeginDynamicLayer(int cascade, bool hasCasters);
+
+        GLuint getStaticTexture() const;
+        GLuint getDynamicTexture() const;
+
+        const ShadowCascadeStats& getStats() const;
+        void resetStats();
+
+    private:
+        GLuint framebuffer;
+        GLuint staticTexture;
+        GLuint dynamicTexture;
+        GLsizei resolution;
+
+        glm::mat4 lightSpaceMatrices[SHADOW_CASCADE_COUNT];
+        glm::mat4 casterMatrices[SHADOW_CASCADE_COUNT];
+        float splits[SHADOW_CASCADE_COUNT];
+        float biases[SHADOW_CASCADE_COUNT];
+        bool dirty[SHADOW_CASCADE_COUNT];
+        bool dynamicEmpty[SHADOW_CASCADE_COUNT];
+
+        ShadowCascadeStats stats;
+
+        GLuint CreateLayers() const;
+        void BeginLayer(GLuint texture, int cascade);
+
+        ShadowCascades(const ShadowCascades&);
+        ShadowCascades& operator=(const ShadowCascades&);
+    };
+}
+
+#endif /* ShadowCascades_hpp */
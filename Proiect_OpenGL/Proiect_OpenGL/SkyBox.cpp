@@ -7,6 +7,11 @@
 //
 
 #include "SkyBox.hpp"
+#include "CpuProfiler.hpp"
+#include "GLInterceptor.hpp"
+#include "LoadTelemetry.hpp"
+#include "TextureCooker.hpp"
+#include "TextureLoader.hpp"
 
 namespace gps {
     
@@ -17,29 +22,40 @@ namespace gps {
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
     {
+        GPS_CPU_ZONE("SkyBox::Load");
+
+        // the faces are recorded as its textures, under the folder they are in
+        std::string folder = cubeMapFaces.empty() ? "skybox" : cubeMapFaces[0];
+        folder = folder.substr(0, folder.find_last_of('/'));
+        LoadAsset& record = LoadTelemetry::Current().BeginAsset(LOAD_ASSET_SKYBOX, folder);
+
         cubemapTexture = LoadSkyBoxTextures(cubeMapFaces);
+        double uploadStart = LoadTelemetry::Now();
         InitSkyBox();
+        record.uploadMilliseconds = LoadTelemetry::Now() - uploadStart;
+        record.vertices = 36;
+        record.gpuBytes = 36 * 3 * sizeof(GLfloat);
+        GLState::Current().Invalidate();
+
+        LoadTelemetry::Current().EndAsset(record);
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    void SkyBox::Draw(gps::DrawContext& context, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
     {
-        shader.useShaderProgram();
-        
         //set the view and projection matrices
         glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        context.shader.set("view", transformedView);
+        context.shader.set("projection", projectionMatrix);
         
-        glDepthFunc(GL_LEQUAL);
+        context.state.SetDepthFunc(GL_LEQUAL);
         
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        context.state.BindVertexArray(skyboxVAO);
+        context.shader.set("skybox", 0);
+        context.state.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        GLInterceptor::Current().NoteCall(GL_CALL_DrawArrays);
         
-        glDepthFunc(GL_LESS);
+        context.state.SetDepthFunc(GL_LESS);
     }
     
     GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
@@ -52,18 +68,55 @@ namespace gps {
         unsigned char* image;
         int force_channels = 3;
         
+        bool useCooked = TextureLoader::SupportsCookedTextures();
+        
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        GLInterceptor::Current().NoteBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
+            LoadAsset face = LoadTelemetry::Current().NewAsset(LOAD_ASSET_TEXTURE, skyBoxFaces[i]);
+            face.bytesRead = LoadTelemetry::FileSize(skyBoxFaces[i]);
+            
+            // cube map faces are not flipped, and only sampled at their top level
+            CookedTexture cooked;
+            bool cookedNow = false;
+            if (useCooked && LoadOrCookTexture(skyBoxFaces[i], false, &cooked, &cookedNow)) {
+                face.parseMilliseconds = LoadTelemetry::Now() - face.startMilliseconds;
+                if (!cookedNow) {
+                    face.cached = true;
+                    face.bytesRead = LoadTelemetry::FileSize(CookedTexturePathFor(skyBoxFaces[i]));
+                }
+                GLenum format = cooked.format == COOKED_TEXTURE_BC3 ?
+                    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+                glCompressedTexImage2D(
+                                       GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format,
+                                       cooked.levels[0].width, cooked.levels[0].height, 0,
+                                       (GLsizei)cooked.levels[0].size, &cooked.data[cooked.levels[0].offset]
+                                       );
+                face.gpuBytes = cooked.levels[0].size;
+                face.milliseconds = LoadTelemetry::Now() - face.startMilliseconds;
+                face.uploadMilliseconds = face.milliseconds - face.parseMilliseconds;
+                LoadTelemetry::Current().AddAsset(face);
+                continue;
+            }
+            
             image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
+            face.parseMilliseconds = LoadTelemetry::Now() - face.startMilliseconds;
             if (!image) {
                 fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
+                LoadTelemetry::Current().AddAsset(face);
                 return false;
             }
             glTexImage2D(
                          GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
                          GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
                          );
+            stbi_image_free(image);
+            // RGB texels are padded to 4 bytes
+            face.gpuBytes = (uint64_t)width * height * 4;
+            face.milliseconds = LoadTelemetry::Now() - face.startMilliseconds;
+            face.uploadMilliseconds = face.milliseconds - face.parseMilliseconds;
+            LoadTelemetry::Current().AddAsset(face);
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -71,6 +124,7 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLInterceptor::Current().NoteBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         
         return textureID;
     }
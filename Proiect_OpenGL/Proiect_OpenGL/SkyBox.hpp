@@ -10,6 +10,7 @@
 #define SkyBox_hpp
 
 
+#include "GLState.hpp"
 #include "Shader.hpp"
 #include "stb_image.h"
 
@@ -25,7 +26,7 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        void Draw(gps::DrawContext& context, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
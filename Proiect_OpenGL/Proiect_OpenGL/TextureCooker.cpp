@@ -0,0 +1,666 @@
+#include "TextureCooker.hpp"
+#include "CpuProfiler.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if defined (_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+namespace gps {
+
+    static const char COOKED_TEXTURE_MAGIC[8] = { 'G', 'P', 'S', 'T', 'E', 'X', '\0', '\0' };
+
+    // Fixed size start of a .gpstex file, followed by levelCount CookedMipLevel records and the block data.
+    // Level offsets are relative to the start of the block data.
+    struct CookedTextureHeader {
+
+        SidecarStamp stamp;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+        uint32_t flipped;
+        uint32_t padding;
+    };
+
+    std::string CookedTexturePathFor(const std::string& imagePath) {
+
+        // the extension is kept, so grass.jpg and grass.png do not share a container
+        return imagePath + ".gpstex";
+    }
+
+    // ---- sRGB-correct mip chain ----
+
+    struct SrgbTable {
+
+        float toLinear[256];
+
+        SrgbTable() {
+            for (int i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+
+    static const SrgbTable& Srgb() {
+        static SrgbTable table;
+        return table;
+    }
+
+    static unsigned char LinearToSrgb(float linear) {
+
+        float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+        int value = (int)(c * 255.0f + 0.5f);
+        return (unsigned char)std::min(255, std::max(0, value));
+    }
+
+    // Halves an RGBA8 image, averaging the colour in linear space and the alpha as is.
+    // Odd edges repeat their last row / column.
+    static void DownsampleSrgb(const unsigned char* source, int width, int height,
+        std::vector<unsigned char>* target, int* targetWidth, int* targetHeight) {
+
+        const float* toLinear = Srgb().toLinear;
+        int w = std::max(1, width / 2);
+        int h = std::max(1, height / 2);
+        target->resize((size_t)w * h * 4);
+
+        for (int y = 0; y < h; y++) {
+
+            int y0 = std::min(2 * y, height - 1);
+            int y1 = std::min(2 * y + 1, height - 1);
+
+            for (int x = 0; x < w; x++) {
+
+                int x0 = std::min(2 * x, width - 1);
+                int x1 = std::min(2 * x + 1, width - 1);
+
+                const unsigned char* p[4] = {
+                    source + ((size_t)y0 * width + x0) * 4,
+                    source + ((size_t)y0 * width + x1) * 4,
+                    source + ((size_t)y1 * width + x0) * 4,
+                    source + ((size_t)y1 * width + x1) * 4
+                };
+
+                unsigned char* out = &(*target)[((size_t)y * w + x) * 4];
+                for (int c = 0; c < 3; c++) {
+                    float sum = toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]];
+                    out[c] = LinearToSrgb(sum * 0.25f);
+                }
+                out[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+            }
+        }
+
+        *targetWidth = w;
+        *targetHeight = h;
+    }
+
+    // ---- BC1 / BC3 block encoder ----
+
+    static void UnpackColor565(uint16_t color, int rgb[3]) {
+
+        int r = (color >> 11) & 31;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    static uint16_t PackColor565(const float rgb[3]) {
+
+        int r = (int)(std::min(255.0f, std::max(0.0f, rgb[0])) * 31.0f / 255.0f + 0.5f);
+        int g = (int)(std::min(255.0f, std::max(0.0f, rgb[1])) * 63.0f / 255.0f + 0.5f);
+        int b = (int)(std::min(255.0f, std::max(0.0f, rgb[2])) * 31.0f / 255.0f + 0.5f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    // Picks the closest of the four palette entries for each pixel of a 4x4 block.
+    // Expects color0 > color1 (four colour mode), returns the squared error.
+    static int MatchColors(const unsigned char* block, uint16_t color0, uint16_t color1, uint32_t* indices) {
+
+        int palette[4][3];
+        UnpackColor565(color0, palette[0]);
+        UnpackColor565(color1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        *indices = 0;
+        int error = 0;
+
+        for (int i = 0; i < 16; i++) {
+
+            const unsigned char* pixel = block + i * 4;
+            int best = 0;
+            int bestDistance = 1 << 30;
+
+            for (int j = 0; j < 4; j++) {
+
+                int dr = pixel[0] - palette[j][0];
+                int dg = pixel[1] - palette[j][1];
+                int db = pixel[2] - palette[j][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = j;
+                }
+            }
+
+            *indices |= (uint32_t)best << (2 * i);
+            error += bestDistance;
+        }
+
+        return error;
+    }
+
+    // Orders the endpoints for four colour mode and finds the indices; a block that
+    // quantizes to a single colour uses index 0 everywhere
+    static int FinishColorBlock(const unsigned char* block, uint16_t* color0, uint16_t* color1, uint32_t* indices) {
+
+        if (*color0 < *color1) {
+            std::swap(*color0, *color1);
+        }
+
+        if (*color0 == *color1) {
+
+            *indices = 0;
+            int rgb[3];
+            UnpackColor565(*color0, rgb);
+            int error = 0;
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < 3; c++) {
+                    int d = block[i * 4 + c] - rgb[c];
+                    error += d * d;
+                }
+            }
+            return error;
+        }
+
+        return MatchColors(block, *color0, *color1, indices);
+    }
+
+    // Least squares fit of both endpoints to the pixels, given the current indices
+    static bool RefineEndpoints(const unsigned char* block, uint32_t indices, float endpoint0[3], float endpoint1[3]) {
+
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = { 0.0f, 0.0f, 0.0f };
+        float bx[3] = { 0.0f, 0.0f, 0.0f };
+
+        for (int i = 0; i < 16; i++) {
+
+            float a = weights[(indices >> (2 * i)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; c++) {
+                ax[c] += a * block[i * 4 + c];
+                bx[c] += b * block[i * 4 + c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) < 1e-6f) {
+            return false;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            endpoint0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+            endpoint1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+        }
+        return true;
+    }
+
+    // Encodes the colour of a 4x4 RGBA block: endpoints along the principal axis of the
+    // pixel colours, then a least squares refinement that is kept if it lowers the error
+    static void EncodeColorBlock(const unsigned char* block, unsigned char* out) {
+
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                mean[c] += block[i * 4 + c];
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            mean[c] /= 16.0f;
+        }
+
+        // covariance: xx, xy, xz, yy, yz, zz
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+
+            float r = block[i * 4 + 0] - mean[0];
+            float g = block[i * 4 + 1] - mean[1];
+            float b = block[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // power iteration for the principal axis
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; iteration++) {
+
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+            if (length < 1e-4f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float minProjection = 0.0f, maxProjection = 0.0f;
+        for (int i = 0; i < 16; i++) {
+
+            float projection = ((block[i * 4 + 0] - mean[0]) * axis[0] +
+                (block[i * 4 + 1] - mean[1]) * axis[1] +
+                (block[i * 4 + 2] - mean[2]) * axis[2]) / lengthSquared;
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+
+        float endpoint0[3], endpoint1[3];
+        for (int c = 0; c < 3; c++) {
+            endpoint0[c] = mean[c] + axis[c] * maxProjection;
+            endpoint1[c] = mean[c] + axis[c] * minProjection;
+        }
+
+        uint16_t color0 = PackColor565(endpoint0);
+        uint16_t color1 = PackColor565(endpoint1);
+        uint32_t indices;
+        int error = FinishColorBlock(block, &color0, &color1, &indices);
+
+        for (int pass = 0; pass < 2 && error > 0 && color0 != color1; pass++) {
+
+            if (!RefineEndpoints(block, indices, endpoint0, endpoint1)) {
+                break;
+            }
+
+            uint16_t refined0 = PackColor565(endpoint0);
+            uint16_t refined1 = PackColor565(endpoint1);
+            uint32_t refinedIndices;
+            int refinedError = FinishColorBlock(block, &refined0, &refined1, &refinedIndices);
+            if (refinedError >= error) {
+                break;
+            }
+
+            color0 = refined0;
+            color1 = refined1;
+            indices = refinedIndices;
+            error = refinedError;
+        }
+
+        out[0] = (unsigned char)(color0 & 0xFF);
+        out[1] = (unsigned char)(color0 >> 8);
+        out[2] = (unsigned char)(color1 & 0xFF);
+        out[3] = (unsigned char)(color1 >> 8);
+        out[4] = (unsigned char)(indices & 0xFF);
+        out[5] = (unsigned char)((indices >> 8) & 0xFF);
+        out[6] = (unsigned char)((indices >> 16) & 0xFF);
+        out[7] = (unsigned char)(indices >> 24);
+    }
+
+    // Encodes the alpha of a 4x4 RGBA block in eight value mode between its min and max alpha
+    static void EncodeAlphaBlock(const unsigned char* block, unsigned char* out) {
+
+        int minAlpha = 255, maxAlpha = 0;
+        for (int i = 0; i < 16; i++) {
+            minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+            maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+        }
+
+        out[0] = (unsigned char)maxAlpha;
+        out[1] = (unsigned char)minAlpha;
+
+        uint64_t bits = 0;
+        if (maxAlpha > minAlpha) {
+
+            int palette[8];
+            palette[0] = maxAlpha;
+            palette[1] = minAlpha;
+            for (int j = 2; j < 8; j++) {
+                palette[j] = ((8 - j) * maxAlpha + (j - 1) * minAlpha) / 7;
+            }
+
+            for (int i = 0; i < 16; i++) {
+
+                int alpha = block[i * 4 + 3];
+                int best = 0;
+                for (int j = 1; j < 8; j++) {
+                    if (abs(alpha - palette[j]) < abs(alpha - palette[best])) {
+                        best = j;
+                    }
+                }
+                bits |= (uint64_t)best << (3 * i);
+            }
+        }
+
+        for (int i = 0; i < 6; i++) {
+            out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xFF);
+        }
+    }
+
+    static size_t BlockBytes(uint32_t format) {
+        return format == COOKED_TEXTURE_BC3 ? 16 : 8;
+    }
+
+    static size_t LevelBytes(uint32_t format, int width, int height) {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+    }
+
+    // Compresses one RGBA8 level; partial blocks at the edges repeat the last row / column
+    static void EncodeLevel(const unsigned char* pixels, int width, int height, uint32_t format, unsigned char* out) {
+
+        unsigned char block[64];
+        size_t blockBytes = BlockBytes(format);
+
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+
+                for (int y = 0; y < 4; y++) {
+                    for (int x = 0; x < 4; x++) {
+                        int sx = std::min(bx + x, width - 1);
+                        int sy = std::min(by + y, height - 1);
+                        memcpy(block + (y * 4 + x) * 4, pixels + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                }
+
+                if (format == COOKED_TEXTURE_BC3) {
+                    EncodeAlphaBlock(block, out);
+                    EncodeColorBlock(block, out + 8);
+                }
+                else {
+                    EncodeColorBlock(block, out);
+                }
+                out += blockBytes;
+            }
+        }
+    }
+
+    bool CookTexture(const std::string& imagePath, bool flipVertically, CookedTexture* texture) {
+
+        GPS_CPU_ZONE("CookTexture");
+
+        stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+        int width, height, n;
+        unsigned char* pixels = stbi_load(imagePath.c_str(), &width, &height, &n, 4);
+        if (!pixels) {
+            return false;
+        }
+
+        bool hasAlpha = false;
+        for (size_t i = 0; i < (size_t)width * height && !hasAlpha; i++) {
+            hasAlpha = pixels[i * 4 + 3] != 255;
+        }
+
+        texture->format = hasAlpha ? COOKED_TEXTURE_BC3 : COOKED_TEXTURE_BC1;
+        texture->width = width;
+        texture->height = height;
+        texture->flipped = flipVertically;
+        texture->levels.clear();
+        texture->data.clear();
+
+        // level 0 is encoded straight from the decoded image, every further level from the previous one
+        std::vector<unsigned char> level;
+        std::vector<unsigned char> nextLevel;
+        const unsigned char* current = pixels;
+        int levelWidth = width;
+        int levelHeight = height;
+
+        while (true) {
+
+            CookedMipLevel mip;
+            mip.width = levelWidth;
+            mip.height = levelHeight;
+            mip.offset = texture->data.size();
+            mip.size = LevelBytes(texture->format, levelWidth, levelHeight);
+            texture->levels.push_back(mip);
+
+            texture->data.resize(mip.offset + mip.size);
+            EncodeLevel(current, levelWidth, levelHeight, texture->format, &texture->data[mip.offset]);
+
+            if (levelWidth == 1 && levelHeight == 1) {
+                break;
+            }
+
+            DownsampleSrgb(current, levelWidth, levelHeight, &nextLevel, &levelWidth, &levelHeight);
+            level.swap(nextLevel);
+            current = level.data();
+        }
+
+        stbi_image_free(pixels);
+        return true;
+    }
+
+    static bool ReadCookedTexture(const std::string& cookedPath, const std::string& imagePath, bool flipVertically,
+        CookedTexture* texture) {
+
+        MappedFile file;
+        if (!file.Open(cookedPath) || file.getSize() < sizeof(CookedTextureHeader)) {
+            return false;
+        }
+
+        CookedTextureHeader header;
+        memcpy(&header, file.getData(), sizeof(header));
+
+        // stale containers are silently cooked again
+        if (!MeshCache::MatchesSidecarStamp(header.stamp, imagePath, COOKED_TEXTURE_MAGIC, COOKED_TEXTURE_VERSION) ||
+            (header.format != COOKED_TEXTURE_BC1 && header.format != COOKED_TEXTURE_BC3) ||
+            header.levelCount == 0 || header.levelCount > 32 || header.flipped != (flipVertically ? 1u : 0u)) {
+            return false;
+        }
+
+        size_t dataStart = sizeof(header) + header.levelCount * sizeof(CookedMipLevel);
+        if (dataStart > file.getSize()) {
+            return false;
+        }
+
+        texture->levels.resize(header.levelCount);
+        memcpy(texture->levels.data(), file.getData() + sizeof(header), header.levelCount * sizeof(CookedMipLevel));
+
+        uint64_t dataSize = file.getSize() - dataStart;
+        for (size_t i = 0; i < texture->levels.size(); i++) {
+
+            const CookedMipLevel& mip = texture->levels[i];
+            if (mip.offset > dataSize || mip.size > dataSize - mip.offset ||
+                mip.size != LevelBytes(header.format, mip.width, mip.height)) {
+                return false;
+            }
+        }
+
+        texture->format = header.format;
+        texture->width = header.width;
+        texture->height = header.height;
+        texture->flipped = flipVertically;
+        texture->data.assign(file.getData() + dataStart, file.getData() + file.getSize());
+        return true;
+    }
+
+    static bool WriteCookedTexture(const std::string& cookedPath, const SidecarStamp& stamp, const CookedTexture& texture) {
+
+        CookedTextureHeader header;
+        memset(&header, 0, sizeof(header));
+        header.stamp = stamp;
+        header.format = texture.format;
+        header.width = texture.width;
+        header.height = texture.height;
+        header.levelCount = (uint32_t)texture.levels.size();
+        header.flipped = texture.flipped ? 1 : 0;
+
+        return MeshCache::WriteSidecar(cookedPath, [&](std::ostream& out) {
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)texture.levels.data(), texture.levels.size() * sizeof(CookedMipLevel));
+            out.write((const char*)texture.data.data(), texture.data.size());
+            return true;
+        });
+    }
+
+    static bool LoadOrCook(const std::string& imagePath, bool flipVertically, bool force,
+        CookedTexture* texture, bool* cooked) {
+
+        *cooked = false;
+
+        // stamped before cooking, so an image changed meanwhile is cooked again next time
+        SidecarStamp stamp;
+        if (!MeshCache::StampSidecar(imagePath, COOKED_TEXTURE_MAGIC, COOKED_TEXTURE_VERSION, &stamp)) {
+            return false;
+        }
+
+        std::string cookedPath = CookedTexturePathFor(imagePath);
+        if (!force && ReadCookedTexture(cookedPath, imagePath, flipVertically, texture)) {
+            return true;
+        }
+
+        if (!CookTexture(imagePath, flipVertically, texture)) {
+            return false;
+        }
+        *cooked = true;
+
+        size_t rawBytes = (size_t)texture->width * texture->height * 4;
+        fprintf(stdout, "cooked %s : %ux%u %s, %u levels, %zu KB -> %zu KB\n", imagePath.c_str(),
+            texture->width, texture->height, texture->format == COOKED_TEXTURE_BC3 ? "BC3" : "BC1",
+            (unsigned)texture->levels.size(), rawBytes * 4 / 3 / 1024, texture->data.size() / 1024);
+
+        if (!WriteCookedTexture(cookedPath, stamp, *texture)) {
+            fprintf(stderr, "WARNING: could not write %s\n", cookedPath.c_str());
+        }
+        return true;
+    }
+
+    bool LoadOrCookTexture(const std::string& imagePath, bool flipVertically, CookedTexture* texture, bool* cooked) {
+
+        bool cookedNow;
+        return LoadOrCook(imagePath, flipVertically, false, texture, cooked != NULL ? cooked : &cookedNow);
+    }
+
+    static bool IsImageFile(const std::string& name) {
+
+        size_t dot = name.find_last_of('.');
+        if (dot == std::string::npos) {
+            return false;
+        }
+
+        std::string extension = name.substr(dot + 1);
+        for (size_t i = 0; i < extension.size(); i++) {
+            extension[i] = (char)tolower((unsigned char)extension[i]);
+        }
+
+        return extension == "jpg" || extension == "jpeg" || extension == "png" ||
+            extension == "tga" || extension == "bmp";
+    }
+
+    static void FindImages(const std::string& folder, std::vector<std::string>* images) {
+
+#if defined (_WIN32)
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA((folder + "\\*").c_str(), &found);
+        if (search == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        do {
+            std::string name = found.cFileName;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            std::string path = folder + "/" + name;
+            if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                FindImages(path, images);
+            }
+            else if (IsImageFile(name)) {
+                images->push_back(path);
+            }
+        } while (FindNextFileA(search, &found));
+
+        FindClose(search);
+#else
+        DIR* directory = opendir(folder.c_str());
+        if (directory == NULL) {
+            return;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(directory)) != NULL) {
+
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            std::string path = folder + "/" + name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0) {
+                continue;
+            }
+
+            if (S_ISDIR(info.st_mode)) {
+                FindImages(path, images);
+            }
+            else if (IsImageFile(name)) {
+                images->push_back(path);
+            }
+        }
+
+        closedir(directory);
+#endif
+    }
+
+    int CookTextureFolder(const std::string& folder, bool flipVertically, bool force) {
+
+        std::vector<std::string> images;
+        FindImages(folder, &images);
+        std::sort(images.begin(), images.end());
+
+        std::vector<char> cooked(images.size(), 0);
+        std::vector<char> failed(images.size(), 0);
+
+        ThreadPool::Shared().ParallelFor(images.size(), [&](size_t i) {
+
+            CookedTexture texture;
+            bool wasCooked;
+            if (LoadOrCook(images[i], flipVertically, force, &texture, &wasCooked)) {
+                cooked[i] = wasCooked;
+            }
+            else {
+                fprintf(stderr, "ERROR: could not cook %s\n", images[i].c_str());
+                failed[i] = 1;
+            }
+        });
+
+        int cookedCount = (int)std::count(cooked.begin(), cooked.end(), 1);
+        int failedCount = (int)std::count(failed.begin(), failed.end(), 1);
+        std::cout << folder << " : " << images.size() << " images, " << cookedCount << " cooked, "
+            << images.size() - cookedCount - failedCount << " up to date, " << failedCount << " failed" << std::endl;
+
+        return failedCount;
+    }
+}
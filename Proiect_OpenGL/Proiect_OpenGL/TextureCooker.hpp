@@ -0,0 +1,53 @@
+#ifndef TextureCooker_hpp
+#define TextureCooker_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the container layout or the encoder output changes
+    const uint32_t COOKED_TEXTURE_VERSION = 2;
+
+    enum CookedTextureFormat {
+
+        COOKED_TEXTURE_BC1 = 1,   // opaque, 4 bits per pixel
+        COOKED_TEXTURE_BC3 = 3    // with alpha, 8 bits per pixel
+    };
+
+    struct CookedMipLevel {
+
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Block compressed image with its complete mip chain, as stored in a .gpstex file
+    struct CookedTexture {
+
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        bool flipped;
+        std::vector<CookedMipLevel> levels;
+        std::vector<unsigned char> data;
+    };
+
+    // Name of the cooked container belonging to an image file
+    std::string CookedTexturePathFor(const std::string& imagePath);
+
+    // Reads the cooked container of an image; if it is missing or older than the image,
+    // the image is cooked and the container written first, and cooked is set. Safe to call from any thread.
+    bool LoadOrCookTexture(const std::string& imagePath, bool flipVertically, CookedTexture* texture, bool* cooked = NULL);
+
+    // Decodes an image, builds the sRGB-correct mip chain and block compresses every level
+    bool CookTexture(const std::string& imagePath, bool flipVertically, CookedTexture* texture);
+
+    // Cooks every image below a folder - needs no GL context, so it runs on headless machines.
+    // Returns the number of images that failed.
+    int CookTextureFolder(const std::string& folder, bool flipVertically, bool force);
+}
+
+#endif /* TextureCooker_hpp */
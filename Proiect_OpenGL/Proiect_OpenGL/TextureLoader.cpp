@@ -0,0 +1,304 @@
+#include "TextureLoader.hpp"
+#include "CpuProfiler.hpp"
+#include "GLInterceptor.hpp"
+#include "LoadTelemetry.hpp"
+#include "TextureCooker.hpp"
+#include "ThreadPool.hpp"
+
+#include "stb_image.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace gps {
+
+    // Upper bound of pixel data staged in the unpack buffer at once
+    static const size_t TEXTURE_BATCH_BYTES = 64 * 1024 * 1024;
+
+    struct DecodedImage {
+
+        size_t slot;
+        int width;
+        int height;
+        unsigned char* pixels;      // RGBA8 from stb_image, or NULL
+        CookedTexture* cooked;      // block compressed mip chain, or NULL
+        bool fromCache;             // cooked container read as it was
+        double decodeStart;         // LoadTelemetry::Now() on the worker
+        double decodeMilliseconds;
+        uint64_t bytesRead;
+    };
+
+    static size_t StagedBytes(const DecodedImage& image) {
+
+        if (image.cooked) {
+            return image.cooked->data.size();
+        }
+        return (size_t)image.width * image.height * 4;
+    }
+
+    static void ReleaseImage(const DecodedImage& image) {
+
+        if (image.pixels) {
+            stbi_image_free(image.pixels);
+        }
+        delete image.cooked;
+    }
+
+    bool TextureLoader::SupportsCookedTextures() {
+
+#if defined (__APPLE__)
+        return true;
+#else
+        return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+#endif
+    }
+
+    size_t TextureLoader::Request(const std::string& path) {
+
+        requests.push_back(path);
+        return requests.size() - 1;
+    }
+
+    // Telemetry of an image, decoded or not, with the time its GL calls took
+    static void RecordImage(const DecodedImage& image, const std::string& path, double uploadMilliseconds) {
+
+        LoadTelemetry& telemetry = LoadTelemetry::Current();
+        LoadAsset asset = telemetry.NewAsset(LOAD_ASSET_TEXTURE, path);
+        asset.cached = image.fromCache;
+        asset.startMilliseconds = image.decodeStart;
+        asset.parseMilliseconds = image.decodeMilliseconds;
+        asset.uploadMilliseconds = uploadMilliseconds;
+        asset.milliseconds = image.decodeMilliseconds + uploadMilliseconds;
+        asset.bytesRead = image.bytesRead;
+        // the driver's mip chain of an uncompressed image takes another third
+        if (image.cooked) {
+            asset.gpuBytes = image.cooked->data.size();
+        }
+        else if (image.pixels) {
+            asset.gpuBytes = (uint64_t)image.width * image.height * 4 * 4 / 3;
+        }
+        telemetry.AddAsset(asset);
+    }
+
+    // Creates the texture objects of a batch from the staged pixel unpack buffer
+    static void UploadBatch(const std::vector<DecodedImage>& batch, const std::vector<std::string>& paths,
+        GLuint pixelBuffer, const std::function<void(size_t, GLuint)>& onUploaded) {
+
+        size_t totalBytes = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            totalBytes += StagedBytes(batch[i]);
+        }
+
+        double stagingStart = LoadTelemetry::Now();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+        // orphan the previous batch so the driver does not have to wait for it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, totalBytes, NULL, GL_STREAM_DRAW);
+        unsigned char* staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalBytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        size_t offset = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+
+            size_t size = StagedBytes(batch[i]);
+            if (staging) {
+                memcpy(staging + offset, batch[i].cooked ? batch[i].cooked->data.data() : batch[i].pixels, size);
+            }
+            offset += size;
+        }
+
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        double stagingMilliseconds = LoadTelemetry::Now() - stagingStart;
+
+        offset = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+
+            const DecodedImage& image = batch[i];
+            double uploadStart = LoadTelemetry::Now();
+
+            // NPOT check
+            if ((image.width & (image.width - 1)) != 0 || (image.height & (image.height - 1)) != 0) {
+                fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", paths[image.slot].c_str());
+            }
+
+            GLuint textureID;
+            glGenTextures(1, &textureID);
+            glBindTexture(GL_TEXTURE_2D, textureID);
+            GLInterceptor::Current().NoteBindTexture(GL_TEXTURE_2D, textureID);
+
+            // the pixels come from the bound unpack buffer, the pointer is an offset into it -
+            // if mapping failed they are read from client memory instead
+            const unsigned char* source = staging ? (const unsigned char*)offset :
+                (image.cooked ? image.cooked->data.data() : image.pixels);
+            if (!staging) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            if (image.cooked) {
+
+                // the cooked mip chain is uploaded as is, the driver neither compresses nor filters
+                GLenum format = image.cooked->format == COOKED_TEXTURE_BC3 ?
+                    GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+                const std::vector<CookedMipLevel>& levels = image.cooked->levels;
+
+                for (size_t level = 0; level < levels.size(); level++) {
+                    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format, levels[level].width, levels[level].height,
+                        0, (GLsizei)levels[level].size, source + levels[level].offset);
+                }
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+            }
+            else {
+
+                glTexImage2D(
+                    GL_TEXTURE_2D,
+                    0,
+                    GL_SRGB, //GL_SRGB,//GL_RGBA,
+                    image.width,
+                    image.height,
+                    0,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    source
+                );
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            GLInterceptor::Current().NoteBindTexture(GL_TEXTURE_2D, 0);
+
+            if (!staging) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+            }
+
+            // the staging copy is shared out by size
+            double staging = totalBytes > 0 ? stagingMilliseconds * StagedBytes(image) / totalBytes : 0.0;
+            RecordImage(image, paths[image.slot], LoadTelemetry::Now() - uploadStart + staging);
+
+            offset += StagedBytes(image);
+            onUploaded(image.slot, textureID);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    void TextureLoader::Finish(const std::function<void(size_t slot, GLuint textureId)>& onUploaded) {
+
+        GPS_CPU_ZONE("TextureLoader::Finish");
+
+        if (requests.empty()) {
+            return;
+        }
+
+        std::mutex readyMutex;
+        std::condition_variable readyChanged;
+        std::deque<DecodedImage> ready;
+
+        // GLEW's extension flags are plain globals, read once here on the GL thread
+        bool useCooked = SupportsCookedTextures();
+
+        ThreadPool& pool = ThreadPool::Shared();
+        for (size_t i = 0; i < requests.size(); i++) {
+
+            const std::string* path = &requests[i];
+            pool.Run([&, path, i] {
+
+                GPS_CPU_ZONE("decode texture");
+                DecodedImage image;
+                image.slot = i;
+                image.pixels = NULL;
+                image.cooked = NULL;
+                image.fromCache = false;
+                image.decodeStart = LoadTelemetry::Now();
+                image.bytesRead = LoadTelemetry::FileSize(*path);
+
+                // images are stored top row first, GL expects the bottom row first
+                if (useCooked) {
+                    CookedTexture* cooked = new CookedTexture();
+                    bool cookedNow = false;
+                    if (LoadOrCookTexture(*path, true, cooked, &cookedNow)) {
+                        image.cooked = cooked;
+                        image.fromCache = !cookedNow;
+                        if (image.fromCache) {
+                            image.bytesRead = LoadTelemetry::FileSize(CookedTexturePathFor(*path));
+                        }
+                        image.width = cooked->width;
+                        image.height = cooked->height;
+                    }
+                    else {
+                        delete cooked;
+                    }
+                }
+
+                if (!image.cooked) {
+                    stbi_set_flip_vertically_on_load_thread(1);
+                    int n;
+                    image.pixels = stbi_load(path->c_str(), &image.width, &image.height, &n, 4);
+                }
+                image.decodeMilliseconds = LoadTelemetry::Now() - image.decodeStart;
+
+                std::lock_guard<std::mutex> lock(readyMutex);
+                ready.push_back(image);
+                readyChanged.notify_one();
+            });
+        }
+
+        GLuint pixelBuffer;
+        glGenBuffers(1, &pixelBuffer);
+
+        size_t finished = 0;
+        while (finished < requests.size()) {
+
+            std::deque<DecodedImage> decoded;
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyChanged.wait(lock, [&] { return !ready.empty(); });
+                decoded.swap(ready);
+            }
+
+            // upload whatever is decoded so far, in batches bounded by TEXTURE_BATCH_BYTES
+            std::vector<DecodedImage> batch;
+            size_t batchBytes = 0;
+
+            for (size_t i = 0; i < decoded.size(); i++) {
+
+                if (!decoded[i].pixels && !decoded[i].cooked) {
+                    fprintf(stderr, "ERROR: could not load %s\n", requests[decoded[i].slot].c_str());
+                    RecordImage(decoded[i], requests[decoded[i].slot], 0.0);
+                    onUploaded(decoded[i].slot, 0);
+                    continue;
+                }
+
+                size_t size = StagedBytes(decoded[i]);
+                if (!batch.empty() && batchBytes + size > TEXTURE_BATCH_BYTES) {
+                    UploadBatch(batch, requests, pixelBuffer, onUploaded);
+                    for (size_t b = 0; b < batch.size(); b++) {
+                        ReleaseImage(batch[b]);
+                    }
+                    batch.clear();
+                    batchBytes = 0;
+                }
+
+                batch.push_back(decoded[i]);
+                batchBytes += size;
+            }
+
+            if (!batch.empty()) {
+                UploadBatch(batch, requests, pixelBuffer, onUploaded);
+                for (size_t b = 0; b < batch.size(); b++) {
+                    ReleaseImage(batch[b]);
+                }
+            }
+
+            finished += decoded.size();
+        }
+
+        glDeleteBuffers(1, &pixelBuffer);
+        requests.clear();
+    }
+}
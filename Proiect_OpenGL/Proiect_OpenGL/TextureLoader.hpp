@@ -0,0 +1,40 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Collects image files while a model is parsed, decodes them on the shared thread pool
+    // and uploads them on the GL thread in batches through a pixel unpack buffer.
+    // Where S3TC is supported the workers read (or cook) the block compressed .gpstex
+    // container of each image instead of decoding it.
+    class TextureLoader {
+
+    public:
+        // Queues an image file, returns the slot reported back once it is uploaded
+        size_t Request(const std::string& path);
+
+        // Decodes every queued image and uploads each batch as soon as it is decoded.
+        // Must be called on the thread owning the GL context.
+        void Finish(const std::function<void(size_t slot, GLuint textureId)>& onUploaded);
+
+        // True if the context can sample the sRGB S3TC formats the cooker produces
+        static bool SupportsCookedTextures();
+
+    private:
+        std::vector<std::string> requests;
+    };
+}
+
+#endif /* TextureLoader_hpp */
@@ -0,0 +1,113 @@
+#include "ThreadPool.hpp"
+#include "CpuProfiler.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned threadCount) : pendingTasks(0), stopping(false) {
+
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    void ThreadPool::Run(std::function<void()> task) {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(task);
+            pendingTasks++;
+        }
+        taskAvailable.notify_one();
+    }
+
+    void ThreadPool::Wait() {
+
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [this] { return pendingTasks == 0; });
+    }
+
+    void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body) {
+
+        // own completion counter, so other work queued on the pool is not waited for
+        std::mutex doneMutex;
+        std::condition_variable doneSignal;
+        size_t remaining = count;
+
+        for (size_t i = 0; i < count; i++) {
+
+            Run([&, i] {
+                body(i);
+
+                std::lock_guard<std::mutex> lock(doneMutex);
+                remaining--;
+                if (remaining == 0) {
+                    doneSignal.notify_all();
+                }
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneSignal.wait(lock, [&] { return remaining == 0; });
+    }
+
+    unsigned ThreadPool::getThreadCount() const {
+        return (unsigned)workers.size();
+    }
+
+    ThreadPool& ThreadPool::Shared() {
+
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::WorkerLoop() {
+
+        CpuProfiler::SetThreadName("worker");
+
+        for (;;) {
+
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = tasks.front();
+                tasks.pop_front();
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pendingTasks--;
+                if (pendingTasks == 0) {
+                    allDone.notify_all();
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads consuming a FIFO of tasks
+    class ThreadPool {
+
+    public:
+        // 0 threads = one per hardware thread
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        // Queues a task, it runs on one of the workers
+        void Run(std::function<void()> task);
+
+        // Blocks until every queued task has finished - must not be called from a worker
+        void Wait();
+
+        // Runs body(0) ... body(count - 1) on the workers and waits for all of them
+        void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+        unsigned getThreadCount() const;
+
+        // Pool shared by the loaders
+        static ThreadPool& Shared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > tasks;
+        std::mutex mutex;
+        std::condition_variable taskAvailable;
+        std::condition_variable allDone;
+        size_t pendingTasks;
+        bool stopping;
+
+        void WorkerLoop();
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+}
+
+#endif /* ThreadPool_hpp */
@@ -2,9 +2,12 @@
 
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, bool hidden) {
         if (!glfwInit()) {
-            throw std::runtime_error("Could not start GLFW3!");
+            //GLFW 3.3 has no display-less platform, only the context below can be headless
+            throw std::runtime_error(hidden ?
+                "Could not start GLFW3! The hidden benchmark window still needs a display, e.g. run under xvfb-run" :
+                "Could not start GLFW3!");
         }
 
         //window hints
@@ -22,14 +25,26 @@ namespace gps {
         //for antialising
         glfwWindowHint(GLFW_SAMPLES, 4);
 
+        if (hidden) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
         this->window = glfwCreateWindow(width, height, title, NULL, NULL);
+
+        //software stand-ins for machines without a GPU driver
+        const int fallbackApis[] = { GLFW_OSMESA_CONTEXT_API, GLFW_EGL_CONTEXT_API };
+        for (int i = 0; hidden && !this->window && i < 2; i++) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, fallbackApis[i]);
+            this->window = glfwCreateWindow(width, height, title, NULL, NULL);
+        }
         if (!this->window) {
             throw std::runtime_error("Could not create GLFW3 window!");
         }
 
         glfwMakeContextCurrent(window);
 
-        glfwSwapInterval(1);
+        //a benchmark measures the frames, not the refresh rate
+        glfwSwapInterval(hidden ? 0 : 1);
 
 #if not defined (__APPLE__)
         // start GLEW extension handler
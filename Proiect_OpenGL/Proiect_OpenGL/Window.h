@@ -24,7 +24,9 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // hidden opens an invisible window with vsync off, for runs nobody watches; where no display
+        // can be reached the context is asked of OSMesa and then of EGL instead
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool hidden=false);
         void Delete();
 
         GLFWwindow* getWindow();
@@ -17,11 +17,28 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
-#include "Skybox.hpp"
+#include "GLState.hpp"
+#include "RenderQueue.hpp"
+#include "ObjParser.hpp"
+#include "TextureCooker.hpp"
+#include "SkyBox.hpp"
+#include "ShadowCascades.hpp"
+#include "InstancedModel.hpp"
+#include "OcclusionCuller.hpp"
+#include "Benchmark.hpp"
+#include "GpuProfiler.hpp"
+#include "CpuProfiler.hpp"
+#include "GLInterceptor.hpp"
+#include "LoadTelemetry.hpp"
 
 #include <iostream>
 
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
 #include <string>
 
 // window
@@ -38,14 +55,17 @@ GLfloat lightVerticalMovement = 0.0f;
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-GLint fogDensityLoc;
+// shader uniform handles
+gps::UniformHandle modelLoc;
+gps::UniformHandle viewLoc;
+gps::UniformHandle projectionLoc;
+gps::UniformHandle normalMatrixLoc;
+gps::UniformHandle lightDirLoc;
+gps::UniformHandle lightColorLoc;
+gps::UniformHandle fogDensityLoc;
+gps::UniformHandle lightSpaceTrMatricesLoc[gps::SHADOW_CASCADE_COUNT];
+gps::UniformHandle cascadeSplitsLoc;
+gps::UniformHandle cascadeBiasesLoc;
 
 // camera
 gps::Camera myCamera(
@@ -64,13 +84,63 @@ gps::Model3D mediv_scene;
 gps::Model3D modelElice;
 gps::Model3D modelEagle;
 
+// draws of the current frame, sorted by state
+gps::RenderQueue renderQueue;
+
+// stress scene of instanced props, enabled with --stress <count>
+size_t stressInstanceCount = 0;
+gps::Model3D stressTree;
+gps::Model3D stressWell;
+gps::InstanceBuffer instanceBuffer;
+gps::InstancedModel instancedTrees;
+gps::InstancedModel instancedWells;
+
+// meshes kept by frustum culling, per pass
+gps::CullStats shadowCullStats;
+gps::CullStats mainCullStats;
+
+// levels of detail, disabled with --no-lod; a coarser level is drawn while its error stays under
+// this many pixels, the shadow passes accept more since their texels grow with the distance anyway
+const float LOD_PIXEL_ERROR = 1.0f;
+const float SHADOW_LOD_PIXEL_ERROR = 4.0f;
+bool lodEnabled = true;
+gps::LodStats shadowLodStats;
+gps::LodStats mainLodStats;
+
+// software occlusion culling of the main pass, disabled with --no-occlusion; the scene meshes with a
+// bounding sphere of at least OCCLUDER_MIN_RADIUS are rasterized on the CPU and hide what is behind them
+const int OCCLUSION_BUFFER_WIDTH = 256;
+const int OCCLUSION_BUFFER_HEIGHT = 144;
+const float OCCLUDER_MIN_RADIUS = 1.0f;
+bool occlusionEnabled = true;
+gps::OcclusionCuller occlusionCuller;
+
+// scripted run in a hidden window, enabled with --benchmark <script.json>
+bool benchmarkMode = false;
+gps::BenchmarkScript benchmarkScript;
+// GPU profiler zone around a whole benchmark frame, its time is the frame's GPU time
+const char* const BENCHMARK_FRAME_ZONE = "frame";
+
+// CPU zones are recorded from the start with --trace <file.json>, written there with T and at exit
+std::string traceFile;
+
+// GL calls counted per frame with --gl-stats [N], their table printed every N frames and at exit
+bool glStatsEnabled = false;
+uint32_t glStatsInterval = 600;
+
+// startup stages and asset loads, summed up at the first frame and written as JSON with --load-report <file.json>
+std::string loadReportFile;
+
 //GLfloats
 GLfloat angle;
 GLfloat modelEagleAngle = 0.0f;
+glm::mat4 modelEagleAngleMatrix;
 
 // shaders
 gps::Shader myBasicShader;
 gps::Shader waterShader;
+gps::Shader instancedShader;
+gps::Shader depthMapInstancedShader;
 
 gps::SkyBox mySkyBox;
 gps::Shader skyboxShader;
@@ -97,10 +167,11 @@ float fogDensity = 0.0f;
 
 
 //shadows 
-GLuint shadowMapFBO;
-GLuint depthMapTexture;
-const unsigned int SHADOW_WIDTH = 2048;
-const unsigned int SHADOW_HEIGHT = 2048;
+// 4 layers of 1024 hold as many texels as the single 2048 map they replace
+const GLsizei SHADOW_CASCADE_RESOLUTION = 1024;
+// the cascades cover the view up to this distance, nothing is shadowed beyond it
+const float SHADOW_DISTANCE = 30.0f;
+gps::ShadowCascades shadowCascades;
 gps::Shader depthMapShader;
 glm::mat3 lightDirMatrix;
 GLuint lightDirMatrixLoc;
@@ -109,10 +180,17 @@ int retina_width, retina_height;
 //for animation 
 int stop = 0;
 
+// glGetError, counted by --gl-stats
+GLenum getGLError() {
+	GLenum errorCode = glGetError();
+	gps::GLInterceptor::Current().NoteCall(gps::GL_CALL_GetError);
+	return errorCode;
+}
+
 GLenum glCheckError_(const char* file, int line)
 {
 	GLenum errorCode;
-	while ((errorCode = glGetError()) != GL_NO_ERROR) {
+	while ((errorCode = getGLError()) != GL_NO_ERROR) {
 		std::string error;
 		switch (errorCode) {
 		case GL_INVALID_ENUM:
@@ -165,7 +243,7 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
 	myCamera.rotate(pitch, yaw);
 	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	myBasicShader.set(viewLoc, view);
 	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 
 }
@@ -175,17 +253,17 @@ void viewModes(GLFWwindow* window, int key, int action) {
 
 	// view edges between vertices ( lines )
 	if (pressedKeys[GLFW_KEY_L]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		gps::GLState::Current().SetPolygonMode(GL_LINE);
 	}
 
 	// view vertices ( points )
 	if (pressedKeys[GLFW_KEY_P]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+		gps::GLState::Current().SetPolygonMode(GL_POINT);
 	}
 
 	// default view
 	if (pressedKeys[GLFW_KEY_N]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		gps::GLState::Current().SetPolygonMode(GL_FILL);
 	}
 
 	// fullscreen
@@ -215,10 +293,10 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 
 	aspectRatio = (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height;
 	projection = glm::perspective(glm::radians(fov), aspectRatio, 0.1f, 100.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	myBasicShader.set(projectionLoc, projection);
 
 	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+	gps::GLInterceptor::Current().NoteCall(gps::GL_CALL_Viewport);
 }
 
 
@@ -230,10 +308,10 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
 
 	aspectRatio = (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height;
 	projection = glm::perspective(glm::radians(fov), aspectRatio, 0.1f, 20.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	myBasicShader.set(projectionLoc, projection);
 
 	glViewport(0, 0, width, height);
+	gps::GLInterceptor::Current().NoteCall(gps::GL_CALL_Viewport);
 
 }
 
@@ -246,13 +324,18 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 	// swap between view modes of scene
 	viewModes(window, key, action);
 
+	// dump the CPU zones recorded so far
+	if (action == GLFW_PRESS && key == GLFW_KEY_T && !traceFile.empty()) {
+		gps::CpuProfiler::WriteTrace(traceFile);
+	}
+
 	// reset position of camera
 	if (action == GLFW_PRESS && key == GLFW_KEY_R) {
 		myCamera.resetPozition();
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 	}
 
 	// other keys
@@ -267,6 +350,7 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 }
 
 void processCameraSpeed() {
+	GPS_CPU_ZONE("processCameraSpeed");
 	currentTime = glfwGetTime();
 	deltaTime = currentTime - lastTime;
 	lastTime = currentTime;
@@ -275,69 +359,119 @@ void processCameraSpeed() {
 	cameraSpeed = baseCameraSpeed * aspectRatio * deltaTime;
 }
 
+// the camera stops this far from the scene geometry
+const float CAMERA_COLLISION_RADIUS = 0.2f;
+
+// Closest hit of a world space ray on the static scene
+bool raycastScene(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, gps::RayHit* hit) {
+	// same model matrix as drawObjects; the distance along direction is the same in object space
+	glm::mat4 sceneModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 worldToObject = glm::inverse(sceneModel);
+	glm::vec3 objectOrigin = glm::vec3(worldToObject * glm::vec4(origin, 1.0f));
+	glm::vec3 objectDirection = glm::vec3(worldToObject * glm::vec4(direction, 0.0f));
+
+	if (!mediv_scene.Raycast(objectOrigin, objectDirection, maxDistance, hit)) {
+		return false;
+	}
+	hit->position = origin + direction * hit->distance;
+	return true;
+}
+
+// Moves the camera unless the step would take it into the scene
+void moveCamera(gps::MOVE_DIRECTION direction) {
+	glm::vec3 from = myCamera.getCameraPosition();
+	myCamera.move(direction, cameraSpeed);
+
+	glm::vec3 step = myCamera.getCameraPosition() - from;
+	float length = glm::length(step);
+	gps::RayHit hit;
+	if (length > 0.0f && raycastScene(from, step / length, length + CAMERA_COLLISION_RADIUS, &hit)) {
+		myCamera.move(direction, -cameraSpeed);
+	}
+}
+
+// Left click picks the mesh under the crosshair
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) {
+		return;
+	}
+
+	gps::RayHit hit;
+	if (raycastScene(myCamera.getCameraPosition(), myCamera.getCameraFrontDirection(), 1000.0f, &hit)) {
+		fprintf(stdout, "picked mesh %u, triangle %u at distance %.2f (%.2f, %.2f, %.2f)\n",
+			hit.mesh, hit.triangle, hit.distance, hit.position.x, hit.position.y, hit.position.z);
+	}
+	else {
+		fprintf(stdout, "picked nothing\n");
+	}
+}
+
 void processMovement() {
+	GPS_CPU_ZONE("processMovement");
 	if (pressedKeys[GLFW_KEY_W]) {
-		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
+		moveCamera(gps::MOVE_FORWARD);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_S]) {
-		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
+		moveCamera(gps::MOVE_BACKWARD);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
-		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
+		moveCamera(gps::MOVE_LEFT);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
-		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
+		moveCamera(gps::MOVE_RIGHT);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_SPACE]) {
-		myCamera.move(gps::MOVE_UP, cameraSpeed);
+		moveCamera(gps::MOVE_UP);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_LEFT_ALT]) {
-		myCamera.move(gps::MOVE_DOWN, cameraSpeed);
+		moveCamera(gps::MOVE_DOWN);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_Q]) {
 		angle -= 1.0f;
+		// the casters moved under unchanged cascades
+		shadowCascades.Invalidate();
 		// update model matrix for teapot
 		model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
 		// update normal matrix for teapot
@@ -346,6 +480,7 @@ void processMovement() {
 
 	if (pressedKeys[GLFW_KEY_E]) {
 		angle += 1.0f;
+		shadowCascades.Invalidate();
 		// update model matrix for teapot
 		model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
 		// update normal matrix for teapot
@@ -377,13 +512,19 @@ void processMovement() {
 		lightRotationAngle += 0.01f;
 		glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(lightRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 		lightDir = glm::vec3(rotationMatrix * glm::vec4(lightDir, 1.0f));
-		glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
+		myBasicShader.set(lightDirLoc, lightDir);
 	}
 
 }
 
 void initOpenGLWindow() {
-	myWindow.Create(1920, 1080, "OpenGL Project Core");
+	gps::LoadStage stage("initOpenGLWindow");
+	if (benchmarkMode) {
+		myWindow.Create(benchmarkScript.width, benchmarkScript.height, "OpenGL Project Benchmark", true);
+	}
+	else {
+		myWindow.Create(1920, 1080, "OpenGL Project Core");
+	}
 }
 
 void setWindowCallbacks() {
@@ -391,27 +532,36 @@ void setWindowCallbacks() {
 	glfwSetKeyCallback(myWindow.getWindow(), keyboardCallback);
 	glfwSetCursorPosCallback(myWindow.getWindow(), mouseCallback);
 	glfwSetScrollCallback(myWindow.getWindow(), scrollCallback);
+	glfwSetMouseButtonCallback(myWindow.getWindow(), mouseButtonCallback);
 	glfwSetInputMode(myWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
 void initOpenGLState() {
+	gps::LoadStage stage("initOpenGLState");
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
 	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 	glEnable(GL_FRAMEBUFFER_SRGB);
-	glEnable(GL_DEPTH_TEST); // enable depth-testing
-	glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+	gps::GLState::Current().SetDepthTest(true); // enable depth-testing
+	gps::GLState::Current().SetDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
 	glEnable(GL_CULL_FACE); // cull face
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 }
 
 void initModels() {
+	GPS_CPU_ZONE("initModels");
+	gps::LoadStage stage("initModels");
 	mediv_scene.LoadModel("models/medieval_scene/medieval_scene_finaly.obj");
 	modelElice.LoadModel("models/medieval_scene/elice.obj");
 	modelEagle.LoadModel("models/medieval_scene/eagle2.obj");
 }
 
 void initShaders() {
+	GPS_CPU_ZONE("initShaders");
+	gps::LoadStage stage("initShaders");
+	// compare a cold start (no .gpsprog files) with a warm one to see what the binary cache saves
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
 	myBasicShader.loadShader(
 		"shaders/basic.vert",
 		"shaders/basic.frag");
@@ -425,49 +575,115 @@ void initShaders() {
 		"shaders/skyboxShader.vert",
 		"shaders/skyboxShader.frag");
 	skyboxShader.useShaderProgram();
+
+	std::cout << "Shaders ready in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+		<< " ms" << std::endl;
 }
 
 void initUniforms() {
+	gps::LoadStage stage("initUniforms");
 	myBasicShader.useShaderProgram();
 
 	// create model matrix for teapot
 	model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
+	modelLoc = myBasicShader.getUniform("model");
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
+	viewLoc = myBasicShader.getUniform("view");
 	// send view matrix to shader
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+	myBasicShader.set(viewLoc, view);
 
 	// compute normal matrix for teapot
 	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
+	normalMatrixLoc = myBasicShader.getUniform("normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(fov),
 		(float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
 		0.1f, 100.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
+	projectionLoc = myBasicShader.getUniform("projection");
 	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	myBasicShader.set(projectionLoc, projection);
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(1.0f, 1.0f, 1.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
+	lightDirLoc = myBasicShader.getUniform("lightDir");
 
 
 	//set light color
 	lightColor = glm::vec3(1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
+	lightColorLoc = myBasicShader.getUniform("lightColor");
 	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
+	myBasicShader.set(lightColorLoc, lightColor);
 
 	//send fordDensity to shader
-	fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
+	fogDensityLoc = myBasicShader.getUniform("fogDensity");
+
+	//one light space matrix per shadow cascade
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		std::string name = "lightSpaceTrMatrices[" + std::to_string(cascade) + "]";
+		lightSpaceTrMatricesLoc[cascade] = myBasicShader.getUniform(name.c_str());
+	}
+	cascadeSplitsLoc = myBasicShader.getUniform("cascadeSplits");
+	cascadeBiasesLoc = myBasicShader.getUniform("cascadeBiases");
+}
+
+// Scatters count trees and wells on a jittered grid around the scene, one well for every four trees
+void initStressScene(size_t count) {
+	GPS_CPU_ZONE("initStressScene");
+	gps::LoadStage stage("initStressScene");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	stressTree.LoadModel("models/tree/pinetree7.obj");
+	stressWell.LoadModel("models/well/well.obj");
+	instancedTrees.Init(stressTree, instanceBuffer);
+	instancedWells.Init(stressWell, instanceBuffer);
+
+	// both models are scaled to a fixed height and stood on y = 0
+	const float TREE_HEIGHT = 3.0f;
+	const float WELL_HEIGHT = 1.5f;
+	const float SPACING = 2.5f;
+	gps::BoundingBox treeBounds = stressTree.getBounds();
+	gps::BoundingBox wellBounds = stressWell.getBounds();
+	float treeScale = TREE_HEIGHT / glm::max(treeBounds.max.y - treeBounds.min.y, 1e-3f);
+	float wellScale = WELL_HEIGHT / glm::max(wellBounds.max.y - wellBounds.min.y, 1e-3f);
+
+	// the same seed gives the same scene on every run, so benchmarks compare
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> jitter(-0.4f, 0.4f);
+	std::uniform_real_distribution<float> turn(0.0f, glm::radians(360.0f));
+
+	size_t side = (size_t)std::ceil(std::sqrt((double)count));
+	std::vector<glm::mat4> trees;
+	std::vector<glm::mat4> wells;
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 position(((float)(i % side) - side * 0.5f + jitter(random)) * SPACING, 0.0f,
+			((float)(i / side) - side * 0.5f + jitter(random)) * SPACING);
+		bool well = i % 5 == 4;
+		float scale = well ? wellScale : treeScale;
+		float bottom = well ? wellBounds.min.y : treeBounds.min.y;
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), position - glm::vec3(0.0f, bottom * scale, 0.0f));
+		transform = glm::rotate(transform, turn(random), glm::vec3(0.0f, 1.0f, 0.0f));
+		transform = glm::scale(transform, glm::vec3(scale));
+		(well ? wells : trees).push_back(transform);
+	}
+	instancedTrees.SetInstances(trees);
+	instancedWells.SetInstances(wells);
+
+	instancedShader.loadShader("shaders/instanced.vert", "shaders/basic.frag");
+	depthMapInstancedShader.loadShader("shaders/shadowsInstanced.vert", "shaders/shadows.frag");
+
+	std::cout << "Stress scene : " << trees.size() << " trees and " << wells.size() << " wells in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+		<< " ms" << std::endl;
 }
 
 void initSkybox() {
+	GPS_CPU_ZONE("initSkybox");
+	gps::LoadStage stage("initSkybox");
 	std::vector<const GLchar*> faces;
 	faces.push_back("skybox/miramar_rt.tga");
 	faces.push_back("skybox/miramar_lf.tga");
@@ -478,96 +694,212 @@ void initSkybox() {
 	mySkyBox.Load(faces);
 }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
+// Camera the levels of detail of a model are chosen for, in the object space of modelMatrix
+gps::LodView lodViewFor(bool depthPass, const glm::mat4& modelMatrix) {
+	gps::LodView lod;
+	lod.eye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(myCamera.getCameraPosition(), 1.0f));
+	lod.pixelsPerUnit = projection[1][1] * myWindow.getWindowDimensions().height * 0.5f;
+	lod.maxPixelError = depthPass ? SHADOW_LOD_PIXEL_ERROR : LOD_PIXEL_ERROR;
+	lod.slot = depthPass ? gps::LOD_SLOT_SHADOW : gps::LOD_SLOT_MAIN;
+	lod.stats = depthPass ? &shadowLodStats : &mainLodStats;
+	return lod;
+}
 
-	shader.useShaderProgram();
+// Queues the models drawn in a pass, returns how many meshes passed culling
+uint64_t drawObjects(gps::Shader& shader, gps::RenderPass pass) {
+	GPS_CPU_ZONE("drawObjects");
 
 	model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
-	// do not send the normal matrix if we are rendering in the depth map
+	// the depth map does not use the normal matrix
+	bool depthPass = pass != gps::PASS_MAIN;
 	if (!depthPass) {
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
-	mediv_scene.Draw(shader);
-	modelElice.Draw(shader);
+	// the static shadow layers hold the scene, the dynamic ones the moving models
+	bool dynamicPass = depthPass && pass >= gps::PASS_SHADOW_DYNAMIC;
+	int cascade = dynamicPass ? pass - gps::PASS_SHADOW_DYNAMIC : pass - gps::PASS_SHADOW;
+
+	// only queued here, drawn when renderModels submits the pass
+	uint32_t transform = renderQueue.AddTransform(model, normalMatrix);
+
+	// the mesh bounds are tested in object space against the casters of the cascade or the camera frustum
+	gps::Frustum frustum = depthPass ? gps::Frustum(shadowCascades.getCasterMatrix(cascade) * model)
+		: gps::Frustum(projection * view * model);
+	gps::CullStats& cullStats = depthPass ? shadowCullStats : mainCullStats;
+	uint64_t visibleBefore = cullStats.visible;
+	gps::LodView lod = lodViewFor(depthPass, model);
+	const gps::LodView* sceneLod = lodEnabled ? &lod : NULL;
+	// the camera's occluders are drawn once, before the main pass is queued; they say nothing about the light
+	gps::OcclusionTest occlusion;
+	const gps::OcclusionTest* sceneOcclusion = NULL;
+	if (!depthPass && occlusionEnabled) {
+		occlusion.culler = &occlusionCuller;
+		occlusion.objectToClip = projection * view * model;
+		occlusionCuller.Begin();
+		mediv_scene.DrawOccluders(occlusionCuller, occlusion.objectToClip, OCCLUDER_MIN_RADIUS);
+		occlusionCuller.Finish();
+		sceneOcclusion = &occlusion;
+	}
+	if (!dynamicPass) {
+		mediv_scene.Submit(renderQueue, pass, shader, transform, frustum, cullStats, sceneLod, sceneOcclusion);
+	}
+	if (dynamicPass || !depthPass) {
+		modelElice.Submit(renderQueue, pass, shader, transform, frustum, cullStats, sceneLod, sceneOcclusion);
+	}
+	// the props never move, they live in the static shadow layers
+	if (stressInstanceCount > 0 && !dynamicPass) {
+		gps::Frustum worldFrustum = depthPass ? gps::Frustum(shadowCascades.getCasterMatrix(cascade)) : gps::Frustum(projection * view);
+		gps::Shader& instanced = depthPass ? depthMapInstancedShader : instancedShader;
+		uint32_t worldTransform = renderQueue.AddTransform(glm::mat4(1.0f), glm::mat3(glm::inverseTranspose(view)));
+		gps::LodView worldLod = lodViewFor(depthPass, glm::mat4(1.0f));
+		gps::OcclusionTest worldOcclusion = { &occlusionCuller, projection * view };
+		const gps::OcclusionTest* propOcclusion = sceneOcclusion != NULL ? &worldOcclusion : NULL;
+		instancedTrees.Submit(renderQueue, pass, instanced, worldTransform, worldFrustum, cullStats, lodEnabled ? &worldLod : NULL, propOcclusion);
+		instancedWells.Submit(renderQueue, pass, instanced, worldTransform, worldFrustum, cullStats, lodEnabled ? &worldLod : NULL, propOcclusion);
+	}
+	// the main pass eagle is queued by renderScene
+	if (dynamicPass) {
+		gps::LodView eagleLod = lodViewFor(true, modelEagleAngleMatrix);
+		modelEagle.Submit(renderQueue, pass, shader, renderQueue.AddTransform(modelEagleAngleMatrix, normalMatrix),
+			gps::Frustum(shadowCascades.getCasterMatrix(cascade) * modelEagleAngleMatrix), cullStats, lodEnabled ? &eagleLod : NULL);
+	}
 
 	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
 	model = glm::scale(model, glm::vec3(0.5f));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
+	return cullStats.visible - visibleBefore;
 }
 
-void initFBO()
-{
-	glGenFramebuffers(1, &shadowMapFBO);
-	//create depth texture for FBO
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	//attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture,
-		0);
-
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// World space box around the shadow casters, same model matrices as drawObjects
+gps::BoundingBox computeSceneBounds() {
+	glm::mat4 sceneModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+	gps::BoundingBox objectBounds = mediv_scene.getBounds();
+	gps::BoundingBox eliceBounds = modelElice.getBounds();
+	objectBounds.min = glm::min(objectBounds.min, eliceBounds.min);
+	objectBounds.max = glm::max(objectBounds.max, eliceBounds.max);
+
+	// the eagle spins around y, bound the whole circle it sweeps so the cascades do not follow it
+	gps::BoundingBox eagleBounds = modelEagle.getBounds();
+	float eagleRadius = 0.0f;
+	for (int corner = 0; corner < 4; corner++) {
+		glm::vec2 point((corner & 1) ? eagleBounds.max.x : eagleBounds.min.x, (corner & 2) ? eagleBounds.max.z : eagleBounds.min.z);
+		eagleRadius = glm::max(eagleRadius, glm::length(point));
+	}
 
+	gps::BoundingBox bounds;
+	bounds.min = glm::vec3(-eagleRadius, eagleBounds.min.y, -eagleRadius);
+	bounds.max = glm::vec3(eagleRadius, eagleBounds.max.y, eagleRadius);
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 point((corner & 1) ? objectBounds.max.x : objectBounds.min.x,
+			(corner & 2) ? objectBounds.max.y : objectBounds.min.y,
+			(corner & 4) ? objectBounds.max.z : objectBounds.min.z);
+		glm::vec3 world = glm::vec3(sceneModel * glm::vec4(point, 1.0f));
+		bounds.min = glm::min(bounds.min, world);
+		bounds.max = glm::max(bounds.max, world);
+	}
+
+	if (stressInstanceCount > 0) {
+		bounds.min = glm::min(bounds.min, glm::min(instancedTrees.getBounds().min, instancedWells.getBounds().min));
+		bounds.max = glm::max(bounds.max, glm::max(instancedTrees.getBounds().max, instancedWells.getBounds().max));
+	}
+	return bounds;
 }
 
-glm::mat4 computeLightSpaceTrMatrix() {
-	glm::mat4 lightView = glm::lookAt(lightDir, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	const GLfloat near_plane = 0.1f, far_plane = 15.0f;
-	glm::mat4 lightProjection = glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, near_plane, far_plane);
-	glm::mat4 lightSpaceTrMatrix = lightProjection * lightView;
-	return lightSpaceTrMatrix;
+// The instanced props share basic.frag, so they get the same per frame uniforms as myBasicShader
+void setInstancedUniforms() {
+	instancedShader.set("view", view);
+	instancedShader.set("projection", projection);
+	instancedShader.set("lightDir", lightDir);
+	instancedShader.set("lightColor", lightColor);
+	instancedShader.set("fogDensity", fogDensity);
+	instancedShader.set("shadowMap", 3);
+	instancedShader.set("dynamicShadowMap", 4);
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		std::string name = "lightSpaceTrMatrices[" + std::to_string(cascade) + "]";
+		instancedShader.set(name.c_str(), shadowCascades.getLightSpaceMatrix(cascade));
+	}
+	instancedShader.set("cascadeSplits", shadowCascades.getSplits());
+	instancedShader.set("cascadeBiases", shadowCascades.getBiases());
 }
 
-void renderModels(gps::Shader shader) {
+void renderModels(gps::Shader& shader) {
+	GPS_CPU_ZONE("renderModels");
 	// select active shader program
 	shader.useShaderProgram();
 
 	//send teapot model matrix data to shader
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	shader.set("model", model);
 
 	//send teapot normal matrix data to shader
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	shader.set("normalMatrix", normalMatrix);
 
 	//draw the skyBox
-	skyboxShader.useShaderProgram();
-	mySkyBox.Draw(skyboxShader, view, projection);
+	{
+		GPS_GPU_ZONE("skybox");
+		gps::DrawContext skyboxContext(skyboxShader);
+		mySkyBox.Draw(skyboxContext, view, projection);
+	}
+
 
+	//queue the scene for the cascades that changed and the main pass, the camera is final for this frame;
+	//the static casters are culled with the caster matrix, so a cascade is dirty when it or the render matrix moves
+	view = myCamera.getViewMatrix();
+	myBasicShader.set(viewLoc, view);
+	shadowCascades.Update(projection, view, lightDir, computeSceneBounds(), SHADOW_DISTANCE);
+	uint64_t dynamicCasters[gps::SHADOW_CASCADE_COUNT];
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		if (shadowCascades.isDirty(cascade)) {
+			drawObjects(depthMapShader, (gps::RenderPass)(gps::PASS_SHADOW + cascade));
+		}
+		dynamicCasters[cascade] = drawObjects(depthMapShader, (gps::RenderPass)(gps::PASS_SHADOW_DYNAMIC + cascade));
+	}
+	drawObjects(myBasicShader, gps::PASS_MAIN);
+	renderQueue.Sort();
+	instanceBuffer.Upload();
 
-	//draw the scene with shadows
+	//draw the scene with shadows, the static layers of unchanged cascades are kept from earlier frames
 	depthMapShader.useShaderProgram();
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	drawObjects(depthMapShader, true);
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		depthMapShader.set("lightSpaceTrMatrix", shadowCascades.getLightSpaceMatrix(cascade));
+		if (stressInstanceCount > 0) {
+			depthMapInstancedShader.set("lightSpaceTrMatrix", shadowCascades.getLightSpaceMatrix(cascade));
+		}
+		if (shadowCascades.isDirty(cascade)) {
+			GPS_GPU_ZONE("shadow static");
+			shadowCascades.BeginStaticLayer(cascade);
+			renderQueue.Submit((gps::RenderPass)(gps::PASS_SHADOW + cascade));
+		}
+		GPS_GPU_ZONE("shadow dynamic");
+		if (shadowCascades.BeginDynamicLayer(cascade, dynamicCasters[cascade] > 0)) {
+			renderQueue.Submit((gps::RenderPass)(gps::PASS_SHADOW_DYNAMIC + cascade));
+		}
+	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+	gps::GLInterceptor::Current().NoteCall(gps::GL_CALL_Viewport);
 
 	myBasicShader.useShaderProgram();
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap"), 3);
-	glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+	gps::GLState::Current().BindTexture(3, GL_TEXTURE_2D_ARRAY, shadowCascades.getStaticTexture());
+	gps::GLState::Current().BindTexture(4, GL_TEXTURE_2D_ARRAY, shadowCascades.getDynamicTexture());
+	myBasicShader.set("shadowMap", 3);
+	myBasicShader.set("dynamicShadowMap", 4);
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		myBasicShader.set(lightSpaceTrMatricesLoc[cascade], shadowCascades.getLightSpaceMatrix(cascade));
+	}
+	myBasicShader.set(cascadeSplitsLoc, shadowCascades.getSplits());
+	myBasicShader.set(cascadeBiasesLoc, shadowCascades.getBiases());
+
+	if (stressInstanceCount > 0) {
+		setInstancedUniforms();
+	}
 
-	drawObjects(myBasicShader, false);
+	{
+		GPS_GPU_ZONE("main");
+		renderQueue.Submit(gps::PASS_MAIN);
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
@@ -575,16 +907,15 @@ void renderModels(gps::Shader shader) {
 double valid;
 
 void renderScene() {
+	GPS_CPU_ZONE("renderScene");
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gps::GLInterceptor::Current().NoteCall(gps::GL_CALL_Clear);
 
 	// Update the rotation angle for modelElice
 	modelEagleAngle += 1.0f;
 
 	// Update the model matrix for modelElice
-	glm::mat4 modelEagleAngleMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(modelEagleAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-
-	// Send the updated model matrix to the shader for modelElice
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(modelEagleAngleMatrix));
+	modelEagleAngleMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(modelEagleAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 
 
 	; // Adjust the speed of the vertical movement as needed
@@ -592,37 +923,344 @@ void renderScene() {
 	lightDir.y = lightVerticalOffset;
 
 	// Update the light direction and fog density as needed
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
-	glUniform1f(fogDensityLoc, fogDensity);
+	myBasicShader.set(lightDirLoc, lightDir);
+	myBasicShader.set(fogDensityLoc, fogDensity);
 
 	// Animate the camera to move higher
 	double currentTimeStamp = glfwGetTime();
 	static double animationStartTime = glfwGetTime();
 	double elapsedTime = currentTimeStamp - animationStartTime;
 	valid = elapsedTime;
-	if (elapsedTime < 7.0) {
+	if (elapsedTime < 7.0 && !benchmarkMode) {
 		glm::vec3 cameraPosition = myCamera.getCameraPosition();
 		cameraPosition.y += 0.1f;
 		myCamera.setCameraPosition(cameraPosition);
 		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+		myBasicShader.set(viewLoc, view);
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
-	//modelElice.Draw(myBasicShader);
-	modelEagle.Draw(myBasicShader);
+	// the eagle casts its shadow through the dynamic layers, queued with the scene
+	renderQueue.Clear();
+	instanceBuffer.Clear();
+	gps::Frustum eagleFrustum(projection * myCamera.getViewMatrix() * modelEagleAngleMatrix);
+	gps::LodView eagleLod = lodViewFor(false, modelEagleAngleMatrix);
+	modelEagle.Submit(renderQueue, gps::PASS_MAIN, myBasicShader, renderQueue.AddTransform(modelEagleAngleMatrix, normalMatrix),
+		eagleFrustum, mainCullStats, lodEnabled ? &eagleLod : NULL);
 
 	// Render the rest of the scene
 	renderModels(myBasicShader);
 }
 
+void printFrameStats(unsigned long frames) {
+	if (frames == 0) {
+		return;
+	}
+	const gps::UniformStats& stats = gps::Shader::getUniformStats();
+	fprintf(stdout, "uniforms per frame: %.1f set calls, %.1f uploaded, %.1f skipped as unchanged\n",
+		(double)stats.setCalls / frames, (double)stats.uploads / frames,
+		(double)(stats.setCalls - stats.uploads) / frames);
+
+	const gps::RenderQueueStats& queue = renderQueue.getStats();
+	uint64_t staticShadowDraws = 0;
+	uint64_t dynamicShadowDraws = 0;
+	for (int cascade = 0; cascade < gps::SHADOW_CASCADE_COUNT; cascade++) {
+		staticShadowDraws += queue.passDraws[gps::PASS_SHADOW + cascade];
+		dynamicShadowDraws += queue.passDraws[gps::PASS_SHADOW_DYNAMIC + cascade];
+	}
+	fprintf(stdout, "draws per frame: static shadow %.1f, dynamic shadow %.1f, main pass %.1f\n",
+		(double)staticShadowDraws / frames, (double)dynamicShadowDraws / frames, (double)queue.passDraws[gps::PASS_MAIN] / frames);
+
+	if (stressInstanceCount > 0) {
+		const gps::InstanceBufferStats& instances = instanceBuffer.getStats();
+		fprintf(stdout, "instancing per frame: %.1f of %zu props drawn over all passes, %.1f KB streamed\n",
+			(double)instances.instances / frames, stressInstanceCount, (double)instances.bytes / 1024.0 / frames);
+	}
+
+	const gps::ShadowCascadeStats& cascades = shadowCascades.getStats();
+	fprintf(stdout, "shadow layers per frame: %.2f static, %.2f dynamic of %d cascades re-rendered\n",
+		(double)cascades.staticRenders / frames, (double)cascades.dynamicRenders / frames, gps::SHADOW_CASCADE_COUNT);
+	fprintf(stdout, "render queue per frame: %.1f draws of %.0f triangles, %.1f program + %.1f texture + %.1f VAO binds (%.1f drawing meshes directly)\n",
+		(double)queue.draws / frames, (double)queue.triangles / frames, (double)queue.programBinds / frames, (double)queue.textureBinds / frames,
+		(double)queue.vaoBinds / frames, (double)queue.directBinds / frames);
+	if (renderQueue.isIndirectEnabled()) {
+		fprintf(stdout, "multi-draw indirect per frame: %.1f calls covering %.1f of %.1f packets\n",
+			(double)queue.multiDraws / frames, (double)queue.indirectCommands / frames, (double)queue.packets / frames);
+	}
+
+	fprintf(stdout, "frustum culling per frame: shadow pass %.1f visible / %.1f culled, main pass %.1f visible / %.1f culled, %.1f BVH node tests\n",
+		(double)shadowCullStats.visible / frames, (double)(shadowCullStats.tested - shadowCullStats.visible) / frames,
+		(double)mainCullStats.visible / frames, (double)(mainCullStats.tested - mainCullStats.visible) / frames,
+		(double)(shadowCullStats.boxTests + mainCullStats.boxTests) / frames);
+
+	if (occlusionEnabled) {
+		const gps::OcclusionStats& occlusion = occlusionCuller.getStats();
+		fprintf(stdout, "occlusion culling per frame: %.1f meshes / props occluded in the main pass, %.0f occluder triangles (%.0f rasterized) in %.3f ms\n",
+			(double)mainCullStats.occluded / frames, (double)occlusion.occluderTriangles / frames,
+			(double)occlusion.rasterizedTriangles / frames, occlusion.milliseconds / frames);
+	}
+
+	if (lodEnabled) {
+		fprintf(stdout, "levels of detail per frame: shadow pass %.0f of %.0f triangles, main pass %.0f of %.0f triangles; main pass meshes per level",
+			(double)shadowLodStats.triangles / frames, (double)shadowLodStats.fullTriangles / frames,
+			(double)mainLodStats.triangles / frames, (double)mainLodStats.fullTriangles / frames);
+		for (uint32_t level = 0; level < gps::MAX_LOD_LEVELS; level++) {
+			fprintf(stdout, " %.1f", (double)mainLodStats.levelDraws[level] / frames);
+		}
+		fprintf(stdout, "\n");
+	}
+
+	std::vector<gps::GpuPassStats> gpuPasses = gps::GpuProfiler::Current().getStats();
+	for (size_t pass = 0; pass < gpuPasses.size(); pass++) {
+		fprintf(stdout, "GPU %s pass: min %.3f / avg %.3f / p99 %.3f ms over the last %llu of %llu frames\n", gpuPasses[pass].name,
+			gpuPasses[pass].minMilliseconds, gpuPasses[pass].avgMilliseconds, gpuPasses[pass].p99Milliseconds,
+			(unsigned long long)std::min<uint64_t>(gpuPasses[pass].frames, gps::GPU_PROFILER_WINDOW), (unsigned long long)gpuPasses[pass].frames);
+	}
+	if (gps::GpuProfiler::Current().getDroppedFrames() > 0) {
+		fprintf(stdout, "GPU profiler: %llu frames dropped, their queries were not back in time\n",
+			(unsigned long long)gps::GpuProfiler::Current().getDroppedFrames());
+	}
+
+	const gps::GLStateStats& state = gps::GLState::Current().getStats();
+	fprintf(stdout, "state tracker per frame: %.1f binds / state changes requested, %.1f reached GL\n",
+		(double)state.requested / frames, (double)state.issued / frames);
+
+	gps::GLInterceptor& gl = gps::GLInterceptor::Current();
+	if (gl.isInstalled()) {
+		gl.PrintReport(gl.getTotals(), gl.getTotalFrames(), "over the run");
+	}
+}
+
+// Startup ends once the first frame is on screen
+void finishStartup() {
+	gps::LoadTelemetry& telemetry = gps::LoadTelemetry::Current();
+	telemetry.FirstFrame();
+	telemetry.PrintSummary();
+	if (!loadReportFile.empty()) {
+		telemetry.WriteReport(loadReportFile);
+	}
+}
+
+// Moves the camera and the light to where the script has them at time
+void applyBenchmarkPose(double time) {
+	gps::BenchmarkPose pose = gps::SampleBenchmarkScript(benchmarkScript, time);
+
+	yaw = pose.yaw;
+	pitch = pose.pitch;
+	myCamera.setCameraPosition(pose.position);
+	myCamera.rotate(pitch, yaw);
+	view = myCamera.getViewMatrix();
+	myBasicShader.useShaderProgram();
+	myBasicShader.set(viewLoc, view);
+	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+
+	// renderScene raises the light by the sine of its vertical movement
+	glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(pose.lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+	lightDir = glm::vec3(rotationMatrix * glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+	lightVerticalMovement = pose.lightHeight;
+	fogDensity = pose.fogDensity;
+}
+
+// Hands the frame and pass times the GPU profiler has read back to the recorder, the warm-up frames are left out
+void recordPassTimes(gps::BenchmarkRecorder& recorder) {
+	std::vector<gps::GpuPassSample> samples;
+	gps::GpuProfiler::Current().TakeSamples(&samples);
+	for (size_t i = 0; i < samples.size(); i++) {
+		if (samples[i].frame < benchmarkScript.warmupFrames) {
+			continue;
+		}
+		uint32_t step = (uint32_t)(samples[i].frame - benchmarkScript.warmupFrames);
+		const char* pass = gps::GpuProfiler::Current().getPassName(samples[i].pass);
+		if (strcmp(pass, BENCHMARK_FRAME_ZONE) == 0) {
+			recorder.SetGpuTime(step, samples[i].milliseconds);
+		}
+		else {
+			recorder.SetPassTime(step, pass, samples[i].milliseconds);
+		}
+	}
+}
+
+// Replays the script with its fixed timestep, as fast as the frames render; returns the exit code
+int runBenchmark(const std::string& outputFile, unsigned long& frames) {
+	gps::BenchmarkRecorder recorder;
+	// on in release builds too, the frame and pass times are what the run is for
+	gps::GpuProfiler& profiler = gps::GpuProfiler::Current();
+	profiler.Enable(true);
+	profiler.KeepSamples(true);
+
+	aspectRatio = (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height;
+	deltaTime = benchmarkScript.timestep;
+	cameraSpeed = baseCameraSpeed * aspectRatio * deltaTime;
+
+	std::cout << "Benchmark : " << benchmarkScript.warmupFrames << " warm-up and " << benchmarkScript.frames << " measured frames at "
+		<< myWindow.getWindowDimensions().width << "x" << myWindow.getWindowDimensions().height << ", "
+		<< benchmarkScript.timestep * 1000.0 << " ms per frame of script time" << std::endl;
+
+	uint32_t totalFrames = benchmarkScript.warmupFrames + benchmarkScript.frames;
+	for (uint32_t frame = 0; frame < totalFrames && !glfwWindowShouldClose(myWindow.getWindow()); frame++) {
+
+		// the warm-up frames replay the start of the path, the measured ones all of it
+		bool measured = frame >= benchmarkScript.warmupFrames;
+		uint32_t step = measured ? frame - benchmarkScript.warmupFrames : frame;
+		double time = step * benchmarkScript.timestep;
+
+		// the counters below cover the measured frames only
+		if (frame == benchmarkScript.warmupFrames) {
+			gps::Shader::resetUniformStats();
+			renderQueue.resetStats();
+			gps::GLState::Current().resetStats();
+			shadowCascades.resetStats();
+			instanceBuffer.resetStats();
+			shadowCullStats = gps::CullStats();
+			mainCullStats = gps::CullStats();
+			shadowLodStats = gps::LodStats();
+			mainLodStats = gps::LodStats();
+			occlusionCuller.resetStats();
+			profiler.resetStats();
+			gps::GLInterceptor::Current().resetStats();
+			frames = 0;
+		}
+
+		uint64_t drawsBefore = renderQueue.getStats().draws;
+		uint64_t trianglesBefore = renderQueue.getStats().triangles;
+		if (measured) {
+			recorder.BeginFrame(step, time);
+		}
+		profiler.BeginFrame(frame);
+		// the frame zone includes glfwSwapBuffers, so vsync and present stalls are measured
+		uint32_t frameZone = profiler.BeginZone(BENCHMARK_FRAME_ZONE);
+
+		GPS_CPU_ZONE("frame");
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		applyBenchmarkPose(time);
+		renderScene();
+		glfwPollEvents();
+		{
+			GPS_CPU_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(myWindow.getWindow());
+		}
+		profiler.EndZone(frameZone);
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		gps::GLInterceptor& gl = gps::GLInterceptor::Current();
+		gl.EndFrame();
+		if (frame == 0) {
+			finishStartup();
+		}
+
+		if (measured) {
+			recorder.EndFrame(milliseconds, renderQueue.getStats().draws - drawsBefore,
+				renderQueue.getStats().triangles - trianglesBefore);
+			if (gl.isInstalled()) {
+				const gps::GLCallStats& calls = gl.getLastFrame();
+				recorder.SetCounter("gl_calls", calls.TotalCalls());
+				recorder.SetCounter("gl_redundant_binds", calls.TotalRedundantBinds());
+				recorder.SetCounter("gl_uniform_uploads", calls.uniformUploads);
+				recorder.SetCounter("gl_uniform_bytes", calls.uniformBytes);
+				recorder.SetCounter("gl_upload_bytes", calls.uploadBytes);
+			}
+			frames++;
+		}
+
+		recordPassTimes(recorder);
+
+		glCheckError();
+	}
+
+	profiler.Flush();
+	recordPassTimes(recorder);
+	profiler.KeepSamples(false);
+
+	recorder.PrintSummary();
+	return recorder.Write(outputFile) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 void cleanup() {
+	gps::GLInterceptor::Current().Uninstall();
+	gps::GpuProfiler::Current().Delete();
 	myWindow.Delete();
 	//cleanup code for your own data
 }
 
 int main(int argc, const char* argv[]) {
 
+	// parser benchmark, runs without opening a window
+	if (argc > 1 && std::string(argv[1]) == "--bench-obj") {
+		std::vector<std::string> files(argv + 2, argv + argc);
+		if (files.empty()) {
+			files.push_back("models/church/church.obj");
+			files.push_back("models/angle/angle.obj");
+			files.push_back("models/medieval_scene/eagle2.obj");
+		}
+		gps::BenchmarkObjParsers(files);
+		return EXIT_SUCCESS;
+	}
+
+	// cooks the .gpstex containers of every model and skybox image ahead of time, no window needed;
+	// --force re-cooks images whose container is still up to date
+	if (argc > 1 && std::string(argv[1]) == "--cook-textures") {
+		bool force = argc > 2 && std::string(argv[2]) == "--force";
+		int failed = gps::CookTextureFolder("models", true, force);
+		failed += gps::CookTextureFolder("skybox", false, force);
+		return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// instanced props benchmark, e.g. --stress 100000; --no-indirect draws mesh by mesh even where
+	// multi-draw indirect is available; --no-lod always draws the full meshes; --no-occlusion
+	// skips the software occlusion culling; --benchmark <script.json> replays a camera path in a
+	// hidden window and writes the frame times to --benchmark-out <file>, the script's output or benchmark.csv,
+	// it still needs a display (xvfb-run on a machine without one) but falls back to a software GL context;
+	// --trace <file.json> records CPU zones for chrome://tracing; --gl-stats [N] counts the GL calls
+	// of each frame and prints them every N frames; --load-report <file.json> writes where the startup time went
+	bool indirect = true;
+	std::string benchmarkFile;
+	std::string benchmarkOutput;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--benchmark" && i + 1 < argc) {
+			benchmarkFile = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--benchmark-out" && i + 1 < argc) {
+			benchmarkOutput = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+			traceFile = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--load-report" && i + 1 < argc) {
+			loadReportFile = argv[i + 1];
+		}
+		if (std::string(argv[i]) == "--gl-stats") {
+			glStatsEnabled = true;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+				glStatsInterval = (uint32_t)std::strtoul(argv[i + 1], NULL, 10);
+			}
+		}
+		if (std::string(argv[i]) == "--stress" && i + 1 < argc) {
+			stressInstanceCount = (size_t)std::strtoul(argv[i + 1], NULL, 10);
+		}
+		if (std::string(argv[i]) == "--no-indirect") {
+			indirect = false;
+		}
+		if (std::string(argv[i]) == "--no-lod") {
+			lodEnabled = false;
+		}
+		if (std::string(argv[i]) == "--no-occlusion") {
+			occlusionEnabled = false;
+		}
+	}
+
+	// before the window, so the loading shows in the trace
+	gps::CpuProfiler::SetThreadName("main");
+	gps::CpuProfiler::Enable(!traceFile.empty());
+
+	if (!benchmarkFile.empty()) {
+		if (!gps::LoadBenchmarkScript(benchmarkFile, &benchmarkScript)) {
+			return EXIT_FAILURE;
+		}
+		benchmarkMode = true;
+		if (benchmarkOutput.empty()) {
+			benchmarkOutput = benchmarkScript.output.empty() ? "benchmark.csv" : benchmarkScript.output;
+		}
+	}
+
 	try {
 		initOpenGLWindow();
 	}
@@ -635,26 +1273,86 @@ int main(int argc, const char* argv[]) {
 	initModels();
 	initShaders();
 	initUniforms();
-	setWindowCallbacks();
+	if (!benchmarkMode) {
+		setWindowCallbacks();
+	}
 	initSkybox();
-	initFBO();
+	{
+		gps::LoadStage stage("initShadowCascades");
+		shadowCascades.Init(SHADOW_CASCADE_RESOLUTION);
+	}
+	{
+		gps::LoadStage stage("initOcclusionCuller");
+		occlusionCuller.Init(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+	}
+	renderQueue.SetIndirectEnabled(indirect);
+	std::cout << "Multi-draw indirect: " << (renderQueue.isIndirectEnabled() ? "on" :
+		gps::RenderQueue::IndirectSupported() ? "off" : "not supported, drawing mesh by mesh") << std::endl;
+	if (stressInstanceCount > 0) {
+		initStressScene(stressInstanceCount);
+	}
+
+	// the setup above bound objects directly
+	gps::GLState::Current().Invalidate();
 
 	glCheckError();
 
+	// the counters cover the frames only, not the setup above
+	gps::Shader::resetUniformStats();
+	renderQueue.resetStats();
+	gps::GLState::Current().resetStats();
+	shadowCascades.resetStats();
+	instanceBuffer.resetStats();
+	shadowCullStats = gps::CullStats();
+	mainCullStats = gps::CullStats();
+	shadowLodStats = gps::LodStats();
+	mainLodStats = gps::LodStats();
+	occlusionCuller.resetStats();
+	unsigned long frames = 0;
+
+	// swapped in last, the loading above is not counted
+	if (glStatsEnabled) {
+		gps::GLInterceptor::Current().Install(glStatsInterval);
+	}
+
+	if (benchmarkMode) {
+		int result = runBenchmark(benchmarkOutput, frames);
+		printFrameStats(frames);
+		if (!traceFile.empty()) {
+			gps::CpuProfiler::WriteTrace(traceFile);
+		}
+		cleanup();
+		return result;
+	}
+
 	// application loop
 	while (!glfwWindowShouldClose(myWindow.getWindow())) {
 
+		GPS_CPU_ZONE("frame");
+		gps::GpuProfiler::Current().BeginFrame(frames);
 		processCameraSpeed();
 		if (valid > 7.0f) {
 			processMovement();
 		}
 		renderScene();
 		glfwPollEvents();
-		glfwSwapBuffers(myWindow.getWindow());
+		{
+			GPS_CPU_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(myWindow.getWindow());
+		}
+		gps::GLInterceptor::Current().EndFrame();
+		if (frames == 0) {
+			finishStartup();
+		}
+		frames++;
 
 		glCheckError();
 	}
 
+	printFrameStats(frames);
+	if (!traceFile.empty()) {
+		gps::CpuProfiler::WriteTrace(traceFile);
+	}
 	cleanup();
 
 	return EXIT_SUCCESS;
@@ -1,16 +1,14 @@
 #version 410 core
 
-in vec3 fPosition;
-in vec3 fNormal;
+in vec4 fPosEye;
+in vec4 fWorldPosition;
+in vec3 fNormalEye;
 in vec2 fTexCoords;
-in vec4 fragPosLightSpace;
 
 out vec4 fColor;
 
 //matrices
-uniform mat4 model;
 uniform mat4 view;
-uniform mat3 normalMatrix;
 uniform mat3 lightDirMatrix;
 //lighting
 uniform vec3 lightDir;
@@ -18,7 +16,13 @@ uniform vec3 lightColor;
 // textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
+//shadow cascades, must match SHADOW_CASCADE_COUNT
+const int CASCADE_COUNT = 4;
+uniform sampler2DArray shadowMap;
+uniform sampler2DArray dynamicShadowMap;
+uniform mat4 lightSpaceTrMatrices[CASCADE_COUNT];
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeBiases;
 
 //uniform float
 uniform float fogDensity;
@@ -32,9 +36,8 @@ float specularStrength = 0.5f;
 
 void computeDirLight()
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+    //eye space coordinates come from the vertex shader
+    vec3 normalEye = normalize(fNormalEye);
 
     //normalize light direction
     vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
@@ -60,7 +63,7 @@ void computeDirLight()
 float computeFog()
 {
  //float fogDensity = 0.05f;
- float fragmentDistance = length(view * model * vec4(fPosition, 1.0f));
+ float fragmentDistance = length(fPosEye);
  float fogFactor = exp(-pow(fragmentDistance * fogDensity, 2));
 
  return clamp(fogFactor, 0.0f, 1.0f);
@@ -68,15 +71,26 @@ float computeFog()
 
 float computeShadow()
 {
-    float bias = 0.005f;
+    //pick the first cascade whose split is beyond the fragment
+    vec4 worldPosition = fWorldPosition;
+    float viewDepth = -fPosEye.z;
+    int cascade = 0;
+    while(cascade < CASCADE_COUNT && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if(cascade == CASCADE_COUNT)
+        return 0.0f;
+
+    vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * worldPosition;
     vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     if(normalizedCoords.z > 1.0f)
         return 0.0f;
 
     normalizedCoords = normalizedCoords * 0.5f + 0.5f;
-    float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+    //the static scene and the moving models are kept in separate layers
+    vec3 layerCoords = vec3(normalizedCoords.xy, cascade);
+    float closestDepth = min(texture(shadowMap, layerCoords).r, texture(dynamicShadowMap, layerCoords).r);
     float currentDepth = normalizedCoords.z;
-    float shadow = currentDepth - bias > closestDepth ? 1.0f : 0.0f;
+    float shadow = currentDepth - cascadeBiases[cascade] > closestDepth ? 1.0f : 0.0f;
 
     return shadow;
 }
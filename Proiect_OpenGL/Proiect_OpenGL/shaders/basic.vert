@@ -3,22 +3,39 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+//index of the draw in drawTransforms, the base instance of a multi-draw indirect command
+layout(location=7) in uint drawIndex;
 
-out vec3 fPosition;
-out vec3 fNormal;
+out vec4 fPosEye;
+out vec4 fWorldPosition;
+out vec3 fNormalEye;
 out vec2 fTexCoords;
-out vec4 fragPosLightSpace;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceTrMatrix;
+uniform mat3 normalMatrix;
+
+//multi-draw indirect: model and normal matrix of each draw come from drawTransforms
+//(7 texels per draw: the model columns, then the normal matrix columns)
+uniform bool indirectDraw;
+uniform samplerBuffer drawTransforms;
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	mat4 drawModel = model;
+	mat3 drawNormalMatrix = normalMatrix;
+	if (indirectDraw) {
+		int base = int(drawIndex) * 7;
+		drawModel = mat4(texelFetch(drawTransforms, base), texelFetch(drawTransforms, base + 1),
+			texelFetch(drawTransforms, base + 2), texelFetch(drawTransforms, base + 3));
+		drawNormalMatrix = mat3(texelFetch(drawTransforms, base + 4).xyz, texelFetch(drawTransforms, base + 5).xyz,
+			texelFetch(drawTransforms, base + 6).xyz);
+	}
+
+	fWorldPosition = drawModel * vec4(vPosition, 1.0f);
+	fPosEye = view * fWorldPosition;
+	gl_Position = projection * fPosEye;
+	fNormalEye = drawNormalMatrix * vNormal;
 	fTexCoords = vTexCoords;
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
 }
@@ -0,0 +1,26 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//model matrix of the instance, one column per location
+layout(location=3) in mat4 instanceModel;
+
+out vec4 fPosEye;
+out vec4 fWorldPosition;
+out vec3 fNormalEye;
+out vec2 fTexCoords;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+//drawn with basic.frag; the props are only rotated and uniformly scaled, so the model matrix
+//turns normals as well
+void main() 
+{
+	fWorldPosition = instanceModel * vec4(vPosition, 1.0f);
+	fPosEye = view * fWorldPosition;
+	gl_Position = projection * fPosEye;
+	fNormalEye = mat3(view) * mat3(instanceModel) * vNormal;
+	fTexCoords = vTexCoords;
+}
@@ -1,11 +1,23 @@
 #version 410 core
 
 layout(location=0) in vec3 vPosition;
+//index of the draw in drawTransforms, the base instance of a multi-draw indirect command
+layout(location=7) in uint drawIndex;
 
 uniform mat4 lightSpaceTrMatrix;
 uniform mat4 model;
 
+//multi-draw indirect: the model matrix of each draw comes from drawTransforms, same layout as basic.vert
+uniform bool indirectDraw;
+uniform samplerBuffer drawTransforms;
+
 void main()
 {
-    gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
-}
\ No newline at end of file
+    mat4 drawModel = model;
+    if (indirectDraw) {
+        int base = int(drawIndex) * 7;
+        drawModel = mat4(texelFetch(drawTransforms, base), texelFetch(drawTransforms, base + 1),
+            texelFetch(drawTransforms, base + 2), texelFetch(drawTransforms, base + 3));
+    }
+    gl_Position = lightSpaceTrMatrix * drawModel * vec4(vPosition, 1.0f);
+}
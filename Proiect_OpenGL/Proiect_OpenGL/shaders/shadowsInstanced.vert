@@ -0,0 +1,12 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+//model matrix of the instance, one column per location
+layout(location=3) in mat4 instanceModel;
+
+uniform mat4 lightSpaceTrMatrix;
+
+void main()
+{
+    gl_Position = lightSpaceTrMatrix * instanceModel * vec4(vPosition, 1.0f);
+}
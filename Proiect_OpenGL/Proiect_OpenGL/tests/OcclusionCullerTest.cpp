@@ -0,0 +1,97 @@
+// Headless check of the software occlusion culler: a quad occluder is rasterized in front of the
+// camera and boxes around it are tested against it. Needs no window or GL context; built from the
+// project directory with the culler and the thread pool it splits work over, e.g.
+//   g++ -std=c++14 -O2 -I. -I<glm> tests/OcclusionCullerTest.cpp OcclusionCuller.cpp ThreadPool.cpp CpuProfiler.cpp Json.cpp -lpthread
+// Returns 0 when every check passes.
+
+#include "../OcclusionCuller.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+
+    fprintf(stdout, "%s : %s\n", condition ? "ok  " : "FAIL", what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+static gps::BoundingBox Box(const glm::vec3& min, const glm::vec3& max) {
+
+    gps::BoundingBox box;
+    box.min = min;
+    box.max = max;
+    return box;
+}
+
+int main() {
+
+    // camera at z = 5 looking down -z, the occluder is a 4x4 quad at z = 0 filling the middle of the view
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 worldToClip = projection * view;
+
+    const glm::vec3 quad[4] = {
+        glm::vec3(-2.0f, -2.0f, 0.0f), glm::vec3(2.0f, -2.0f, 0.0f), glm::vec3(2.0f, 2.0f, 0.0f), glm::vec3(-2.0f, 2.0f, 0.0f)
+    };
+    const uint32_t quadTriangles[6] = { 0, 1, 2, 0, 2, 3 };
+
+    gps::OcclusionCuller culler;
+    culler.Init(64, 64);
+    culler.Begin();
+    culler.AddOccluder(quad, 4, quadTriangles, 2, worldToClip);
+    culler.Finish();
+
+    Check(culler.getDepth(culler.getWidth() / 2, culler.getHeight() / 2) < 1.0f, "the quad covers the middle of the depth buffer");
+    Check(culler.getDepth(0, 0) == 1.0f, "the corner of the depth buffer stays clear");
+
+    gps::BoundingBox behind = Box(glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, -2.0f));
+    gps::BoundingBox inFront = Box(glm::vec3(-0.5f, -0.5f, 1.0f), glm::vec3(0.5f, 0.5f, 2.0f));
+    gps::BoundingBox partlyUncovered = Box(glm::vec3(1.5f, -0.5f, -3.0f), glm::vec3(3.5f, 0.5f, -2.0f));
+    gps::BoundingBox straddling = Box(glm::vec3(-0.5f, -0.5f, -1.0f), glm::vec3(0.5f, 0.5f, 1.0f));
+    gps::BoundingBox throughNear = Box(glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, 6.0f));
+    gps::BoundingBox behindCamera = Box(glm::vec3(-0.5f, -0.5f, 6.0f), glm::vec3(0.5f, 0.5f, 7.0f));
+
+    Check(!culler.IsVisible(behind, worldToClip), "a box fully behind the quad is culled");
+    Check(culler.IsVisible(inFront, worldToClip), "a box in front of the quad is kept");
+    Check(culler.IsVisible(partlyUncovered, worldToClip), "a box behind the quad sticking out past its edge is kept");
+    Check(culler.IsVisible(straddling, worldToClip), "a box reaching through the quad is kept");
+    Check(culler.IsVisible(throughNear, worldToClip), "a box crossing the near plane is kept");
+    Check(culler.IsVisible(behindCamera, worldToClip), "a box behind the camera is kept");
+
+    // the same boxes in object space of a model moved back by 1, through the batch path
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    std::vector<gps::BoundingBox> boxes;
+    boxes.push_back(Box(glm::vec3(-0.5f, -0.5f, -2.0f), glm::vec3(0.5f, 0.5f, -1.0f)));
+    boxes.push_back(Box(glm::vec3(-0.5f, -0.5f, 2.0f), glm::vec3(0.5f, 0.5f, 3.0f)));
+    boxes.push_back(Box(glm::vec3(1.5f, -0.5f, -2.0f), glm::vec3(3.5f, 0.5f, -1.0f)));
+    std::vector<uint8_t> visible(boxes.size(), 1);
+    size_t hidden = culler.Cull(boxes.data(), boxes.size(), worldToClip * model, visible.data());
+    Check(hidden == 1 && !visible[0] && visible[1] && visible[2], "Cull hides only the box behind the quad");
+
+    // a wall filling the whole view: only the near plane tests keep boxes reaching past the camera,
+    // their projected corners would otherwise land far behind the wall
+    const glm::vec3 wall[4] = {
+        glm::vec3(-20.0f, -20.0f, 0.0f), glm::vec3(20.0f, -20.0f, 0.0f), glm::vec3(20.0f, 20.0f, 0.0f), glm::vec3(-20.0f, 20.0f, 0.0f)
+    };
+    culler.Begin();
+    culler.AddOccluder(wall, 4, quadTriangles, 2, worldToClip);
+    culler.Finish();
+    Check(!culler.IsVisible(behind, worldToClip), "a box behind the wall is culled");
+    Check(culler.IsVisible(Box(glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, 5.5f)), worldToClip),
+        "a box from behind the wall to behind the camera is kept");
+
+    // nothing rasterized, nothing hidden
+    culler.Begin();
+    culler.Finish();
+    Check(culler.IsVisible(behind, worldToClip), "without occluders every box is kept");
+
+    fprintf(stdout, failures == 0 ? "all checks passed\n" : "%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}